@@ -0,0 +1,52 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __sim_adafruit_bme280_h__
+#define __sim_adafruit_bme280_h__
+
+#include <Arduino.h>
+
+typedef struct
+{
+    float temperature;
+    float relative_humidity;
+} sensors_event_t;
+
+class Adafruit_Sensor
+{
+public:
+    bool getEvent(sensors_event_t *e)
+    {
+        e->temperature = NAN;
+        e->relative_humidity = NAN;
+        return false;
+    }
+};
+
+/* not connected */
+class Adafruit_BME280
+{
+    Adafruit_Sensor dummy;
+
+public:
+    bool begin(uint8_t addr = 0x77) { return false; }
+    Adafruit_Sensor *getTemperatureSensor(void) { return &dummy; }
+    Adafruit_Sensor *getHumiditySensor(void) { return &dummy; }
+};
+
+#endif
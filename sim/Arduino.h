@@ -0,0 +1,142 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __sim_arduino_h__
+#define __sim_arduino_h__
+
+/* thin host replacement for the esp32 arduino core, see sim_hal.cpp;
+   also pulled in by lvgl (LV_TICK_CUSTOM_INCLUDE), hence C compatible */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x02
+#define INPUT_PULLUP 0x05
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define F(s) (s)
+#define FPSTR(p) (p)
+#define IRAM_ATTR
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    unsigned long millis(void);
+    unsigned long micros(void);
+    void delay(uint32_t ms);
+    void yield(void);
+
+    void pinMode(uint8_t pin, uint8_t mode);
+    void digitalWrite(uint8_t pin, uint8_t val);
+    int digitalRead(uint8_t pin);
+    uint16_t analogRead(uint8_t pin);
+
+    double ledcSetup(uint8_t chan, double freq, uint8_t bit_num);
+    void ledcWrite(uint8_t chan, uint32_t duty);
+    uint32_t ledcRead(uint8_t chan);
+    double ledcWriteTone(uint8_t chan, double freq);
+    void ledcAttachPin(uint8_t pin, uint8_t chan);
+    void ledcDetachPin(uint8_t pin);
+
+    /* FreeRTOS subset, tasks are host threads */
+    typedef struct sim_sem *SemaphoreHandle_t;
+    typedef struct sim_task *TaskHandle_t;
+    typedef struct sim_queue *QueueHandle_t;
+    typedef uint32_t TickType_t;
+    typedef int BaseType_t;
+    typedef unsigned int UBaseType_t;
+    typedef void (*TaskFunction_t)(void *);
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define configMAX_PRIORITIES 25
+#define tskNO_AFFINITY 0x7fffffff
+
+    SemaphoreHandle_t xSemaphoreCreateMutex(void);
+    BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks);
+    BaseType_t xSemaphoreGive(SemaphoreHandle_t s);
+    void vSemaphoreDelete(SemaphoreHandle_t s);
+
+    QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size);
+    BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks);
+    BaseType_t xQueueReceive(QueueHandle_t q, void *buf, TickType_t ticks);
+    UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q);
+
+    BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack,
+                                       void *arg, UBaseType_t prio, TaskHandle_t *h, BaseType_t core);
+    static inline BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack,
+                                         void *arg, UBaseType_t prio, TaskHandle_t *h)
+    {
+        return xTaskCreatePinnedToCore(fn, name, stack, arg, prio, h, tskNO_AFFINITY);
+    }
+    void vTaskDelete(TaskHandle_t t);
+    void vTaskDelay(TickType_t ticks);
+    UBaseType_t uxTaskPriorityGet(TaskHandle_t t);
+#ifdef __cplusplus
+}
+
+#include <algorithm>
+#include "WString.h"
+
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+
+class HardwareSerial
+{
+public:
+    void begin(unsigned long baud) {}
+    size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+    size_t print(const String &s) { return fwrite(s.c_str(), 1, s.length(), stdout); }
+    size_t print(const char *s) { return fputs(s, stdout); }
+    template <typename T>
+    size_t print(T v) { return print(String(v)); }
+    size_t println(void) { return print("\n"); }
+    template <typename T>
+    size_t println(const T &v) { return print(v) + println(); }
+};
+extern HardwareSerial Serial;
+
+class EspClass
+{
+public:
+    void restart(void);
+    uint32_t getFreeHeap(void);
+};
+extern EspClass ESP;
+
+void configTime(long gmtOffset_sec, int daylightOffset_sec, const char *server1,
+                const char *server2 = nullptr, const char *server3 = nullptr);
+bool getLocalTime(struct tm *info, uint32_t ms = 5000);
+#endif
+
+#endif
@@ -0,0 +1,51 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __sim_dhtesp_h__
+#define __sim_dhtesp_h__
+
+#include <Arduino.h>
+
+struct TempAndHumidity
+{
+    float temperature;
+    float humidity;
+};
+
+/* reads the analog value table of its pin: temperature in 1/10 C, humidity fixed */
+class DHTesp
+{
+    uint8_t pin = 0;
+
+public:
+    typedef enum
+    {
+        AUTO_DETECT,
+        DHT11,
+        DHT22,
+        AM2302,
+        RHT03
+    } DHT_MODEL_t;
+
+    void setup(uint8_t p, DHT_MODEL_t m = AUTO_DETECT) { pin = p; }
+    TempAndHumidity getTempAndHumidity(void) { return TempAndHumidity{analogRead(pin) / 10.0f, 65.0f}; }
+    int getStatus(void) { return 0; }
+    const char *getStatusString(void) { return "OK"; }
+};
+
+#endif
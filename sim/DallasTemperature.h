@@ -0,0 +1,74 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __sim_dallastemperature_h__
+#define __sim_dallastemperature_h__
+
+#include "OneWire.h"
+
+#define DEVICE_DISCONNECTED_C -127
+typedef uint8_t DeviceAddress[8];
+
+/* DS18B20 at 12 bit: a conversion takes 750ms, reading one scratchpad by address 11ms
+   (reset, match ROM, 9 bytes); readings are 22.5C + 0.25C per device index */
+class DallasTemperature
+{
+    OneWire *wire;
+    bool wait = true;
+    uint64_t conv_done = 0;
+
+public:
+    DallasTemperature(OneWire *w) : wire(w) {}
+    void begin(void)
+    {
+        DeviceAddress a;
+        wire->reset_search();
+        while (wire->search(a))
+            ;
+        wire->reset_search();
+    }
+    void setWaitForConversion(bool w) { wait = w; }
+    uint8_t getResolution(void) { return 12; }
+    int16_t millisToWaitForConversion(uint8_t bits) { return 750; }
+    void requestTemperatures(void)
+    {
+        sim_busy(2);
+        conv_done = sim_now_ms() + 750;
+        if (wait)
+            sim_busy(750);
+    }
+    bool isConversionComplete(void) { return sim_now_ms() >= conv_done; }
+    float getTempC(const uint8_t *addr)
+    {
+        sim_busy(11);
+        if ((addr[0] != 0x28) || (addr[1] >= sim_onewire_devices()) || !conv_done)
+            return DEVICE_DISCONNECTED_C;
+        return 22.5 + 0.25 * addr[1];
+    }
+    float getTempCByIndex(uint8_t i)
+    {
+        DeviceAddress a;
+        wire->reset_search();
+        for (int n = 0; n <= i; n++)
+            if (!wire->search(a))
+                return DEVICE_DISCONNECTED_C;
+        return getTempC(a);
+    }
+};
+
+#endif
@@ -0,0 +1,44 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __sim_esp32servo_h__
+#define __sim_esp32servo_h__
+
+#include <Arduino.h>
+
+class Servo
+{
+    int pin = -1;
+    int angle = 0;
+
+public:
+    int attach(int p, int min = 544, int max = 2400)
+    {
+        pin = p;
+        return 0;
+    }
+    void write(int v)
+    {
+        angle = v;
+        if (pin >= 0)
+            digitalWrite(pin, v ? HIGH : LOW); /* make servo moves visible in gpio traces */
+    }
+    int read(void) { return angle; }
+};
+
+#endif
@@ -0,0 +1,32 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __sim_espmdns_h__
+#define __sim_espmdns_h__
+
+#include "WiFi.h"
+
+class MDNSResponder
+{
+public:
+    bool begin(const char *hostname) { return true; }
+    IPAddress queryHost(const char *host, uint32_t timeout = 2000) { return IPAddress(127, 0, 0, 1); }
+};
+extern MDNSResponder MDNS;
+
+#endif
@@ -0,0 +1,70 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __sim_littlefs_h__
+#define __sim_littlefs_h__
+
+#include <stdio.h>
+#include <dirent.h>
+#include <Arduino.h>
+
+/* LittleFS on a host directory (FCC_SIM_FS, else a fresh temporary one per run);
+   the flash cost of writes is estimated in sim_fs_stats() */
+class File
+{
+    FILE *f = nullptr;
+    DIR *d = nullptr;
+    String path, base;
+    bool writing = false;
+    size_t written = 0;
+    size_t held = 0; /* blocks of the version being rewritten, until close */
+
+public:
+    File() = default;
+    File(FILE *fp, const String &p, bool w, size_t h = 0) : f(fp), path(p), writing(w), held(h) { set_base(); }
+    File(DIR *dp, const String &p) : d(dp), path(p) { set_base(); }
+    void set_base(void)
+    {
+        int s = path.lastIndexOf('/');
+        base = (s < 0) ? path : path.substring(s + 1);
+    }
+    operator bool() const { return f || d; }
+    size_t write(const uint8_t *buf, size_t len);
+    size_t read(uint8_t *buf, size_t len) { return f ? fread(buf, 1, len, f) : 0; }
+    bool seek(uint32_t pos) { return f && !fseek(f, pos, SEEK_SET); }
+    size_t size(void);
+    const char *name(void) const { return base.c_str(); }
+    bool isDirectory(void) const { return d != nullptr; }
+    File openNextFile(void);
+    void close(void);
+};
+
+class LittleFSFS
+{
+public:
+    bool begin(bool formatOnFail = false);
+    File open(const char *path, const char *mode = "r");
+    File open(const String &path, const char *mode = "r") { return open(path.c_str(), mode); }
+    bool exists(const char *path);
+    bool exists(const String &path) { return exists(path.c_str()); }
+    bool remove(const char *path);
+    bool remove(const String &path) { return remove(path.c_str()); }
+};
+extern LittleFSFS LittleFS;
+
+#endif
@@ -0,0 +1,64 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __sim_mqtt_h__
+#define __sim_mqtt_h__
+
+/* MQTTClient (256dpi/MQTT) talking to the in-process broker stand-in in sim_mqtt.cpp */
+
+#include <Arduino.h>
+#include <list>
+#include "Client.h"
+
+typedef void (*MQTTClientCallbackSimple)(String &topic, String &payload);
+
+typedef enum
+{
+    LWMQTT_SUCCESS = 0,
+    LWMQTT_NETWORK_FAILED_CONNECT = -3,
+    LWMQTT_MISSING_OR_WRONG_PACKET = -9,
+} lwmqtt_err_t;
+
+class MQTTClient
+{
+    MQTTClientCallbackSimple cb = nullptr;
+    std::list<String> subscriptions;
+    bool conn = false;
+    lwmqtt_err_t err = LWMQTT_SUCCESS;
+
+public:
+    explicit MQTTClient(int buf_size = 128);
+    ~MQTTClient();
+
+    void begin(const char *host, int port, Client &net) {}
+    void begin(const char *host, Client &net) {}
+    void onMessage(MQTTClientCallbackSimple fn) { cb = fn; }
+    bool connect(const char *id, const char *user = nullptr, const char *pw = nullptr, bool skip = false);
+    bool disconnect(void);
+    bool connected(void);
+    bool subscribe(const String &topic, int qos = 0);
+    bool publish(const String &topic, const String &payload, bool retained = false, int qos = 0);
+    bool publish(const char topic[], const char payload[], bool retained = false, int qos = 0);
+    bool publish(const char topic[], const char payload[], int length, bool retained, int qos);
+    bool loop(void);
+    lwmqtt_err_t lastError(void) { return err; }
+
+    bool sim_deliver(const String &topic, const String &payload);
+};
+
+#endif
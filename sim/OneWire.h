@@ -0,0 +1,45 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __sim_onewire_h__
+#define __sim_onewire_h__
+
+#include <Arduino.h>
+#include "sim.h"
+
+/* sim_onewire_devices() DS18B20 on the bus; bus time advances the virtual clock at roughly
+   the real cost: reset 1ms, one search step (64 ROM bits, 3 slots each) 13ms */
+class OneWire
+{
+    int next = 0;
+
+public:
+    OneWire(uint8_t pin) {}
+    bool search(uint8_t *addr)
+    {
+        sim_busy(1 + 13);
+        if (next >= sim_onewire_devices())
+            return false;
+        uint8_t rom[8] = {0x28, static_cast<uint8_t>(next++), 0, 0, 0, 0, 0, 0};
+        memcpy(addr, rom, 8);
+        return true;
+    }
+    void reset_search(void) { next = 0; }
+};
+
+#endif
@@ -0,0 +1,222 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __sim_wstring_h__
+#define __sim_wstring_h__
+
+/* Arduino String for the host build, same interface as far as formicula uses it */
+
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <utility>
+
+class String
+{
+    std::string s;
+
+    static std::string num(long v, unsigned char base)
+    {
+        if (base == 10)
+            return std::to_string(v);
+        return unum(static_cast<unsigned long>(v), base);
+    }
+    static std::string unum(unsigned long v, unsigned char base)
+    {
+        char buf[8 * sizeof(unsigned long) + 1];
+        char *p = buf + sizeof(buf) - 1;
+        *p = '\0';
+        do
+        {
+            int d = v % base;
+            *--p = (d < 10) ? ('0' + d) : ('a' + d - 10);
+            v /= base;
+        } while (v);
+        return std::string(p);
+    }
+    static std::string flt(double v, unsigned char decimals)
+    {
+        char buf[48];
+        snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+        return std::string(buf);
+    }
+
+public:
+    String(const char *c = "") : s(c ? c : "") {}
+    String(const String &o) = default;
+    String(String &&o) = default;
+    explicit String(char c) : s(1, c) {}
+    explicit String(unsigned char v, unsigned char base = 10) : s(unum(v, base)) {}
+    explicit String(int v, unsigned char base = 10) : s(num(v, base)) {}
+    explicit String(unsigned int v, unsigned char base = 10) : s(unum(v, base)) {}
+    explicit String(long v, unsigned char base = 10) : s(num(v, base)) {}
+    explicit String(unsigned long v, unsigned char base = 10) : s(unum(v, base)) {}
+    explicit String(float v, unsigned char decimals = 2) : s(flt(v, decimals)) {}
+    explicit String(double v, unsigned char decimals = 2) : s(flt(v, decimals)) {}
+    ~String() = default;
+
+    String &operator=(const String &o) = default;
+    String &operator=(String &&o) = default;
+    String &operator=(const char *c)
+    {
+        s = c ? c : "";
+        return *this;
+    }
+
+    inline const char *c_str(void) const { return s.c_str(); }
+    inline unsigned int length(void) const { return s.length(); }
+    inline bool reserve(unsigned int n)
+    {
+        s.reserve(n);
+        return true;
+    }
+
+    String &operator+=(const String &o)
+    {
+        s += o.s;
+        return *this;
+    }
+    String &operator+=(const char *c)
+    {
+        if (c)
+            s += c;
+        return *this;
+    }
+    String &operator+=(char c)
+    {
+        s += c;
+        return *this;
+    }
+    String &operator+=(unsigned char v) { return *this += String(v); }
+    String &operator+=(int v) { return *this += String(v); }
+    String &operator+=(unsigned int v) { return *this += String(v); }
+    String &operator+=(long v) { return *this += String(v); }
+    String &operator+=(unsigned long v) { return *this += String(v); }
+    String &operator+=(float v) { return *this += String(v); }
+    String &operator+=(double v) { return *this += String(v); }
+    template <typename T>
+    bool concat(const T &v)
+    {
+        *this += v;
+        return true;
+    }
+
+    bool equals(const String &o) const { return s == o.s; }
+    bool equals(const char *c) const { return s == (c ? c : ""); }
+    int compareTo(const String &o) const { return s.compare(o.s); }
+    bool startsWith(const String &p) const { return s.compare(0, p.s.length(), p.s) == 0; }
+    bool startsWith(const String &p, unsigned int offset) const
+    {
+        return (offset <= s.length()) && (s.compare(offset, p.s.length(), p.s) == 0);
+    }
+    bool endsWith(const String &p) const
+    {
+        return (p.s.length() <= s.length()) && (s.compare(s.length() - p.s.length(), p.s.length(), p.s) == 0);
+    }
+
+    char charAt(unsigned int i) const { return (i < s.length()) ? s[i] : 0; }
+    char operator[](unsigned int i) const { return charAt(i); }
+    char &operator[](unsigned int i) { return s[i]; }
+
+    int indexOf(char c, unsigned int from = 0) const
+    {
+        size_t r = s.find(c, from);
+        return (r == std::string::npos) ? -1 : static_cast<int>(r);
+    }
+    int indexOf(const String &str, unsigned int from = 0) const
+    {
+        size_t r = s.find(str.s, from);
+        return (r == std::string::npos) ? -1 : static_cast<int>(r);
+    }
+    int lastIndexOf(char c) const
+    {
+        size_t r = s.rfind(c);
+        return (r == std::string::npos) ? -1 : static_cast<int>(r);
+    }
+    String substring(unsigned int from) const { return substring(from, s.length()); }
+    String substring(unsigned int from, unsigned int to) const
+    {
+        if (from > to)
+            std::swap(from, to);
+        if (from >= s.length())
+            return String();
+        return String(s.substr(from, to - from).c_str());
+    }
+
+    void replace(const String &f, const String &r)
+    {
+        if (f.s.empty())
+            return;
+        for (size_t p = s.find(f.s); p != std::string::npos; p = s.find(f.s, p + r.s.length()))
+            s.replace(p, f.s.length(), r.s);
+    }
+    void remove(unsigned int index) { remove(index, s.length()); }
+    void remove(unsigned int index, unsigned int count)
+    {
+        if (index < s.length())
+            s.erase(index, count);
+    }
+    void toLowerCase(void)
+    {
+        for (auto &c : s)
+            c = tolower(c);
+    }
+    void toUpperCase(void)
+    {
+        for (auto &c : s)
+            c = toupper(c);
+    }
+    void trim(void)
+    {
+        size_t b = s.find_first_not_of(" \t\r\n");
+        size_t e = s.find_last_not_of(" \t\r\n");
+        s = (b == std::string::npos) ? std::string() : s.substr(b, e - b + 1);
+    }
+    long toInt(void) const { return atol(s.c_str()); }
+    float toFloat(void) const { return atof(s.c_str()); }
+};
+
+template <typename T>
+inline String operator+(const String &lhs, const T &rhs)
+{
+    String r(lhs);
+    r += rhs;
+    return r;
+}
+inline String operator+(const char *lhs, const String &rhs)
+{
+    String r(lhs);
+    r += rhs;
+    return r;
+}
+inline String operator+(char lhs, const String &rhs)
+{
+    String r(lhs);
+    r += rhs;
+    return r;
+}
+
+inline bool operator==(const String &a, const String &b) { return a.equals(b); }
+inline bool operator==(const String &a, const char *b) { return a.equals(b); }
+inline bool operator==(const char *a, const String &b) { return b.equals(a); }
+inline bool operator!=(const String &a, const String &b) { return !a.equals(b); }
+inline bool operator!=(const String &a, const char *b) { return !a.equals(b); }
+inline bool operator<(const String &a, const String &b) { return a.compareTo(b) < 0; }
+
+#endif
@@ -0,0 +1,122 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __sim_webserver_h__
+#define __sim_webserver_h__
+
+#include <functional>
+#include <vector>
+#include "WiFi.h"
+
+typedef enum
+{
+    HTTP_ANY,
+    HTTP_GET,
+    HTTP_HEAD,
+    HTTP_POST,
+    HTTP_PUT,
+    HTTP_PATCH,
+    HTTP_DELETE,
+    HTTP_OPTIONS
+} HTTPMethod;
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+
+/* no sockets: requests are issued by the simulation via sim_get(), the response body goes to a sink */
+class WebServer
+{
+public:
+    typedef std::function<void(void)> THandlerFunction;
+    typedef std::function<void(const char *, size_t)> sim_sink_t;
+
+private:
+    struct handler_t
+    {
+        String uri;
+        HTTPMethod method;
+        THandlerFunction fn;
+    };
+    std::vector<handler_t> handlers;
+    std::vector<std::pair<String, String>> args;
+    String cur_uri;
+    sim_sink_t sink;
+
+public:
+    WebServer(int port = 80) {}
+    ~WebServer() = default;
+
+    void begin(void) {}
+    void handleClient(void) {}
+    void on(const String &uri, THandlerFunction fn) { on(uri, HTTP_ANY, fn); }
+    void on(const String &uri, HTTPMethod m, THandlerFunction fn) { handlers.push_back(handler_t{uri, m, fn}); }
+    String uri(void) { return cur_uri; }
+    bool hasArg(const String &n)
+    {
+        for (auto &a : args)
+            if (a.first == n)
+                return true;
+        return false;
+    }
+    String arg(const String &n)
+    {
+        for (auto &a : args)
+            if (a.first == n)
+                return a.second;
+        return String("");
+    }
+
+    void setContentLength(size_t len) {}
+    void send(int code, const char *type, const String &content) { sendContent(content); }
+    void sendContent(const String &c) { sendContent_P(c.c_str(), c.length()); }
+    void sendContent_P(const char *c) { sendContent_P(c, strlen(c)); }
+    void sendContent_P(const char *c, size_t len)
+    {
+        if (sink && len)
+            sink(c, len);
+    }
+
+    /* uri may carry a query, "?a=1&b=2", no %-decoding */
+    bool sim_get(const String &req, sim_sink_t s)
+    {
+        int q = req.indexOf('?');
+        String uri = (q < 0) ? req : req.substring(0, q);
+        args.clear();
+        for (String rest = (q < 0) ? String("") : req.substring(q + 1); rest.length();)
+        {
+            int amp = rest.indexOf('&');
+            String kv = (amp < 0) ? rest : rest.substring(0, amp);
+            rest = (amp < 0) ? String("") : rest.substring(amp + 1);
+            int eq = kv.indexOf('=');
+            args.push_back({(eq < 0) ? kv : kv.substring(0, eq), (eq < 0) ? String("") : kv.substring(eq + 1)});
+        }
+        for (auto &h : handlers)
+        {
+            if (h.uri == uri && (h.method == HTTP_ANY || h.method == HTTP_GET))
+            {
+                cur_uri = uri;
+                sink = s;
+                h.fn();
+                sink = nullptr;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,62 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __sim_wifi_h__
+#define __sim_wifi_h__
+
+#include <Arduino.h>
+#include "Client.h"
+
+class IPAddress
+{
+    uint8_t a[4];
+
+public:
+    IPAddress(uint8_t a0 = 0, uint8_t a1 = 0, uint8_t a2 = 0, uint8_t a3 = 0) : a{a0, a1, a2, a3} {}
+    operator uint32_t() const { return a[0] | (a[1] << 8) | (a[2] << 16) | (uint32_t(a[3]) << 24); }
+    String toString() const
+    {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u", a[0], a[1], a[2], a[3]);
+        return String(buf);
+    }
+};
+
+class WiFiClass
+{
+public:
+    void begin(const char *ssid, const char *pw) {}
+    bool isConnected(void) { return true; }
+    IPAddress localIP(void) { return IPAddress(127, 0, 0, 1); }
+    IPAddress gatewayIP(void) { return IPAddress(127, 0, 0, 1); }
+    IPAddress dnsIP(void) { return IPAddress(127, 0, 0, 1); }
+};
+extern WiFiClass WiFi;
+
+class WiFiClient : public Client
+{
+};
+
+class WiFiClientSecure : public WiFiClient
+{
+public:
+    void setCACert(const char *ca) {}
+    void setInsecure(void) {}
+};
+
+#endif
@@ -0,0 +1,101 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __sim_h__
+#define __sim_h__
+
+/* simulation control, only available in the native (host) build */
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    /* virtual clock, advanced by delay() on the simulation main thread */
+    uint64_t sim_now_ms(void);
+    uint64_t sim_epoch_ms(void);
+    void sim_advance(uint32_t ms);
+    /* time-warp: a delay() of the main thread advances the clock by at least this */
+    void sim_set_quantum(uint32_t ms);
+    /* tasks woken exactly at their deadline, run before the main thread goes on; costs a
+       host context switch per wakeup */
+    void sim_set_preemptive(int on);
+    /* bus time of a driver, advances the clock on the main thread, waits for it elsewhere */
+    void sim_busy(uint32_t ms);
+
+    /* gpio */
+    typedef void (*sim_gpio_hook_t)(uint64_t t_ms, uint8_t pin, uint8_t val);
+    void sim_set_gpio_hook(sim_gpio_hook_t fn);
+    void sim_set_analog(uint8_t pin, uint16_t val);
+    /* what drives a load on the pin: the LEDC duty attached to it in [0, 1], else its level */
+    double sim_pin_level(uint8_t pin);
+    /* digitalWrite() calls and GPIO register writes so far */
+    void sim_gpio_writes(unsigned long *pins, unsigned long *regs);
+
+    /* mqtt broker stand-in */
+    typedef void (*sim_publish_hook_t)(const char *topic, const char *payload, int len); /* payload terminated */
+    void sim_mqtt_inject(const char *topic, const char *payload);
+    void sim_mqtt_set_broker(int up);
+    void sim_mqtt_set_publish_hook(sim_publish_hook_t fn);
+    unsigned long sim_mqtt_published(void);
+    /* PUBLISH packet bytes so far: fixed header, topic, payload */
+    unsigned long sim_mqtt_wire_bytes(void);
+    /* ESP.restart() calls fn and returns instead of ending the run */
+    typedef void (*sim_restart_hook_t)(void);
+    void sim_set_restart_hook(sim_restart_hook_t fn);
+    /* host time a publish takes on the wire */
+    void sim_mqtt_set_wire_us(uint32_t us);
+    /* a congested link: every publish takes ms on the virtual clock, 0: back to normal */
+    void sim_mqtt_set_stall(uint32_t ms);
+    /* connect() calls, longest broker up -> a client connected again */
+    void sim_mqtt_stats(unsigned long *tries, unsigned long *reconnect_max_ms);
+
+    /* DS18B20 on the simulated OneWire bus */
+    void sim_set_onewire_devices(int n);
+    int sim_onewire_devices(void);
+
+    /* LittleFS: files written, bytes programmed and blocks erased, as LittleFS would (estimated) */
+    void sim_fs_stats(unsigned long *commits, unsigned long *prog, unsigned long *erases);
+    /* blocks: most in use at once, the partition's, writes that didn't fit */
+    void sim_fs_space(unsigned long *peak, unsigned long *total, unsigned long *full);
+    void sim_fs_cleanup(void);
+    /* NVS: entries written so far */
+    unsigned long sim_nvs_writes(void);
+
+    /* heap allocations so far; peak of the bytes operator new holds since the mark */
+    unsigned long sim_allocations(void);
+    void sim_heap_mark(void);
+    unsigned long sim_heap_peak(void);
+#ifdef __cplusplus
+}
+
+void sim_init(time_t epoch);
+
+/* the ui setup() created, to attach extra sensors */
+class uiElements;
+uiElements *sim_ui_elements(void);
+
+/* display: pixels flushed; frame time per buffer height with the SPI transfer modeled at hz,
+   host render time scaled by cpu (0: keep 27MHz, x1) */
+unsigned long sim_flushed_pixels(void);
+void sim_disp_bench(double hz, double cpu);
+#endif
+
+#endif
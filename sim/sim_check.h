@@ -0,0 +1,67 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __sim_check_h__
+#define __sim_check_h__
+
+/* host checks, a sim_check_<subsystem>.cpp each, run by sim_main.cpp (program -h lists them) */
+
+#include <Arduino.h>
+#include "logger.h"
+
+void setup(void);
+void loop(void);
+
+/* sim_main.cpp: the fcce stand-in's sensor telemetry and alive messages, due ones only */
+void fcce_feed(bool sensors);
+/* the lines a stats function writes to its sink, joined by sep, no trailing newline */
+String stats_text(void (*fn)(log_sink_fn, void *), const char *sep = "\n");
+
+/* checks that end the run; arg is the option's argument, nullptr if it takes none */
+void img_bench(const char *arg);    /* -i, sim_check_display.cpp */
+void disp_bench(const char *arg);   /* -f mhz[:cpu] */
+void lock_bench(const char *arg);   /* -l, sim_check_sensors.cpp */
+void window_check(const char *arg); /* -m */
+void ring_check(const char *arg);   /* -L, sim_check_logger.cpp */
+void rollup_check(const char *arg); /* -R, sim_check_rollup.cpp */
+void hist_bench(const char *arg);   /* -H days[:flush_h], sim_check_history.cpp */
+void time_check(const char *arg);   /* -T, sim_check_time.cpp */
+void sched_check(const char *arg);  /* -S */
+void frame_check(const char *arg);  /* -G, sim_check_io.cpp */
+void pid_bench(const char *arg);    /* -P hours[:kp:ti:td:window] */
+void relay_check(const char *arg);  /* -r */
+void topic_bench(const char *arg);  /* -D, sim_check_mqtt.cpp */
+void pub_bench(const char *arg);    /* -Q wire_us */
+void web_bench(const char *arg);    /* -W, sim_check_web.cpp */
+void tlm_bench(const char *arg);    /* -C ticks[:dump], sim_check_telemetry.cpp */
+
+/* modes of a simulated run, sim_check_sensors.cpp: -a fusion probe, -w DS18B20 on the bus */
+void probe_setup(void);
+void probe_feed(const String &topic, uint64_t t_ms, const String &value);
+void probe_check(void);
+void probe_report(void);
+void ds18b20_setup(int n);
+/* sim_check_mqtt.cpp: -M broker outages, -O one outage of hours with the spool replayed;
+   spool_setup() returns the seconds to run */
+void outages_run(void);
+void outages_report(void);
+unsigned long spool_setup(float hours);
+void spool_feed(void);
+void spool_report(void);
+
+#endif
@@ -0,0 +1,57 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* display: rle image decoder, DMA flush */
+
+#include <chrono>
+#include <lvgl.h>
+
+#include "sim.h"
+#include "sim_check.h"
+#include "img_rle.h"
+
+/* rle decoder throughput, lines as lvgl fetches them for a full screen redraw */
+extern const lv_img_dsc_t splash_screen, biohazard, wifi_warning;
+
+void img_bench(const char *arg)
+{
+    static const lv_img_dsc_t *imgs[] = {&splash_screen, &biohazard, &wifi_warning};
+    uint8_t buf[LV_HOR_RES_MAX * sizeof(lv_color_t)];
+    const int rounds = 200;
+    unsigned long lines = 0, sum = 0;
+
+    auto wall = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (auto img : imgs)
+            for (int y = 0; y < img->header.h; y++)
+            {
+                img_rle_read_line(img->data, 0, y, img->header.w, buf);
+                sum += buf[y % img->header.w];
+                lines++;
+            }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wall).count();
+    fprintf(stderr, "sim: rle decoded %lu lines in %.1fms, %.0f lines/ms (%lu)\n", lines, ms, lines / ms, sum);
+}
+
+/* -f: frame time per display buffer height, SPI clock of mhz, host render time x cpu */
+void disp_bench(const char *arg)
+{
+    double mhz = 27, cpu = 1;
+    sscanf(arg, "%lf:%lf", &mhz, &cpu);
+    sim_disp_bench(mhz * 1e6, cpu);
+}
@@ -0,0 +1,129 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* sensor history on LittleFS, next to a full spool */
+
+#include <chrono>
+#include <algorithm>
+#include <math.h>
+
+#include "sim.h"
+#include "sim_check.h"
+#include "history.h"
+#include "spool.h"
+
+/* history store: 1 minute samples of six fcce like feeds (daily curve, DHT22 noise, a 20 minute
+   dropout every 3 days) over days, flushed every flush_h (0: full segments only);
+   density, retention within HIST_BUDGET, flash cost per day and query time per range; a full spool
+   shares the partition, and drops the segment of a record the replay has peeked */
+static void hist_query_sink(time_t t, float v, void *arg) { *static_cast<double *>(arg) += v; }
+
+void hist_bench(const char *arg)
+{
+    int days = 90;
+    double flush_h = 6;
+    sscanf(arg, "%d:%lf", &days, &flush_h);
+    static const struct
+    {
+        const char *name;
+        double base, amp;
+    } feeds[] = {
+        {"/FCCETemp", 26.0, 2.0},
+        {"/FCCEHum", 65.0, -5.0},
+        {"/BergTemp", 27.0, 3.0},
+        {"/BergHum", 72.0, -6.0},
+        {"/ErdeTemp", 29.5, 1.5},
+        {"/ErdeHum", 68.0, -4.0},
+    };
+    const int n = sizeof(feeds) / sizeof(feeds[0]);
+    /* a full spool next to it, as after a long broker outage: both budgets in the one partition */
+    mySpool spool;
+    spool.begin();
+    for (uint32_t i = 0; i < 2 * SPOOL_BUDGET / 32; i++)
+    {
+        uint8_t payload[16] = {};
+        spool.put(i, "/FCCETemp", payload, sizeof(payload));
+    }
+    spool.flush(true);
+    myHistory h;
+    for (auto &f : feeds)
+        h.add(String(f.name));
+    h.begin();
+    srand(1);
+    time_t end = time(nullptr), start = end - days * 86400L;
+    unsigned long last_flush = 0;
+    for (time_t t = start; t < end; t += 60)
+    {
+        double day = 2 * M_PI * (t % 86400) / 86400.0;
+        for (int i = 0; i < n; i++)
+        {
+            double noise = ((rand() % 1000) + (rand() % 1000) - 999) / 1000.0 * 0.1;
+            float v = roundf((feeds[i].base - feeds[i].amp * cos(day) + noise) * 10) / 10;
+            bool dropout = ((t - start) / 60 + i * 997) % (3 * 1440) < 20;
+            h.append(i, t, dropout ? NAN : v);
+        }
+        if ((flush_h > 0) && (t - start - last_flush >= flush_h * 3600))
+        {
+            h.flush();
+            last_flush = t - start;
+        }
+    }
+    unsigned long commits, prog, erases;
+    sim_fs_stats(&commits, &prog, &erases);
+    fprintf(stderr, "sim: history %s\n", h.stats().c_str());
+    fprintf(stderr, "sim: %d days of %d sensors, flush every %.1fh: %.1f writes/day, %.0f bytes programmed/day, %.1f blocks erased/day, "
+                    "write amplification %.1f (programmed / encoded), raw 8 bytes/sample would be %.0fk/day\n",
+            days, n, flush_h, commits / static_cast<double>(days), prog / static_cast<double>(days), erases / static_cast<double>(days),
+            prog / static_cast<double>(std::max(1UL, h.encoded_bytes())), n * 1440 * 8 / 1024.0);
+    unsigned long peak, total, full;
+    sim_fs_space(&peak, &total, &full);
+    fprintf(stderr, "sim: flash with a full spool (%s): at most %lu of %lu blocks in use, %lu writes didn't fit\n",
+            spool.stats().c_str(), peak, total, full);
+    static const struct
+    {
+        const char *what;
+        long secs;
+    } ranges[] = {{"1h", 3600}, {"1d", 86400}, {"7d", 7 * 86400}, {"all", 400 * 86400L}};
+    for (auto &r : ranges)
+    {
+        const int rounds = 200;
+        size_t got = 0;
+        double sum = 0;
+        auto wall = std::chrono::steady_clock::now();
+        for (int k = 0; k < rounds; k++)
+        {
+            time_t to = end - (rand() % 86400);
+            got += h.query(feeds[k % n].name, to - r.secs, to, hist_query_sink, &sum);
+        }
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - wall).count() / rounds;
+        fprintf(stderr, "sim: query %-3s: %6.0f samples, %8.1fus (host)\n", r.what, got / static_cast<double>(rounds), us);
+    }
+    /* the replay peeks a record, the spool drops its segment for the budget meanwhile, then done() */
+    uint32_t t;
+    char topic[32];
+    uint8_t payload[16];
+    size_t len = sizeof(payload);
+    bool raw;
+    spool.peek(t, topic, sizeof(topic), payload, len, raw);
+    for (uint32_t i = 0; i < mySpool::seg_size / mySpool::hdr_size; i++)
+        spool.put(i, "/FCCETemp", payload, sizeof(payload));
+    unsigned long pending = spool.pending();
+    spool.done();
+    fprintf(stderr, "sim: spool: a peeked record's segment dropped, done() skipped %lu records\n", pending - spool.pending());
+    sim_fs_cleanup();
+}
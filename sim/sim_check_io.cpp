@@ -0,0 +1,311 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* outputs: PID on a thermal plant, the output frame against the GPIO registers */
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+#include "sim.h"
+#include "sim_check.h"
+#include "circuits.h"
+#include "io.h"
+
+/* heater control on a thermal plant, the heater circuit's ranges (day 30-31, night 29-30):
+   mat and soil as two first order lags of 5 and 40 minutes, full power holds the soil 15K above
+   ambient (22-25C over the day), the sensor reports every minute in 0.1 steps with noise.
+   Hysteresis, PID time proportioned on a relay, PID on PWM side by side, each from ambient;
+   settling (within 0.3K for good) and overshoot after the start and after every day/night
+   setpoint change, the error from 3h after a change on, relay switches */
+typedef struct
+{
+    const char *name;
+    uint8_t pin;
+    ioSwitch *io;
+    remoteSensor *sens;
+    myCircuit<genSensor> *c;
+    double tm, ts;
+    double seg_sp, seg_dir;                          /* setpoint of the segment, +1 up, -1 down */
+    unsigned long seg_start, seg_settled;            /* s */
+    double seg_over;                                 /* overshoot beyond the setpoint, K */
+    bool seg_crossed;
+    double settle_sum, over_sum, first_settle, first_over; /* settle < 0: never */
+    int steps, settled;
+    double err2, errs;
+    unsigned long switches;
+} plant_t;
+
+static plant_t plants[] = {{"hysteresis", 33}, {"PID relay", 25}, {"PID PWM", 2}};
+
+static void plant_gpio(uint64_t t_ms, uint8_t pin, uint8_t val)
+{
+    for (auto &p : plants)
+        if (p.pin == pin)
+            p.switches++;
+}
+
+static void plant_segment_end(plant_t &p, unsigned long now)
+{
+    double settle = p.seg_settled ? static_cast<double>(p.seg_settled - p.seg_start) : -1;
+    if (p.seg_start == 0)
+    {
+        p.first_settle = settle;
+        p.first_over = p.seg_over;
+        return;
+    }
+    if (settle >= 0)
+    {
+        p.settle_sum += settle;
+        p.settled++;
+    }
+    p.over_sum += p.seg_over;
+    p.steps++;
+}
+
+void pid_bench(const char *arg)
+{
+    int hours = 72;
+    float kp = 0.2, ti = 1800, td = 300;
+    int window = 900;
+    sscanf(arg, "%d:%f:%f:%f:%d", &hours, &kp, &ti, &td, &window);
+    if (!freopen("/dev/null", "w", stdout))
+        return;
+    sim_init(1622505600);
+    uiElements *ui = setup_ui(30);
+    setup_mqtt(ui);
+    setup_logger();
+    time_obj = new myTime();
+    sim_set_gpio_hook(plant_gpio);
+    for (auto &p : plants)
+    {
+        bool pwm = (&p == &plants[2]);
+        p.io = pwm ? static_cast<ioSwitch *>(new ioPWM(p.pin, 0)) : new ioDigitalIO(p.pin);
+        p.sens = new remoteSensor(ui, (String("/Plant") + p.pin).c_str(), NAN);
+        p.c = new myCircuit<genSensor>(ui, p.name, *p.sens, *p.io, 60, /* circuit_watchdog */
+                                       myRange<float>{30.0, 31.0}, myRange<float>{29.0, 30.0}, ctrl_temprange2);
+        if (&p != &plants[0])
+            p.c->set_pid(kp, ti, td, window);
+        p.tm = p.ts = 22;
+        p.seg_sp = NAN;
+    }
+    ui->set_avg_sensors(plants[0].sens, plants[1].sens, plants[0].sens, plants[2].sens); /* the overview shows something */
+    ui->set_mode(UI_OPERATIONAL);
+    srand(3);
+    for (unsigned long t = 0; t < hours * 3600UL; t++)
+    {
+        delay(1000);
+        time_obj->tick();
+        lv_task_handler();
+        gpio_commit(); /* as loop() does */
+        time_t now = time(nullptr);
+        struct tm lt;
+        time_obj->get_time(&lt);
+        double ta = 23.5 - 1.5 * cos(2 * M_PI * ((now % 86400) - 4 * 3600) / 86400.0);
+        double sp = def_day.is_in(lt) ? 30.5 : 29.5;
+        for (auto &p : plants)
+        {
+            double u = sim_pin_level(p.pin);
+            p.tm += (p.ts + 15 * u - p.tm) / 300.0;
+            p.ts += ((p.tm - p.ts) - (p.ts - ta)) / 2400.0;
+            if ((t % 60) == 0)
+                p.sens->update_data(roundf((p.ts + ((rand() % 101) - 50) / 1000.0) * 10) / 10);
+            if (sp != p.seg_sp)
+            {
+                if (!isnan(p.seg_sp))
+                    plant_segment_end(p, t);
+                p.seg_dir = (sp > (isnan(p.seg_sp) ? p.ts : p.seg_sp)) ? 1 : -1;
+                p.seg_sp = sp;
+                p.seg_start = t;
+                p.seg_settled = 0;
+                p.seg_over = 0;
+                p.seg_crossed = false;
+            }
+            double e = p.ts - p.seg_sp;
+            p.seg_crossed |= (e * p.seg_dir >= 0);
+            if (p.seg_crossed)
+                p.seg_over = std::max(p.seg_over, e * p.seg_dir);
+            if (fabs(e) > 0.3)
+                p.seg_settled = 0;
+            else if (!p.seg_settled)
+                p.seg_settled = t;
+            if (t - p.seg_start >= 3 * 3600)
+            {
+                p.err2 += e * e;
+                p.errs++;
+            }
+        }
+    }
+    fprintf(stderr, "sim: %dh, PID kp=%.3f/K ti=%.0fs td=%.0fs, relay window %ds\n", hours, kp, ti, td, window);
+    fprintf(stderr, "sim: controller    start: settle  overshoot   steps: settled  overshoot  rms error  relay switches/h\n");
+    for (auto &p : plants)
+    {
+        char first[16], steps[24];
+        plant_segment_end(p, hours * 3600UL);
+        snprintf(first, sizeof(first), (p.first_settle < 0) ? "never" : "%.0fmin", p.first_settle / 60);
+        snprintf(steps, sizeof(steps), "%d/%d, %.0fmin", p.settled, p.steps, p.settled ? p.settle_sum / p.settled / 60 : 0.0);
+        fprintf(stderr, "sim: %-12s %13s %8.2fK %16s %8.2fK %9.3fK %10.1f\n", p.name, first, p.first_over, steps,
+                p.steps ? p.over_sum / p.steps : 0.0, sqrt(p.err2 / std::max(p.errs, 1.0)), p.switches / static_cast<double>(hours));
+    }
+}
+
+/* output frame against the mocked GPIO registers: the relay pins of main.cpp staged at random every
+   10ms tick (a new level now and then, mostly the same level again, as circuits do), one commit per
+   tick; every commit may change a pin only once, switch ons GPIO_STAGGER_MS apart, and after the
+   last stage all pins end up as staged. Register writes against a digitalWrite() per set() */
+static const uint8_t frame_pins[] = {12, 16, 26, 27, 32};
+static uint64_t frame_last_on;
+static int frame_changes[40], frame_bad;
+
+static void frame_gpio(uint64_t t_ms, uint8_t pin, uint8_t val)
+{
+    if (frame_changes[pin]++)
+        frame_bad++; /* twice within one commit */
+    if (val != HIGH)
+        return;
+    if (frame_last_on && (t_ms - frame_last_on < GPIO_STAGGER_MS))
+        frame_bad++;
+    frame_last_on = t_ms;
+}
+
+void frame_check(const char *arg)
+{
+    const int n = sizeof(frame_pins) / sizeof(frame_pins[0]);
+    ioDigitalIO *io[n];
+    uint8_t want[n] = {};
+    unsigned long sets = 0, pins0, regs0, pins1, regs1;
+    for (int i = 0; i < n; i++)
+        io[i] = new ioDigitalIO(frame_pins[i]);
+    sim_set_gpio_hook(frame_gpio);
+    sim_gpio_writes(&pins0, &regs0);
+    srand(4);
+    for (int tick = 0; tick < 360000; tick++) /* an hour */
+    {
+        for (int i = 0; i < n; i++)
+        {
+            int r = rand() % 1000;
+            if (r < 5)
+                want[i] = !want[i];
+            if (r < 50)
+            {
+                io[i]->set(want[i]);
+                sets++;
+                if (io[i]->state() != want[i])
+                    frame_bad++; /* staged state not visible */
+            }
+        }
+        memset(frame_changes, 0, sizeof(frame_changes));
+        gpio_commit();
+        sim_advance(10);
+    }
+    for (int tick = 0; tick < n * GPIO_STAGGER_MS / 10 + 1; tick++, sim_advance(10))
+    {
+        memset(frame_changes, 0, sizeof(frame_changes));
+        gpio_commit();
+    }
+    for (int i = 0; i < n; i++)
+        frame_bad += (digitalRead(frame_pins[i]) != want[i]);
+    sim_gpio_writes(&pins1, &regs1);
+    fprintf(stderr, "sim: output frame, %d pins for 1h: %lu set() calls, %lu register writes (%lu digitalWrite()), %d violations\n",
+            n, sets, regs1 - regs0, pins1 - pins0, frame_bad);
+    fprintf(stderr, "sim: %s\n", stats_text(gpio_stats).c_str());
+}
+
+/* relay protection on a plain and an inverted output (the fan on 16 in main.cpp): the same on/off
+   wishes, flipped for the inverted one as its circuit flips them, every 5-30s for 6 hours; pin HIGH
+   is on for both. Every on has to last min_on, every off min_off, at most max_cph switch ons in any
+   hour (give or take GPIO_STAGGER_MS), switching off is never held back beyond the dwell, and the
+   lifetime count is the switch ons */
+static const unsigned long relay_on_s = 60, relay_off_s = 120;
+static const int relay_cph = 6;
+static struct
+{
+    uint8_t pin;
+    bool invers;
+    uint8_t level;
+    uint64_t since;
+    std::vector<uint64_t> ons;
+    unsigned long short_on, short_off, over_budget, late_off;
+} relays[] = {{27, false}, {16, true}};
+
+static void relay_gpio(uint64_t t_ms, uint8_t pin, uint8_t val)
+{
+    for (auto &r : relays)
+    {
+        if ((r.pin != pin) || (val == r.level))
+            continue;
+        uint64_t held = t_ms - r.since + GPIO_STAGGER_MS; /* a switch on may be staggered */
+        if (val == HIGH)
+        {
+            r.short_off += r.ons.size() && (held < relay_off_s * 1000);
+            r.ons.push_back(t_ms);
+            int in_hour = 0;
+            for (auto t : r.ons)
+                in_hour += (t_ms - t + GPIO_STAGGER_MS < 3600 * 1000ULL);
+            r.over_budget += (in_hour > relay_cph);
+        }
+        else
+        {
+            r.short_on += (held < relay_on_s * 1000);
+            r.late_off += (held > (relay_on_s + 31) * 1000); /* an off wish comes within 30s */
+        }
+        r.level = val;
+        r.since = t_ms;
+    }
+}
+
+void relay_check(const char *arg)
+{
+    sim_init(1622505600);
+    lv_init();
+    const int n = sizeof(relays) / sizeof(relays[0]);
+    ioDigitalIO *io[n];
+    for (int i = 0; i < n; i++)
+    {
+        io[i] = new ioDigitalIO(relays[i].pin, relays[i].invers);
+        io[i]->protect(relay_on_s, relay_off_s, relay_cph);
+    }
+    sim_set_gpio_hook(relay_gpio);
+    srand(5);
+    bool want = false;
+    unsigned long wishes = 0;
+    uint64_t next = 0;
+    for (uint64_t t = 0; t < 6 * 3600 * 1000ULL; t += 10, sim_advance(10))
+    {
+        if (t >= next)
+        {
+            want = !want;
+            wishes++;
+            next = t + (5 + rand() % 26) * 1000;
+        }
+        for (int i = 0; i < n; i++)
+            io[i]->set((want != relays[i].invers) ? HIGH : LOW);
+        lv_task_handler();
+        gpio_commit();
+    }
+    fprintf(stderr, "sim: relay protection, min on %lus, min off %lus, %d switch ons/h, %lu on/off wishes in 6h\n",
+            relay_on_s, relay_off_s, relay_cph, wishes);
+    for (int i = 0; i < n; i++)
+    {
+        auto &r = relays[i];
+        fprintf(stderr, "sim: %-8s pin %2u: %zu switch ons, %lu counted; %lu on too short, %lu off too short, "
+                        "%lu over the budget, %lu offs held back\n",
+                r.invers ? "inverted" : "plain", r.pin, r.ons.size(), static_cast<unsigned long>(io[i]->get_guard()->cycles),
+                r.short_on, r.short_off, r.over_budget, r.late_off);
+    }
+}
@@ -0,0 +1,175 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* logger: the arena ring */
+
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "sim_check.h"
+#include "logger.h"
+
+/* -L: the myLogger arena ring; the text of record nr is a function of nr (ring_text()), every
+   fetched record is checked against it, so torn, misordered or cut records show up, as do
+   records evicted too early; run it built with -fsanitize=address or -fsanitize=thread */
+static size_t ring_text(unsigned long nr, char *buf)
+{
+    size_t len = (nr * 37) % (myLogger::max_msg_len + 40); /* some get truncated */
+    for (size_t i = 0; buf && (i < len); i++)
+        buf[i] = 'a' + (nr + i) % 26;
+    return len;
+}
+
+static size_t ring_fmt(const void *rec, char *buf, size_t len)
+{
+    return snprintf(buf, len, "bin %lu", static_cast<unsigned long>(*static_cast<const uint32_t *>(rec)));
+}
+
+static bool ring_ok(const myLogger::log_entry_t &e)
+{
+    char exp[myLogger::max_msg_len + 40];
+    size_t len;
+    if ((e.nr % 11) == 0)
+        len = snprintf(exp, sizeof(exp), "bin %lu", e.nr);
+    else
+        len = std::min(ring_text(e.nr, exp), myLogger::max_msg_len);
+    return (e.len == len) && !memcmp(e.msg, exp, len) && (e.msg[len] == '\0');
+}
+
+static void ring_put(myLogger &l, unsigned long nr)
+{
+    if ((nr % 11) == 0)
+    {
+        uint32_t v = nr;
+        l.log(ring_fmt, &v, sizeof(v));
+        return;
+    }
+    char buf[myLogger::max_msg_len + 40];
+    l.log(buf, ring_text(nr, buf));
+}
+
+/* bytes a record takes in the arena, same members as myLogger's log_hdr_t */
+static size_t ring_need(unsigned long nr)
+{
+    struct
+    {
+        unsigned long nr;
+        time_t t;
+        uint16_t len;
+        log_fmt_fn fmt;
+    } h;
+    return sizeof(h) + (((nr % 11) == 0) ? sizeof(uint32_t) : std::min(ring_text(nr, nullptr), myLogger::max_msg_len));
+}
+
+void ring_check(const char *arg)
+{
+    /* single thread: a writer and a reader that lags by a random number of records, the arena
+       position is followed along to count wraps by marker and by a tail too short for a header */
+    const size_t budget = 1024;
+    const unsigned long records = 200000;
+    myLogger l("/ring", budget);
+    myLogger::log_cursor_t c{0, 0};
+    myLogger::log_entry_t e;
+    unsigned long bad = 0, lost = 0, early = 0, skips = 0, fetched = 0, truncated = 0, marks = 0, short_tails = 0;
+    size_t tail = 0, hdr = ring_need(11) - sizeof(uint32_t);
+    srand(3);
+    for (unsigned long nr = 1; nr <= records; nr++)
+    {
+        ring_put(l, nr);
+        size_t need = ring_need(nr);
+        if (tail + need > budget)
+        {
+            (tail + hdr <= budget) ? marks++ : short_tails++;
+            tail = 0;
+        }
+        tail += need;
+        if (rand() % 8)
+            continue;
+        for (int n = rand() % 16; n && l.fetch(c, e); n--)
+        {
+            if (e.nr != c.nr)
+                lost++;
+            if (e.nr > nr)
+                bad++;
+            else if (e.nr != fetched + 1)
+            {
+                /* skipped ahead: what's left from e.nr on has to fit, with e.nr - 1 it must not
+                   (up to the largest record wasted at the end of the arena) */
+                size_t held = 0;
+                for (unsigned long i = e.nr; i <= nr; i++)
+                    held += ring_need(i);
+                if ((e.nr <= fetched) || (held > budget) || (held + ring_need(e.nr - 1) + hdr + myLogger::max_msg_len <= budget))
+                    early++;
+                skips++;
+            }
+            bad += !ring_ok(e);
+            truncated += ((e.nr % 11) && (ring_text(e.nr, nullptr) > myLogger::max_msg_len));
+            fetched = e.nr;
+        }
+    }
+    fprintf(stderr, "sim: ring %zu bytes, %lu records: %lu wrap markers, %lu short tails, %lu lagging cursor skips, %lu truncated\n",
+            budget, records, marks, short_tails, skips, truncated);
+    fprintf(stderr, "sim: ring %lu bad records, %lu cursor mismatches, %lu bad skips\n", bad, lost, early);
+
+    /* one writer flat out, several readers each with a cursor of its own */
+    const int readers = 3;
+    const unsigned long mt_records = 50000;
+    myLogger m("/ring-mt", budget);
+    std::atomic<unsigned long> written{0}, torn{0}, order{0}, reads{0}, skipped{0};
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> threads;
+    for (int r = 0; r < readers; r++)
+        threads.emplace_back([&] {
+            myLogger::log_cursor_t c{0, 0};
+            myLogger::log_entry_t e;
+            unsigned long last = 0, n = 0, bad = 0, mis = 0, skip = 0;
+            bool done = false;
+            while (!done)
+            {
+                done = stop; /* one more pass after the writer is through */
+                while (m.fetch(c, e))
+                {
+                    bad += !ring_ok(e);
+                    mis += (e.nr <= last) || (e.nr > written);
+                    skip += (e.nr != last + 1);
+                    last = e.nr;
+                    n++;
+                }
+            }
+            mis += (last != mt_records); /* the newest record is never evicted */
+            torn += bad;
+            order += mis;
+            reads += n;
+            skipped += skip;
+        });
+    for (unsigned long nr = 1; nr <= mt_records; nr++)
+    {
+        written = nr;
+        ring_put(m, nr);
+        if ((nr % 16) == 0)
+            std::this_thread::yield(); /* readers get to run on a single core, too */
+    }
+    stop = true;
+    for (auto &t : threads)
+        t.join();
+    fprintf(stderr, "sim: ring 1 writer, %d readers: %lu records, %lu read, %lu skips, %lu torn, %lu misordered\n",
+            readers, mt_records, static_cast<unsigned long>(reads), static_cast<unsigned long>(skipped),
+            static_cast<unsigned long>(torn), static_cast<unsigned long>(order));
+}
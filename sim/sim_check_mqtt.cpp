@@ -0,0 +1,438 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* mqtt: fcce topic dispatch, the publish queue, broker outages, the spool */
+
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "sim.h"
+#include "sim_check.h"
+#include "circuits.h"
+#include "spool.h"
+
+/* -D: fcce topics dispatched through the sorted index (mqtt_topic_lookup(), as fcce_upstream() does)
+   vs. the linear scan it did before (String("/") + name per circuit, operator== per sensor), 10k topics:
+   hits, a topic with two sensors, near misses and unknown ones; both have to find the same targets */
+class benchSensor : public genSensor /* JUST_SWITCH: no widget, rollup or telemetry */
+{
+public:
+    benchSensor(const String &n) : genSensor(sim_ui_elements(), n, JUST_SWITCH) {}
+    String _to_string(void) override { return String(); }
+    float get_data(void) override { return 0; }
+    void _add_data(float v) override {}
+    void update_data(void) override {}
+};
+
+class benchCircuit : public genCircuit
+{
+    myRange<float> r{0, 0};
+
+public:
+    benchCircuit(const String &n) : genCircuit(n) {}
+    void update(void) override {}
+    void io_set(uint8_t v, bool ign_inverse, bool update_button) override {}
+    myRange<float> &get_range(bool) override { return r; }
+};
+
+typedef std::vector<std::pair<genSensor *, genCircuit *>> topic_hits_t;
+
+static void topic_collect(genSensor *s, genCircuit *c, void *arg)
+{
+    static_cast<topic_hits_t *>(arg)->push_back(std::make_pair(s, c));
+}
+
+void topic_bench(const char *arg)
+{
+    const int topics = 10000, sens_no = 24, circ_no = 8;
+    std::list<genSensor *> sensors;
+    std::list<genCircuit *> circuits;
+    std::vector<String> pool;
+    char n[32];
+    for (int i = 0; i < sens_no; i++)
+    {
+        snprintf(n, sizeof(n), "/Bench%02dTemp", i);
+        sensors.push_back(new benchSensor(n));
+        pool.push_back(n);
+        snprintf(n, sizeof(n), "/Bench%02dTem", i); /* a prefix */
+        pool.push_back(n);
+    }
+    sensors.push_back(new benchSensor("/Bench07Temp")); /* two sensors on one topic */
+    for (int i = 0; i < circ_no; i++)
+    {
+        snprintf(n, sizeof(n), "BenchRelay%d", i);
+        circuits.push_back(new benchCircuit(n));
+        pool.push_back(String("/") + n);
+        pool.push_back(String("/") + n + "x"); /* one longer */
+    }
+    for (auto s : sensors)
+        mqtt_register_sensor(s);
+    for (auto c : circuits)
+        mqtt_register_circuit(c);
+    pool.push_back("/config");
+    pool.push_back("/unknown");
+    pool.push_back("/");
+    std::vector<String> replay;
+    srand(4);
+    for (int i = 0; i < topics; i++)
+        replay.push_back(String("fcce") + pool[rand() % pool.size()]);
+
+    unsigned long bad = 0, hits = 0;
+    topic_hits_t a, b;
+    for (auto &t : replay)
+    {
+        a.clear();
+        b.clear();
+        String topic = t.substring(t.indexOf('/'));
+        for (auto c : circuits)
+            if ((String("/") + c->get_name()) == topic)
+                a.push_back(std::make_pair(nullptr, c));
+        for (auto s : sensors)
+            if (*s == topic)
+                a.push_back(std::make_pair(s, nullptr));
+        mqtt_topic_lookup(t.c_str() + t.indexOf('/'), topic_collect, &b);
+        std::sort(a.begin(), a.end());
+        std::sort(b.begin(), b.end());
+        bad += (a != b);
+        hits += a.size();
+    }
+    fprintf(stderr, "sim: %d topics, %d sensors (2 on one topic) and %d circuits besides setup()'s: %lu targets hit, %lu dispatch mismatches\n",
+            topics, sens_no + 1, circ_no, hits, bad);
+
+    const int rounds = 20;
+    unsigned long found = 0, allocs = sim_allocations();
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (auto &t : replay)
+        {
+            String topic = t.substring(t.indexOf('/'));
+            for (auto c : circuits)
+                found += ((String("/") + c->get_name()) == topic);
+            for (auto s : sensors)
+                found += (*s == topic);
+        }
+    double scan_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / (rounds * topics);
+    unsigned long scan_allocs = sim_allocations() - allocs;
+    allocs = sim_allocations();
+    t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (auto &t : replay)
+        {
+            int sep = t.indexOf('/');
+            mqtt_topic_lookup(t.c_str() + ((sep < 0) ? t.length() : sep), [](genSensor *s, genCircuit *c, void *arg)
+                              { (*static_cast<unsigned long *>(arg))++; }, &found);
+        }
+    double index_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / (rounds * topics);
+    fprintf(stderr, "sim: per topic: linear scan %.0fns, %.1f allocations; index %.0fns, %.1f allocations (host, %lu)\n",
+            scan_ns, static_cast<double>(scan_allocs) / (rounds * topics), index_ns,
+            static_cast<double>(sim_allocations() - allocs) / (rounds * topics), found);
+}
+
+/* -Q: producers on threads of their own, 8 telemetry topics each, every 16th message an alarm;
+   direct is the old way, the producer sends itself under the client lock, the wire time spun */
+static std::mutex q_mutex;
+static std::map<std::string, std::string> q_last; /* topic -> last payload on the wire */
+static std::map<std::string, uint32_t> q_alarm;   /* producer -> next alarm expected */
+static unsigned long q_alarm_bad;
+
+static void q_hook(const char *topic, const char *payload, int len)
+{
+    std::lock_guard<std::mutex> l(q_mutex);
+    std::string t(topic);
+    if (t.find("/alarm") != std::string::npos)
+    {
+        uint32_t n = strtoul(payload, nullptr, 0);
+        q_alarm_bad += (n < q_alarm[t]); /* out of order or twice */
+        q_alarm[t] = n + 1;
+    }
+    else
+        q_last[t] = payload;
+}
+
+static void pub_run(myMqtt *c, int producers, int msgs, bool direct)
+{
+    std::atomic<int> done{0};
+    std::vector<std::thread> threads;
+    std::vector<unsigned long> worst(producers), sum(producers), refused(producers);
+    std::vector<std::map<std::string, std::string>> queued(producers);
+    std::vector<std::map<std::string, uint32_t>> alarms(producers);
+    for (int p = 0; p < producers; p++)
+        threads.emplace_back([&, p] {
+            char topic[32], payload[32];
+            for (int i = 0; i < msgs; i++)
+            {
+                bool alarm = !(i % 16);
+                if (alarm)
+                {
+                    snprintf(topic, sizeof(topic), "/alarm%d", p);
+                    snprintf(payload, sizeof(payload), "%u", alarms[p][std::string("fcc") + topic]);
+                }
+                else
+                {
+                    snprintf(topic, sizeof(topic), "/bench%d/t%d", p, i % 8);
+                    snprintf(payload, sizeof(payload), "%d.%d", i, p);
+                }
+                auto t = std::chrono::steady_clock::now();
+                bool ok = true;
+                if (direct)
+                    c->send(topic, payload);
+                else
+                    ok = mqtt_publish(topic, payload, c, 0, alarm ? MQTT_ALARM : MQTT_TELEMETRY);
+                unsigned long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t).count();
+                sum[p] += ns;
+                worst[p] = std::max(worst[p], ns);
+                if (!ok)
+                    refused[p]++;
+                else if (alarm)
+                    alarms[p][std::string("fcc") + topic]++;
+                else
+                    queued[p][std::string("fcc") + topic] = payload;
+                if ((i % 8) == 7)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(8 * producers)); /* 1000 msgs/s in all */
+            }
+            done++;
+        });
+    while (done < producers)
+        delay(MQTT_BATCH_MS); /* the connection task drains at its deadlines */
+    for (auto &t : threads)
+        t.join();
+    for (unsigned long n = ~0UL; n != sim_mqtt_published();) /* until the wire goes quiet */
+    {
+        n = sim_mqtt_published();
+        delay(MQTT_BATCH_MS);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    unsigned long total = 0, max_ns = 0, lost = 0, stale = 0;
+    for (int p = 0; p < producers; p++)
+    {
+        total += sum[p];
+        max_ns = std::max(max_ns, worst[p]);
+        lost += refused[p];
+        std::lock_guard<std::mutex> l(q_mutex);
+        for (auto &q : queued[p])
+            stale += (q_last[q.first] != q.second); /* last value queued isn't the last one sent */
+        for (auto &a : alarms[p])
+            stale += (q_alarm[a.first] != a.second);
+    }
+    fprintf(stderr, "sim: %s %d producers: publish avg %.2fus, max %.1fus, %lu refused, %lu topics not at their last value\n",
+            direct ? "direct" : "queued", producers, total / 1e3 / (producers * msgs), max_ns / 1e3, lost, stale);
+    std::lock_guard<std::mutex> l(q_mutex);
+    q_last.clear();
+    q_alarm.clear();
+}
+
+void pub_bench(const char *arg)
+{
+    uint32_t wire_us = strtoul(arg, nullptr, 0);
+    sim_mqtt_set_wire_us(wire_us);
+    sim_mqtt_set_publish_hook(q_hook);
+    myMqtt *c = new myMqttLocal("bench", "localhost", nullptr, "bench broker");
+    c->manage();
+    unsigned long sent = sim_mqtt_published();
+    fprintf(stderr, "sim: %uus per publish on the wire, %d messages per producer\n", wire_us, 2000);
+    for (int producers = 1; producers <= 4; producers *= 4)
+    {
+        pub_run(c, producers, 2000, true);
+        pub_run(c, producers, 2000, false);
+    }
+    String m = stats_text(mqtt_stats, "\nsim:   ");
+    fprintf(stderr, "sim: %lu messages on the wire, %s\n", sim_mqtt_published() - sent, m.c_str());
+    fprintf(stderr, "sim: %lu alarms out of order\n", q_alarm_bad);
+}
+
+/* -M: the broker goes away for a while, every outage shorter than MQTT_GIVE_UP; then the link
+   congests, every publish stalls for stall_ms, with 8 telemetry topics a second and an alarm every
+   10s meanwhile: how long an alarm waits for the wire, at most the publish in flight and its own */
+static const struct
+{
+    unsigned long at, len; /* s */
+} outage[] = {{2 * 3600, 30}, {6 * 3600, 150}, {12 * 3600, 280}, {18 * 3600, 5}};
+static const unsigned long stall_at = 20 * 3600, stall_len = 60; /* s */
+static const uint32_t stall_ms = 500;
+static std::vector<uint64_t> alarm_at; /* seq -> ms queued */
+static uint64_t alarm_wait_sum, alarm_wait_max;
+static unsigned long alarms_sent;
+
+static void stall_hook(const char *topic, const char *payload, int len)
+{
+    std::lock_guard<std::mutex> l(q_mutex);
+    unsigned long seq = strtoul(payload, nullptr, 0);
+    if (strcmp(topic, "fcc/alarm") || (seq >= alarm_at.size()))
+        return;
+    uint64_t wait = sim_now_ms() - alarm_at[seq];
+    alarm_wait_sum += wait;
+    alarm_wait_max = std::max(alarm_wait_max, wait);
+    alarms_sent++;
+}
+
+void outages_run(void)
+{
+    static int down = -1;
+    unsigned long now = sim_now_ms() / 1000;
+    int o = -1;
+    for (int i = 0; i < static_cast<int>(sizeof(outage) / sizeof(outage[0])); i++)
+        if ((now >= outage[i].at) && (now < outage[i].at + outage[i].len))
+            o = i;
+    if (o != down)
+        sim_mqtt_set_broker(o < 0);
+    down = o;
+    static bool stalled = false;
+    static unsigned long last = 0;
+    bool stall = (now >= stall_at) && (now < stall_at + stall_len);
+    if (stall != stalled)
+    {
+        sim_mqtt_set_publish_hook(stall_hook);
+        sim_mqtt_set_stall(stall ? stall_ms : 0);
+    }
+    stalled = stall;
+    if (!stall || (now == last))
+        return;
+    last = now;
+    for (int i = 0; i < 8; i++)
+        mqtt_publish((String("/stall/t") + i).c_str(), String(now));
+    if (now % 10)
+        return;
+    uint32_t seq;
+    {
+        std::lock_guard<std::mutex> l(q_mutex);
+        seq = alarm_at.size();
+        alarm_at.push_back(sim_now_ms());
+    }
+    mqtt_publish("/alarm", String(seq).c_str(), nullptr, 0, MQTT_ALARM);
+}
+
+void outages_report(void)
+{
+    String s;
+    for (auto &o : outage)
+    {
+        if (s.length())
+            s += ", ";
+        s += String(o.len) + "s at " + String(o.at / 3600) + "h";
+    }
+    unsigned long tries, back_ms;
+    sim_mqtt_stats(&tries, &back_ms);
+    fprintf(stderr, "sim: broker outages %s: %lu connect attempts, reconnected at most %.1fs after the broker was back\n",
+            s.c_str(), tries, back_ms / 1000.0);
+    std::lock_guard<std::mutex> l(q_mutex);
+    fprintf(stderr, "sim: publishes stalled %ums each for %lus at %luh: %lu of %zu alarms sent, waited avg %llums, max %llums\n",
+            stall_ms, stall_len, stall_at / 3600, alarms_sent, alarm_at.size(),
+            static_cast<unsigned long long>(alarm_wait_sum / std::max(alarms_sent, 1UL)),
+            static_cast<unsigned long long>(alarm_wait_max));
+}
+
+/* -O: one broker outage of hours from 1h on; /probe carries a sequence number a minute as ground
+   truth, each one has to show up once, live or replayed with its original epoch, in order; only
+   the oldest may be missing, dropped by the spool budget */
+static const uint64_t spool_from_ms = 3600 * 1000ULL;
+static uint64_t spool_to_ms;
+static std::vector<uint32_t> probe_epoch;      /* seq -> epoch published */
+static std::vector<uint32_t> probe_live, probe_back;
+static unsigned long probe_bad_epoch, replays, reboots;
+static uint64_t replay_first_ms, replay_last_ms;
+static long pending_live = -1, pending_flash = -1; /* at the first reboot request */
+
+static void spool_hook(const char *topic, const char *payload, int len)
+{
+    std::lock_guard<std::mutex> l(q_mutex);
+    if (!strncmp(topic, "fcc/replay/", 11))
+    {
+        if (!replays++)
+            replay_first_ms = sim_now_ms();
+        replay_last_ms = sim_now_ms();
+    }
+    unsigned long t, seq;
+    if (!strcmp(topic, "fcc/probe"))
+        probe_live.push_back(strtoul(payload, nullptr, 0));
+    else if (!strcmp(topic, "fcc/replay/probe") && (sscanf(payload, "%lu,%lu", &t, &seq) == 2))
+    {
+        probe_back.push_back(seq);
+        probe_bad_epoch += (seq >= probe_epoch.size()) || (t + 1 < probe_epoch[seq]) || (t > probe_epoch[seq]); /* cached clock */
+    }
+}
+
+void spool_feed(void)
+{
+    static uint64_t next;
+    bool down = (sim_now_ms() >= spool_from_ms) && (sim_now_ms() < spool_to_ms);
+    sim_mqtt_set_broker(!down);
+    if (sim_now_ms() < next)
+        return;
+    next += 60 * 1000;
+    uint32_t seq;
+    {
+        std::lock_guard<std::mutex> l(q_mutex);
+        seq = probe_epoch.size();
+        probe_epoch.push_back(sim_epoch_ms() / 1000);
+    }
+    mqtt_publish("/probe", String(seq));
+}
+
+/* the firmware gives up on the broker and reboots, the spool was just flushed: what's on flash */
+static void spool_reboot(void)
+{
+    if (!reboots++)
+    {
+        mySpool probe;
+        probe.begin();
+        pending_flash = probe.pending();
+        pending_live = mqtt_spool_pending();
+    }
+}
+
+void spool_report(void)
+{
+    std::lock_guard<std::mutex> l(q_mutex);
+    std::vector<int> seen(probe_epoch.size());
+    unsigned long order = 0, twice = 0, unseen = 0, older = 0;
+    for (size_t i = 0; i < probe_back.size(); i++)
+        order += (i && (probe_back[i] <= probe_back[i - 1]));
+    for (auto v : {&probe_live, &probe_back})
+        for (auto q : *v)
+            twice += (seen[q]++ > 0);
+    for (size_t q = 0; q < seen.size(); q++)
+        if (!seen[q])
+        {
+            unseen++;
+            older += (probe_back.size() && (q < probe_back.front())); /* dropped for the budget */
+        }
+    unsigned long commits, prog, erases;
+    sim_fs_stats(&commits, &prog, &erases);
+    fprintf(stderr, "sim: outage %.1fh: %zu probes, %zu live, %zu replayed (%lu out of order, %lu off their epoch), "
+                    "%lu lost (%lu of them older than the first replayed), %lu twice\n",
+            (spool_to_ms - spool_from_ms) / 3600e3, probe_epoch.size(), probe_live.size(), probe_back.size(), order,
+            probe_bad_epoch, unseen, older, twice);
+    fprintf(stderr, "sim: replay of %lu messages from %.1fs to %.1fs after the broker was back; %lu reboot requests, "
+                    "at the first %ld of %ld pending on flash; %lu files written, %lu blocks erased\n",
+            replays, (replay_first_ms - spool_to_ms) / 1000.0, (replay_last_ms - spool_to_ms) / 1000.0, reboots,
+            pending_flash, pending_live, commits, erases);
+}
+
+unsigned long spool_setup(float hours)
+{
+    spool_to_ms = spool_from_ms + static_cast<uint64_t>(hours * 3600e3);
+    sim_mqtt_set_publish_hook(spool_hook);
+    sim_set_restart_hook(spool_reboot);
+    return spool_to_ms / 1000 + 3600;
+}
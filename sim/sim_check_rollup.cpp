@@ -0,0 +1,107 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* rollups: minute, hour and day buckets */
+
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+#include "sim_check.h"
+#include "rollup.h"
+
+/* rollups against brute force: readings every 0-2 minutes with NANs and gaps of up to 3 days,
+   on/off spans of up to 2 hours, over 60 days; every bucket still on a ring is recomputed from
+   the raw samples at checkpoints. Then the cost of one reading, all three levels */
+typedef struct
+{
+    time_t from, to; /* from == to: a reading */
+    float v;
+} roll_raw_t;
+
+static int roll_compare(const myRollup &r, const std::vector<roll_raw_t> &raw, time_t now)
+{
+    int bad = 0;
+    for (int l = 0; l < myRollup::LEVELS; l++)
+        for (uint32_t k = 0; k < myRollup::len[l]; k++)
+        {
+            time_t b0 = (now / myRollup::res[l] - k) * myRollup::res[l], b1 = b0 + myRollup::res[l];
+            double mn = NAN, mx = NAN, sum = 0, w = 0;
+            for (auto &s : raw)
+            {
+                double sw = (s.from == s.to) ? ((s.from >= b0) && (s.from < b1))
+                                             : std::max(0L, std::min(s.to, b1) - std::max(s.from, b0));
+                if (sw <= 0)
+                    continue;
+                mn = (w && (mn <= s.v)) ? mn : s.v;
+                mx = (w && (mx >= s.v)) ? mx : s.v;
+                sum += s.v * sw;
+                w += sw;
+            }
+            myRollup::stat_t st = r.get(static_cast<myRollup::level_t>(l), b0);
+            if ((st.weight != w) || (w && ((st.min != mn) || (st.max != mx) || (fabs(st.sum / st.weight - sum / w) > 1e-3))))
+            {
+                if (!bad)
+                    fprintf(stderr, "sim: %s level %d bucket -%u: %g/%g/%g w %g, brute force %g/%g/%g w %g\n",
+                            r.get_name().c_str(), l, k, st.min, st.sum / st.weight, st.max, st.weight, mn, sum / w, mx, w);
+                bad++;
+            }
+        }
+    return bad;
+}
+
+void rollup_check(const char *arg)
+{
+    myRollup sens("reading"), circ("on-time", true);
+    std::vector<roll_raw_t> rs, rc;
+    time_t t = 1622505600, end = t + 60 * 86400L, since = t, next_toggle = t;
+    bool on = false;
+    int checks = 0, bad = 0;
+    srand(2);
+    while (t < end)
+    {
+        t += (rand() % 5000) ? rand() % 121 : rand() % (3 * 86400);
+        float v = (rand() % 50) ? 20 + (rand() % 1000) / 100.0f : NAN;
+        sens.add(t, v);
+        if (!isnan(v))
+            rs.push_back(roll_raw_t{t, t, v});
+        if (t >= next_toggle)
+        {
+            circ.add_span(since, t, on);
+            rc.push_back(roll_raw_t{since, t, static_cast<float>(on)});
+            since = t;
+            on = !on;
+            next_toggle = t + rand() % 7200;
+        }
+        if ((rs.size() % 5000) == 0)
+        {
+            bad += roll_compare(sens, rs, t) + roll_compare(circ, rc, since);
+            checks++;
+        }
+    }
+    bad += roll_compare(sens, rs, t) + roll_compare(circ, rc, since);
+    fprintf(stderr, "sim: rollups %lu readings, %lu spans, %d checkpoints x %u buckets: %d mismatches\n",
+            rs.size(), rc.size(), checks + 1, 2 * (myRollup::len[0] + myRollup::len[1] + myRollup::len[2]), bad);
+    const int rounds = 1000000;
+    auto wall = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++)
+        sens.add(end + i * 7, 20 + (i & 63) / 10.0f);
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - wall).count() / rounds;
+    fprintf(stderr, "sim: rollup add %.0fns per reading (host), %u bytes per sensor\n", ns, static_cast<unsigned>(sizeof(myRollup)));
+}
@@ -0,0 +1,284 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* sensors: fusion probe, seqlock snapshots, trimmed mean window, DS18B20 bus */
+
+#include <chrono>
+#include <vector>
+#include <list>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "sim.h"
+#include "sim_check.h"
+#include "io.h"
+
+/* fusion probe: extra sensors on the BergTemp and ErdeTemp topics, averaged both ways; every
+   minute each average is compared to the mean of the feeds that delivered within 5 minutes */
+static const char *probe_topics[] = {"BergTemp", "ErdeTemp"};
+static const unsigned long probe_max_age = 10 * 60 * 1000; /* remote_max_age, main.cpp */
+static avgSensor *probe_avg[2];                             /* FUSE_FRESH, FUSE_TRIMMED */
+static struct
+{
+    uint64_t t_ms;
+    float v;
+} probe_last[2];
+static struct
+{
+    double err_sum, err_max;
+    unsigned long samples, blind_min; /* minutes with a value although no feed is alive */
+} probe_stats[2];
+
+void probe_setup(void)
+{
+    std::list<genSensor *> srcs;
+    for (auto t : probe_topics)
+    {
+        remoteSensor *r = new remoteSensor(sim_ui_elements(), (String("/") + t).c_str(), NAN);
+        r->set_max_age(probe_max_age);
+        srcs.push_back(r);
+    }
+    probe_avg[0] = new avgSensor(sim_ui_elements(), "/probeFresh", srcs, NAN);
+    probe_avg[0]->set_fusion(FUSE_FRESH, probe_max_age);
+    probe_avg[1] = new avgSensor(sim_ui_elements(), "/probeTrimmed", srcs, NAN);
+}
+
+void probe_feed(const String &topic, uint64_t t_ms, const String &value)
+{
+    for (int i = 0; i < 2; i++)
+        if (probe_avg[0] && (topic == String("fcce/") + probe_topics[i]))
+            probe_last[i] = {t_ms, strtof(value.c_str(), nullptr)};
+}
+
+void probe_check(void)
+{
+    static uint64_t next = 60 * 1000;
+    uint64_t now = sim_now_ms();
+    if (!probe_avg[0] || (now < next))
+        return;
+    next += 60 * 1000;
+    float sum = 0;
+    int alive = 0;
+    for (auto &l : probe_last)
+        if (l.t_ms && (now - l.t_ms < 5 * 60 * 1000))
+        {
+            sum += l.v;
+            alive++;
+        }
+    for (int i = 0; i < 2; i++)
+    {
+        float v = probe_avg[i]->stale() ? NAN : probe_avg[i]->get_data();
+        if (!alive)
+        {
+            probe_stats[i].blind_min += !isnan(v);
+            continue;
+        }
+        double err = isnan(v) ? 0 : fabs(v - sum / alive);
+        probe_stats[i].err_sum += err;
+        probe_stats[i].err_max = std::max(probe_stats[i].err_max, err);
+        probe_stats[i].samples++;
+    }
+}
+
+void probe_report(void)
+{
+    for (int i = 0; probe_avg[0] && (i < 2); i++)
+        fprintf(stderr, "sim: fusion %s: error vs. live feeds avg %.3f, max %.3f; %lu min reporting a value with no live feed\n",
+                i ? "FUSE_TRIMMED" : "FUSE_FRESH  ", probe_stats[i].err_sum / std::max(probe_stats[i].samples, 1UL),
+                probe_stats[i].err_max, probe_stats[i].blind_min);
+}
+
+/* -w: n DS18B20 on the OneWire bus, read like the soil sensor setup in main.cpp */
+void ds18b20_setup(int n)
+{
+    sim_set_onewire_devices(n);
+    sim_set_preemptive(true); /* acquisition timing as on the target */
+    genSensor *ds = new myDS18B20(sim_ui_elements(), "/Erde", 17, 5000);
+    new avgSensor(sim_ui_elements(), "/avgTempErde", std::list<genSensor *>{ds});
+}
+
+/* sensor snapshots, seqlock against the former mutex read: readers check every snapshot for
+   consistency (hum == -val, ts == val, error == odd ts); stress: the writer publishes flat out,
+   contention: it publishes every 50us, still far more often than any sensor; a seqlock read
+   yields after spin_tries, none may take more than lock_max_tries */
+static bool snap_consistent(const sens_snapshot_t &s)
+{
+    return (s.hum == -s.val) && (s.ts == static_cast<unsigned long>(s.val)) && (s.error == (s.ts & 1));
+}
+
+static seqLock<sens_snapshot_t> bench_snap{sens_snapshot_t{0, 0, 0, false}};
+static sens_snapshot_t bench_locked{0, 0, 0, false};
+static SemaphoreHandle_t bench_mutex;
+static const unsigned lock_max_tries = 16 * seqLock<sens_snapshot_t>::spin_tries; /* the bound a read has to keep */
+
+static void lock_run(bool paced, int readers, bool use_seq)
+{
+    std::atomic<bool> stop{false};
+    std::atomic<unsigned long> reads{0}, torn{0}, max_read_ns{0}, max_tries{0}, yielded{0}, over{0};
+    unsigned long writes = 0;
+    std::vector<std::thread> threads;
+    threads.emplace_back([&] {
+        for (uint32_t i = 1; !stop; i++, writes++)
+        {
+            uint32_t n = i & 0xffffff; /* exact as float */
+            sens_snapshot_t s{static_cast<float>(n), -static_cast<float>(n), n, static_cast<bool>(n & 1)};
+            if (use_seq)
+                bench_snap.write(s);
+            else
+            {
+                P(bench_mutex);
+                bench_locked = s;
+                V(bench_mutex);
+            }
+            if (paced)
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    });
+    for (int r = 0; r < readers; r++)
+        threads.emplace_back([&] {
+            unsigned long n = 0, bad = 0, worst = 0, most = 0, slow = 0, long_reads = 0;
+            while (!stop)
+            {
+                auto t = std::chrono::steady_clock::now();
+                sens_snapshot_t s;
+                if (use_seq)
+                {
+                    unsigned tries;
+                    s = bench_snap.read(&tries);
+                    most = std::max(most, static_cast<unsigned long>(tries));
+                    slow += (tries > seqLock<sens_snapshot_t>::spin_tries);
+                    long_reads += (tries > lock_max_tries);
+                }
+                else
+                {
+                    P(bench_mutex);
+                    s = bench_locked;
+                    V(bench_mutex);
+                }
+                unsigned long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t).count();
+                worst = std::max(worst, ns);
+                bad += !snap_consistent(s);
+                n++;
+            }
+            reads += n;
+            torn += bad;
+            yielded += slow;
+            over += long_reads;
+            if (worst > max_read_ns)
+                max_read_ns = worst;
+            if (most > max_tries)
+                max_tries = most;
+        });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    stop = true;
+    for (auto &t : threads)
+        t.join();
+    fprintf(stderr, "sim: %s %s, 1 writer, %d readers: %.2fM reads/s, %.3fM writes/s, worst read %.1fus, %lu inconsistent\n",
+            paced ? "contention" : "stress    ", use_seq ? "seqlock" : "mutex  ", readers,
+            reads / 1e6, writes / 1e6, max_read_ns / 1e3, static_cast<unsigned long>(torn));
+    if (use_seq)
+        fprintf(stderr, "sim:   at most %lu tries a read, %lu reads yielded after %u, %lu took over %u\n",
+                static_cast<unsigned long>(max_tries), static_cast<unsigned long>(yielded), seqLock<sens_snapshot_t>::spin_tries,
+                static_cast<unsigned long>(over), lock_max_tries);
+}
+
+void lock_bench(const char *arg)
+{
+    bench_mutex = xSemaphoreCreateMutex();
+    for (int paced = 0; paced <= 1; paced++)
+        for (int readers = 1; readers <= 3; readers += 2)
+        {
+            lock_run(paced, readers, true);
+            lock_run(paced, readers, false);
+        }
+}
+
+/* -m: trimmedWindow against the sort & crop avgSensor::get_data() did before (a std::list of the
+   non-NaN samples, sorted, 1 or 2 dropped at each end), random windows with NaNs, and the cost of both */
+static float window_ref(const float *data, size_t n)
+{
+    std::list<float> s;
+    float res = 0.0;
+    int crop = 0;
+    for (size_t i = 0; i < n; i++)
+        if (!isnan(data[i]))
+            s.push_back(data[i]);
+    if (s.size() > 2)
+    {
+        s.sort();
+        crop = (s.size() > 6) ? 2 : 1;
+    }
+    while (crop-- > 0)
+    {
+        s.pop_front();
+        s.pop_back();
+    }
+    for (auto v : s)
+        res = res + v;
+    return res / s.size();
+}
+
+void window_check(const char *arg)
+{
+    const int n = 12, rounds = 1000000; /* avgSensor::sample_no */
+    trimmedWindow<float, n> w(NAN);
+    float data[n];
+    std::fill(data, data + n, NAN);
+    unsigned long bad = 0, nans = 0;
+    srand(3);
+    for (int i = 0; i < rounds; i++)
+    {
+        int nan_pct = (i / 1000) % 4 * 30; /* stretches of 0, 30, 60 and 90% NaNs */
+        float v = (rand() % 100 < nan_pct) ? NAN : 15 + (rand() % 3000) / 100.0f;
+        if (!(rand() % 5000))
+        {
+            std::fill(data, data + n, v); /* avgSensor::reset() */
+            w.fill(v);
+        }
+        else
+        {
+            data[i % n] = v;
+            w.add(v);
+        }
+        float a = w.trimmed_mean(), b = window_ref(data, n);
+        nans += isnan(b);
+        bad += !((isnan(a) && isnan(b)) || (a == b));
+    }
+    fprintf(stderr, "sim: trimmed mean, %d random windows of %d (%lu without a valid sample): %lu mismatches\n",
+            rounds, n, nans, bad);
+    float sink = 0;
+    auto t = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++)
+    {
+        data[i % n] = 20 + (i % 97) / 10.0f;
+        sink += window_ref(data, n);
+    }
+    double ref_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t).count() / rounds;
+    unsigned long allocs = sim_allocations();
+    t = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++)
+    {
+        w.add(20 + (i % 97) / 10.0f);
+        sink += w.trimmed_mean();
+    }
+    double win_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t).count() / rounds;
+    allocs = sim_allocations() - allocs;
+    fprintf(stderr, "sim: add + mean: sort & crop %.0fns, trimmedWindow %.0fns (host), %lu allocations (%.3g)\n",
+            ref_ns, win_ns, allocs, sink);
+}
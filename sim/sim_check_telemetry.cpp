@@ -0,0 +1,216 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* telemetry: CBOR frames against a message per value */
+
+#include <chrono>
+#include <vector>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "sim.h"
+#include "sim_check.h"
+#include "circuits.h"
+#include "telemetry.h"
+
+/* -C: the values of a frame sent a message each, formatted like genSensor::publish_data(), vs. one CBOR
+   frame (telemetry.h), ticks of each: messages, bytes on the wire, producer time and heap allocations per
+   tick; then frames from the lv_task every 10s through a 4 minute broker outage, each one has to show up
+   once, live or replayed with the epoch of the outage; last sensors with long names until a frame
+   doesn't fit, the values have to go one by one meanwhile. dump: the frames as '<topic> <hex>' lines, like
+   mosquitto_sub -F '%t %x' prints them, for tools/cbor_dump.py */
+static const uint32_t c_wire_us = 300; /* per publish, to put the message counts into time */
+static std::vector<std::pair<std::string, std::vector<uint8_t>>> c_frames; /* as on the wire */
+
+static std::mutex c_mutex;
+static std::atomic<unsigned long> c_values{0}; /* anything else published */
+
+static void c_hook(const char *topic, const char *payload, int len)
+{
+    if (!strstr(topic, "/telemetry"))
+    {
+        c_values++;
+        return;
+    }
+    std::lock_guard<std::mutex> l(c_mutex);
+    c_frames.push_back(std::make_pair(std::string(topic), std::vector<uint8_t>(payload, payload + len)));
+}
+
+static void c_per_value(const char *topic, float v, void *arg)
+{
+    mqtt_publish(topic, String(v));
+}
+
+/* an unsigned integer item, heads as cborWriter writes them */
+static uint32_t c_uint(const uint8_t *&p)
+{
+    uint8_t ai = *p++ & 0x1f;
+    uint32_t v = (ai < 24) ? ai : 0;
+    for (int n = (ai == 24) ? 1 : (ai == 25) ? 2 : (ai == 26) ? 4 : 0; n; n--)
+        v = (v << 8) | *p++;
+    return v;
+}
+
+/* the frame starts with TLM_EPOCH, TLM_UPTIME, TLM_SEQ */
+static uint32_t c_seq(const std::vector<uint8_t> &f, uint32_t &epoch)
+{
+    const uint8_t *p = f.data() + 1;
+    c_uint(p);
+    epoch = c_uint(p);
+    c_uint(p);
+    c_uint(p);
+    c_uint(p);
+    return c_uint(p);
+}
+
+void tlm_bench(const char *arg)
+{
+    const char *dump = strchr(arg, ':');
+    int ticks = atoi(arg);
+    if (dump)
+        dump++;
+    static uint8_t buf[MQTT_PAYLOAD_LEN];
+    sim_mqtt_set_publish_hook(c_hook);
+    for (uint64_t until = sim_now_ms() + 120 * 1000; sim_now_ms() < until;) /* a reading for every sensor */
+    {
+        fcce_feed(true);
+        loop();
+    }
+    fprintf(stderr, "sim: %d ticks each, %uus per publish on the wire\n", ticks, c_wire_us);
+    for (int bundled = 0; bundled < 2; bundled++)
+    {
+        unsigned long msgs = sim_mqtt_published(), bytes = sim_mqtt_wire_bytes(), allocs = 0, ns = 0, ns_max = 0;
+        for (int i = 0; i < ticks; i++)
+        {
+            unsigned long a = sim_allocations();
+            auto t = std::chrono::steady_clock::now();
+            if (bundled)
+                mqtt_publish_raw("/telemetry", buf, telemetry_frame(buf, sizeof(buf)));
+            else
+                telemetry_each(c_per_value, nullptr);
+            unsigned long d = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t).count();
+            allocs += sim_allocations() - a;
+            ns += d;
+            ns_max = std::max(ns_max, d);
+            fcce_feed(true); /* fresh readings and clock, without the rest of loop() and its messages */
+            loop_wifi();
+            loop_mqtt();
+            delay(1000);
+        }
+        msgs = sim_mqtt_published() - msgs;
+        bytes = sim_mqtt_wire_bytes() - bytes;
+        fprintf(stderr, "sim: %s: %.1f msgs/tick, %.0f bytes/tick in PUBLISH packets (+%.0f TCP/IP headers, 40 a packet), "
+                        "%.1fms on the wire, producer %.2fus/tick (max %.1fus), %.1f heap allocations/tick\n",
+                bundled ? "CBOR frame   " : "one per value", static_cast<double>(msgs) / ticks, static_cast<double>(bytes) / ticks,
+                40.0 * msgs / ticks, msgs * c_wire_us / 1e3 / ticks, ns / 1e3 / ticks, ns_max / 1e3, static_cast<double>(allocs) / ticks);
+    }
+
+    uint64_t down = sim_now_ms() + 60 * 1000, up = down + 240 * 1000, end = up + 300 * 1000;
+    uint32_t from = sim_epoch_ms() / 1000 + 60, to = from + 240; /* epoch of the outage */
+    size_t first;
+    {
+        std::lock_guard<std::mutex> l(c_mutex);
+        first = c_frames.size();
+    }
+    telemetry_set_period(10);
+    while (sim_now_ms() < end)
+    {
+        sim_mqtt_set_broker((sim_now_ms() < down) || (sim_now_ms() >= up));
+        fcce_feed(true);
+        loop();
+    }
+    fprintf(stderr, "sim: telemetry %s\n", stats_text(telemetry_stats).c_str());
+    telemetry_set_period(0);
+    std::unique_lock<std::mutex> l(c_mutex);
+    std::map<uint32_t, int> seen;
+    unsigned long live = 0, back = 0, order = 0, epoch_bad = 0, twice = 0;
+    uint32_t last = 0, lo = ~0U, hi = 0, epoch, back_live = ~0U; /* first live frame after the outage */
+    for (size_t i = first; i < c_frames.size(); i++)
+    {
+        c_seq(c_frames[i].second, epoch);
+        if ((c_frames[i].first.find("/replay/") == std::string::npos) && (epoch >= to))
+            back_live = std::min(back_live, epoch);
+    }
+    for (size_t i = first; i < c_frames.size(); i++)
+    {
+        uint32_t seq = c_seq(c_frames[i].second, epoch);
+        bool replay = (c_frames[i].first.find("/replay/") != std::string::npos);
+        if (replay)
+        {
+            order += (back++ && (seq <= last));
+            last = seq;
+            epoch_bad += (epoch + 1 < from) || (epoch >= back_live); /* cached clock */
+        }
+        else
+            live++;
+        twice += (seen[seq]++ > 0);
+        lo = std::min(lo, seq);
+        hi = std::max(hi, seq);
+    }
+    fprintf(stderr, "sim: outage 240s, a frame every 10s: %lu live, %lu replayed (%lu out of order, %lu off the outage), "
+                    "%lu of seq %u..%u missing, %lu twice\n",
+            live, back, order, epoch_bad, (hi - lo + 1) - seen.size(), lo, hi, twice);
+    /* sensors with long names until a frame doesn't fit: the values have to go one by one, as the
+       DS18B20 probes show, whose readings go by themselves only then (<name>-<idx>) */
+    l.unlock();
+    sim_set_onewire_devices(3);
+    new myDS18B20(sim_ui_elements(), "/Probe", 17, 5000);
+    auto frames = [] {
+        std::lock_guard<std::mutex> g(c_mutex);
+        return c_frames.size();
+    };
+    unsigned long frames_a = frames(), values_a = c_values;
+    telemetry_set_period(10);
+    for (uint64_t until = sim_now_ms() + 120 * 1000; sim_now_ms() < until;)
+    {
+        fcce_feed(true);
+        loop();
+    }
+    bool bundled_a = telemetry_bundled();
+    frames_a = frames() - frames_a;
+    values_a = c_values - values_a;
+    for (int i = 0; i < 2; i++)
+        new remoteSensor(sim_ui_elements(), (String("/ARemoteSensorWithAVeryLongNameThatDoesntFitTheFrame") + i).c_str(), 20.0);
+    unsigned long frames_b = frames(), values_b = c_values;
+    for (uint64_t until = sim_now_ms() + 120 * 1000; sim_now_ms() < until;)
+    {
+        fcce_feed(true);
+        loop();
+    }
+    frames_b = frames() - frames_b;
+    values_b = c_values - values_b;
+    fprintf(stderr, "sim: 2 minutes each, frames that fit: %s, %lu frames, %lu other messages; with 2 more sensors: %s, %lu frames, %lu other messages\n",
+            bundled_a ? "bundled" : "one per value", frames_a, values_a, telemetry_bundled() ? "bundled" : "one per value", frames_b, values_b);
+    fprintf(stderr, "sim: telemetry %s\n", stats_text(telemetry_stats).c_str());
+    telemetry_set_period(0);
+    l.lock();
+    FILE *f = dump ? fopen(dump, "w") : nullptr;
+    for (auto &fr : c_frames)
+    {
+        if (!f)
+            break;
+        fprintf(f, "%s ", fr.first.c_str());
+        for (auto b : fr.second)
+            fprintf(f, "%02x", b);
+        fprintf(f, "\n");
+    }
+    if (f)
+        fclose(f);
+}
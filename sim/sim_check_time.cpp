@@ -0,0 +1,267 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* time of day: cached time service, schedule engine */
+
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "sim.h"
+#include "sim_check.h"
+#include "ui.h"
+#include "wifi.h"
+#include "schedule.h"
+
+/* cached time service against getLocalTime(): from 20 minutes before the clock turns valid over two
+   days, once a second and at random points in between, then the cost of a query either way */
+void time_check(const char *arg)
+{
+    if (!freopen("/dev/null", "w", stdout))
+        return;
+    sim_init(TIME_VALID_EPOCH - 1200);
+    setup_ui(30);
+    time_obj = new myTime();
+    int checks = 0, bad = 0;
+    srand(4);
+    for (long i = 0; i < 2 * 86400L; i++)
+    {
+        delay((i % 600) ? 1000 : 1 + rand() % 999);
+        time_obj->tick();
+        struct tm ref, t;
+        getLocalTime(&ref);
+        bool valid = time_obj->get_time(&t);
+        time_snapshot_t s = time_obj->now();
+        if ((valid != (time(nullptr) >= TIME_VALID_EPOCH)) || (s.now != time(nullptr)) ||
+            (s.sod != ref.tm_hour * 3600 + ref.tm_min * 60 + ref.tm_sec) ||
+            (t.tm_sec != ref.tm_sec) || (t.tm_min != ref.tm_min) || (t.tm_hour != ref.tm_hour) ||
+            (t.tm_mday != ref.tm_mday) || (t.tm_mon != ref.tm_mon) || (t.tm_year != ref.tm_year) ||
+            (t.tm_wday != ref.tm_wday) || (t.tm_yday != ref.tm_yday))
+            bad++;
+        checks++;
+    }
+    fprintf(stderr, "sim: time service %d checks against getLocalTime(): %d mismatches\n", checks, bad);
+    const int rounds = 1000000;
+    struct tm t;
+    volatile int sink = 0;
+    auto wall = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++)
+    {
+        getLocalTime(&t);
+        sink += t.tm_sec;
+    }
+    double ns_libc = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - wall).count() / rounds;
+    wall = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++)
+    {
+        time_obj->get_time(&t);
+        sink += t.tm_sec;
+    }
+    double ns_cached = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - wall).count() / rounds;
+    wall = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++)
+        sink += time_obj->sec_of_day();
+    double ns_sod = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - wall).count() / rounds;
+    wall = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++)
+        time_obj->tick();
+    double ns_tick = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - wall).count() / rounds;
+    fprintf(stderr, "sim: per query (host): getLocalTime() %.1fns, cached tm %.1fns, seconds of day %.1fns; tick() within a second %.1fns\n",
+            ns_libc, ns_cached, ns_sod, ns_tick);
+}
+
+/* schedule engine against evaluating the rules one by one: random rule sets (weekday masks, windows over
+   midnight, full days, overlaps) probed at every rule edge and around it, next() checked to be the first
+   change; the ui range against myRange<struct tm>::is_in() for every second of a day; then every
+   second around the DST switches of a CET/CEST zone, where local time skips and repeats an hour */
+typedef struct
+{
+    uint8_t days;
+    int32_t from, to;
+} sched_rule_t;
+
+static bool sched_ref(const std::vector<sched_rule_t> &rules, int wday, int32_t sod)
+{
+    for (auto &r : rules)
+    {
+        int32_t to = (r.to <= r.from) ? r.to + mySchedule::DAY : r.to;
+        if ((r.days & (1 << wday)) && (sod >= r.from) && (sod < to))
+            return true;
+        if ((r.days & (1 << ((wday + 6) % 7))) && (sod + mySchedule::DAY >= r.from) && (sod + mySchedule::DAY < to))
+            return true;
+    }
+    return false;
+}
+
+static bool sched_ref_week(const std::vector<sched_rule_t> &rules, int32_t w)
+{
+    w = ((w % mySchedule::WEEK) + mySchedule::WEEK) % mySchedule::WEEK;
+    return sched_ref(rules, w / mySchedule::DAY, w % mySchedule::DAY);
+}
+
+void sched_check(const char *arg)
+{
+    const int32_t DAY = mySchedule::DAY, WEEK = mySchedule::WEEK;
+    int sets = 0, probes = 0, bad = 0, bad_next = 0;
+    size_t flips = 0;
+    srand(5);
+    for (; sets < 2000; sets++)
+    {
+        mySchedule sch;
+        std::vector<sched_rule_t> rules;
+        int n = 1 + rand() % 5;
+        for (int i = 0; i < n; i++)
+        {
+            uint8_t days = (rand() % 3) ? (1 + rand() % 127) : mySchedule::EVERY_DAY;
+            int32_t from = (rand() % 97) * 900, to = (rand() % 6) ? (rand() % 97) * 900 : from;
+            from = std::min(from, DAY);
+            to = std::min(to, DAY);
+            rules.push_back(sched_rule_t{days, from, to});
+            sch.add(days, from, to);
+        }
+        flips += sch.size();
+        std::vector<int32_t> pts; /* every rule edge on every day, the state can only change there */
+        for (auto &r : rules)
+            for (int d = 0; d < 8; d++)
+                for (int32_t e : {r.from, r.to})
+                    pts.push_back(d * DAY + e);
+        std::sort(pts.begin(), pts.end());
+        for (int32_t p : pts)
+            for (int32_t w : {p - 1, p, p + 1, p + 1 + rand() % 900})
+            {
+                w = ((w % WEEK) + WEEK) % WEEK;
+                bool on = sch.is_on(w / DAY, w % DAY);
+                bad += (on != sched_ref_week(rules, w));
+                int32_t nx = sch.next(w / DAY, w % DAY);
+                bool ok = true;
+                if (nx < 0)
+                    for (int32_t q : pts)
+                        ok = ok && (sched_ref_week(rules, q) == on) && (sched_ref_week(rules, q - 1) == on);
+                else
+                {
+                    ok = (nx > 0) && (nx <= WEEK) && (sched_ref_week(rules, w + nx - 1) == on) && (sched_ref_week(rules, w + nx) != on);
+                    for (int32_t q : pts) /* no change before */
+                        for (int32_t k = 0; ok && (k < 2); k++)
+                        {
+                            int32_t ahead = ((q - k - w) % WEEK + WEEK) % WEEK;
+                            if ((ahead > 0) && (ahead < nx))
+                                ok = (sched_ref_week(rules, w + ahead) == on);
+                        }
+                }
+                bad_next += !ok;
+                probes++;
+            }
+    }
+    fprintf(stderr, "sim: schedule %d random rule sets, %.1f flips/week avg, %d probes: %d state mismatches, %d wrong next()\n",
+            sets, static_cast<double>(flips) / sets, probes, bad, bad_next);
+
+    /* the ui range, inclusive bounds like myRange<struct tm>::is_in(), in the spinbox steps */
+    int ranges = 0, bad_range = 0;
+    for (int l = 0; l <= 2400; l += 100)
+        for (int u = l; u <= 2400; u += 175)
+        {
+            myRange<struct tm> r{{0, (l % 100) * 60 / 100, l / 100}, {0, (u % 100) * 60 / 100, u / 100}};
+            mySchedule sch(r);
+            for (int32_t sod = 0; sod < DAY; sod++)
+            {
+                struct tm t = {};
+                t.tm_hour = sod / 3600;
+                t.tm_min = (sod / 60) % 60;
+                t.tm_sec = sod % 60;
+                bad_range += (sch.is_on(3, sod) != r.is_in(t));
+            }
+            ranges++;
+        }
+    fprintf(stderr, "sim: schedule %d ui ranges x %d s against myRange::is_in(): %d mismatches\n", ranges, DAY, bad_range);
+
+    /* DST: 02:30 falls into the skipped hour in march and comes twice in october */
+    std::vector<sched_rule_t> rules{{mySchedule::EVERY_DAY, 2 * 3600 + 1800, 3 * 3600 + 900},
+                                    {mySchedule::EVERY_DAY, 20 * 3600, 1 * 3600 + 1800},
+                                    {1 << 0, 1 * 3600, 1 * 3600 + 2700},
+                                    {1 << 6, 23 * 3600 + 1800, 0}};
+    mySchedule sch;
+    for (auto &r : rules)
+        sch.add(r.days, r.from, r.to);
+    setenv("TZ", "CET-1CEST,M3.5.0,M10.5.0/3", 1);
+    tzset();
+    int secs = 0, dst_bad = 0, dst_next = 0, jumps = 0, jump_flips = 0;
+    for (time_t day : {static_cast<time_t>(1616886000), static_cast<time_t>(1635631200)}) /* 2021-03-28, 2021-10-31 */
+    {
+        int32_t prev_w = -1, prev_next = 0;
+        bool prev_on = false;
+        for (time_t e = day - DAY; e < day + 2 * DAY; e++)
+        {
+            struct tm lt;
+            localtime_r(&e, &lt);
+            int32_t sod = lt.tm_hour * 3600 + lt.tm_min * 60 + lt.tm_sec, w = lt.tm_wday * DAY + sod;
+            bool on = sch.is_on(lt.tm_wday, sod);
+            dst_bad += (on != sched_ref(rules, lt.tm_wday, sod));
+            if (prev_w >= 0)
+            {
+                if (w != (prev_w + 1) % WEEK) /* local time jumped, next() counts wall clock seconds */
+                {
+                    jumps++;
+                    jump_flips += (on != prev_on);
+                }
+                else
+                    dst_next += ((prev_next == 1) != (on != prev_on));
+            }
+            prev_w = w;
+            prev_on = on;
+            prev_next = sch.next(lt.tm_wday, sod);
+            secs++;
+        }
+    }
+    unsetenv("TZ");
+    tzset();
+    fprintf(stderr, "sim: schedule %d s around the DST switches: %d state mismatches, %d wrong next(); %d local time jumps, %d flipped the state\n",
+            secs, dst_bad, dst_next, jumps, jump_flips);
+
+    const int rounds = 1000000;
+    mySchedule big;
+    for (int d = 0; d < 7; d++)
+        for (int i = 0; i < 8; i++)
+            big.add(1 << d, i * 3 * 3600, i * 3 * 3600 + 3600);
+    volatile int sink = 0;
+    for (mySchedule *m : {&sch, &big})
+    {
+        double ns[2];
+        for (int k = 0; k < 2; k++)
+        {
+            auto wall = std::chrono::steady_clock::now();
+            for (int i = 0; i < rounds; i++)
+            {
+                int32_t sod = (i * 7919ULL) % DAY;
+                sink += k ? m->next(i % 7, sod) : m->is_on(i % 7, sod);
+            }
+            ns[k] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - wall).count() / rounds;
+        }
+        fprintf(stderr, "sim: schedule %zu flips/week: state %.0fns, next %.0fns (host)\n", m->size(), ns[0], ns[1]);
+    }
+    myRange<struct tm> r{{0, 0, 7}, {0, 0, 18}};
+    struct tm t = {};
+    auto wall = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++)
+    {
+        t.tm_hour = (i * 7) % 24;
+        t.tm_min = i % 60;
+        sink += r.is_in(t);
+    }
+    fprintf(stderr, "sim: myRange<struct tm>::is_in() %.0fns (host)\n",
+            std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - wall).count() / rounds);
+}
@@ -0,0 +1,117 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* web: the / page streamed in chunks */
+
+#include <WebServer.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "sim.h"
+#include "sim_check.h"
+#include "circuits.h"
+#include "history.h"
+#include "rollup.h"
+#include "telemetry.h"
+
+/* -W: the / page through the WebServer mock with the three logs full, peak heap (operator new)
+   while it's sent vs. the get_log() Strings the former page build concatenated; the page again
+   with 32 more sensors, which adds a rollup line each, vs. the stats blocks built as Strings */
+struct web_sent_t
+{
+    unsigned long bytes, chunks;
+    size_t largest;
+};
+
+/* the three logs full, 400 rows each */
+static void web_fill_logs(void)
+{
+    static const char *const rows[] = {"MQTT connected", "Sensor /FCCETemp: 23.4 -> 23.5, age 12s",
+                                       "Circuit Heizung: on, BergTemp 17.9 < 18.0", "WiFi: RSSI -71dBm, reconnect 2"};
+    int out = dup(1), null = open("/dev/null", O_WRONLY); /* log_msg() prints every row */
+    fflush(stdout);
+    dup2(null, 1);
+    for (int i = 0; i < 400; i++)
+    {
+        log_msg(String(rows[i % 4]) + " #" + i, myLogger::LOG_MSG);
+        log_msg(String(rows[1]) + " #" + i, myLogger::LOG_SENSOR);
+        log_msg(String(rows[2]) + " #" + i, myLogger::LOG_CIRCUIT);
+    }
+    fflush(stdout);
+    dup2(out, 1);
+    close(null);
+    close(out);
+}
+
+/* a stats block the way the former page built it: one String, newlines replaced */
+static void web_block_sink(const char *c, size_t len, void *arg)
+{
+    *static_cast<String *>(arg) += std::string(c, len).c_str();
+}
+
+void web_bench(const char *arg)
+{
+    web_fill_logs();
+    WebServer srv;
+    setup_web(srv, sim_ui_elements());
+    web_sent_t sent{0, 0, 0};
+    web_sent_t *st = &sent; /* the sink captures one pointer, no std::function allocation */
+    WebServer::sim_sink_t sink = [st](const char *c, size_t len) {
+        st->bytes += len;
+        st->chunks++;
+        st->largest = std::max(st->largest, len);
+    };
+    sim_heap_mark();
+    srv.sim_get("/", sink);
+    unsigned long streamed = sim_heap_peak();
+    web_sent_t first = sent;
+
+    sim_heap_mark();
+    {
+        String page;
+        page += get_log(myLogger::LOG_MSG);
+        page += get_log(myLogger::LOG_SENSOR);
+        page += get_log(myLogger::LOG_CIRCUIT);
+        fprintf(stderr, "sim: / with full logs: %lu bytes in %lu chunks (largest %zu); the logs as get_log() Strings: %u bytes\n",
+                sent.bytes, sent.chunks, sent.largest, page.length());
+    }
+    fprintf(stderr, "sim: peak heap (operator new): streamed %lu bytes, get_log() page build %lu bytes\n",
+            streamed, sim_heap_peak());
+
+    for (int i = 0; i < 32; i++)
+        new remoteSensor(sim_ui_elements(), (String("/Web") + i).c_str(), NAN);
+    web_fill_logs(); /* the sensors logged, same rows again */
+    sent = web_sent_t{0, 0, 0};
+    sim_heap_mark();
+    srv.sim_get("/", sink);
+    unsigned long more = sim_heap_peak();
+    unsigned long former = 0;
+    for (auto fn : {disp_stats, mqtt_stats, telemetry_stats, acq_stats, history_stats, io_stats, rollup_stats})
+    {
+        sim_heap_mark();
+        {
+            String block;
+            fn(web_block_sink, &block);
+            block.replace("\n", "<br>");
+        }
+        former = std::max(former, sim_heap_peak());
+    }
+    fprintf(stderr, "sim: / with 32 more sensors: %lu bytes (+%lu), peak heap streamed %lu bytes (%+ld), "
+                    "the largest stats block built as a String %lu bytes\n",
+            sent.bytes, sent.bytes - first.bytes, more, static_cast<long>(more - streamed), former);
+}
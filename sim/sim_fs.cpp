@@ -0,0 +1,214 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* LittleFS stand-in: files in a host directory. Flash cost model, per file written:
+   LittleFS writes a new copy (copy on write), so each close after writing programs the whole
+   file to fresh blocks (erasing ceil(size/4k) of them) plus a metadata commit of one 256 byte
+   program unit in the directory pair, which gets compacted - one more erase - every 16 commits.
+   Space: the spiffs partition of custompart.csv, 16 blocks, the superblock pair takes two, a file
+   ceil(size/4k); a rewrite holds the old blocks until close, a write that doesn't fit then comes
+   back short, as LittleFS fails with LFS_ERR_NOSPC */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <map>
+#include <algorithm>
+#include <LittleFS.h>
+#include <Preferences.h>
+
+#include "sim.h"
+
+LittleFSFS LittleFS;
+
+static String root;
+static bool tmp_root;
+static unsigned long commits, prog_bytes, erases;
+
+static const size_t blk = 4096, prog_unit = 256;
+static const size_t fs_blocks = 0x10000 / blk, fs_super = 2;
+static unsigned long fs_peak, fs_full;
+
+static size_t blocks(size_t size) { return (size + blk - 1) / blk; }
+
+static String host(const char *path) { return root + ((*path == '/') ? "" : "/") + path; }
+
+/* blocks in use, with the file at host path p counted at size */
+static size_t fs_used(const String &p, size_t size)
+{
+    size_t n = fs_super + blocks(size);
+    DIR *d = opendir(root.c_str());
+    for (struct dirent *e; d && (e = readdir(d));)
+    {
+        String f = root + "/" + e->d_name;
+        struct stat st;
+        if ((e->d_name[0] != '.') && (f != p) && !stat(f.c_str(), &st) && S_ISREG(st.st_mode))
+            n += blocks(st.st_size);
+    }
+    if (d)
+        closedir(d);
+    return n;
+}
+
+bool LittleFSFS::begin(bool formatOnFail)
+{
+    if (root.length())
+        return true;
+    const char *e = getenv("FCC_SIM_FS");
+    if (e)
+    {
+        mkdir(e, 0755);
+        root = e;
+        return true;
+    }
+    char t[] = "/tmp/fccsim-fs-XXXXXX";
+    if (!mkdtemp(t))
+        return false;
+    root = t;
+    tmp_root = true;
+    return true;
+}
+
+File LittleFSFS::open(const char *path, const char *mode)
+{
+    String p = host(path);
+    struct stat st;
+    if (!stat(p.c_str(), &st) && S_ISDIR(st.st_mode))
+    {
+        DIR *d = opendir(p.c_str());
+        return d ? File(d, p) : File();
+    }
+    bool w = strchr(mode, 'w') || strchr(mode, 'a');
+    size_t held = (strchr(mode, 'w') && !stat(p.c_str(), &st)) ? blocks(st.st_size) : 0;
+    String m = String(mode) + "b";
+    FILE *f = fopen(p.c_str(), m.c_str());
+    return f ? File(f, p, w, held) : File();
+}
+
+bool LittleFSFS::exists(const char *path) { return !access(host(path).c_str(), F_OK); }
+
+bool LittleFSFS::remove(const char *path)
+{
+    return !::remove(host(path).c_str());
+}
+
+size_t File::write(const uint8_t *buf, size_t len)
+{
+    if (!f)
+        return 0;
+    size_t used = fs_used(path, std::max(size(), static_cast<size_t>(ftell(f)) + len)) + held;
+    if (used > fs_blocks)
+    {
+        fs_full++;
+        return 0;
+    }
+    fs_peak = std::max(fs_peak, static_cast<unsigned long>(used));
+    size_t n = fwrite(buf, 1, len, f);
+    written += n;
+    return n;
+}
+
+size_t File::size(void)
+{
+    if (!f)
+        return 0;
+    long pos = ftell(f);
+    fseek(f, 0, SEEK_END);
+    long s = ftell(f);
+    fseek(f, pos, SEEK_SET);
+    return s;
+}
+
+File File::openNextFile(void)
+{
+    for (struct dirent *e; d && (e = readdir(d));)
+    {
+        if (e->d_name[0] == '.')
+            continue;
+        String p = path + "/" + e->d_name;
+        FILE *fp = fopen(p.c_str(), "rb");
+        if (fp)
+            return File(fp, p, false);
+    }
+    return File();
+}
+
+void File::close(void)
+{
+    if (f && writing)
+    {
+        size_t s = size();
+        commits++;
+        prog_bytes += (s + prog_unit - 1) / prog_unit * prog_unit + prog_unit;
+        erases += (s + blk - 1) / blk + ((commits % 16) ? 0 : 1);
+    }
+    if (f)
+        fclose(f);
+    if (d)
+        closedir(d);
+    f = nullptr;
+    d = nullptr;
+    writing = false;
+    held = 0;
+}
+
+void sim_fs_stats(unsigned long *c, unsigned long *prog, unsigned long *erase)
+{
+    *c = commits;
+    *prog = prog_bytes;
+    *erase = erases;
+}
+
+void sim_fs_space(unsigned long *peak, unsigned long *total, unsigned long *full)
+{
+    *peak = fs_peak;
+    *total = fs_blocks;
+    *full = fs_full;
+}
+
+/* a temporary root goes with the run */
+void sim_fs_cleanup(void)
+{
+    if (!tmp_root)
+        return;
+    String cmd = "rm -rf " + root;
+    if (system(cmd.c_str()))
+        return;
+}
+
+/* NVS, gone with the run */
+static std::map<String, uint32_t> nvs;
+static unsigned long nvs_writes;
+
+uint32_t Preferences::getUInt(const char *key, uint32_t def)
+{
+    auto i = nvs.find(ns + "/" + key);
+    return (i == nvs.end()) ? def : i->second;
+}
+
+size_t Preferences::putUInt(const char *key, uint32_t v)
+{
+    if (ro)
+        return 0;
+    nvs[ns + "/" + key] = v;
+    nvs_writes++;
+    return sizeof(v);
+}
+
+unsigned long sim_nvs_writes(void) { return nvs_writes; }
@@ -0,0 +1,533 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <ESPmDNS.h>
+#include <Wire.h>
+#include <AutoConnect.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <malloc.h>
+#include <string.h>
+#include <soc/gpio_reg.h>
+#include <algorithm>
+#include <vector>
+#include <set>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <new>
+
+#include "sim.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+MDNSResponder MDNS;
+TwoWire Wire;
+const char AutoConnect::_CSS_BASE[] = "";
+const char AutoConnect::_CSS_TABLE[] = "";
+
+/* heap allocations, counted at operator new since the host String is a std::string;
+   the bytes they hold and the peak of those since sim_heap_mark() */
+static std::atomic<unsigned long> allocations{0};
+static std::atomic<long> heap_live{0}, heap_peak{0}, heap_base{0};
+unsigned long sim_allocations(void) { return allocations; }
+
+void sim_heap_mark(void)
+{
+    heap_base = heap_live.load();
+    heap_peak = heap_base.load();
+}
+unsigned long sim_heap_peak(void) { return heap_peak - heap_base; }
+
+void *operator new(size_t n)
+{
+    allocations++;
+    void *p = malloc(n ? n : 1);
+    if (!p)
+        throw std::bad_alloc();
+    long live = heap_live += malloc_usable_size(p);
+    for (long peak = heap_peak; (live > peak) && !heap_peak.compare_exchange_weak(peak, live);)
+        ;
+    return p;
+}
+void operator delete(void *p) noexcept
+{
+    heap_live -= malloc_usable_size(p);
+    free(p);
+}
+void operator delete(void *p, size_t) noexcept { operator delete(p); }
+
+/* virtual clock */
+static std::atomic<uint64_t> now_ms{0};
+static time_t epoch_start = 1622505600; /* 2021-06-01 00:00:00 UTC */
+static std::mutex clk_mutex;
+static std::condition_variable clk_cv;
+static std::condition_variable asleep_cv; /* a task woken by the clock went back to sleep */
+static std::multiset<uint64_t> wakes;     /* deadlines of the sleeping tasks, under clk_mutex */
+static int pending;                       /* tasks woken by the clock, not asleep again yet */
+static unsigned gen;                      /* clock stop they were woken at */
+static thread_local unsigned woken_gen;   /* 0: not woken by the clock */
+static std::thread::id main_thread;
+static bool main_registered = false;
+static uint32_t quantum = 0;
+static bool preemptive = false;
+
+void sim_init(time_t epoch)
+{
+    epoch_start = epoch;
+    main_thread = std::this_thread::get_id();
+    main_registered = true;
+}
+
+uint64_t sim_now_ms(void) { return now_ms; }
+uint64_t sim_epoch_ms(void) { return static_cast<uint64_t>(epoch_start) * 1000 + now_ms; }
+void sim_set_quantum(uint32_t ms) { quantum = ms; }
+void sim_set_preemptive(int on) { preemptive = on; }
+
+/* preemptive: stops at every deadline of a sleeping task on the way and lets it run until it
+   sleeps again, as if it had preempted the main thread right then; otherwise the tasks wake
+   once the main thread has passed their deadline, much cheaper */
+void sim_advance(uint32_t ms)
+{
+    std::unique_lock<std::mutex> l(clk_mutex);
+    uint64_t until = now_ms + ms;
+    if (!preemptive)
+    {
+        now_ms = until;
+        if (!wakes.empty() && (*wakes.begin() <= until))
+            clk_cv.notify_all(); /* nobody to wake most of the time, saves a futex call per loop() */
+        return;
+    }
+    while (!wakes.empty() && (*wakes.begin() <= until))
+    {
+        now_ms = *wakes.begin();
+        pending = wakes.count(now_ms);
+        if (!++gen)
+            gen++;
+        clk_cv.notify_all();
+        /* host time bound: a task may have gone on to block on something else */
+        asleep_cv.wait_for(l, std::chrono::milliseconds(20), [] { return pending <= 0; });
+        pending = 0;
+    }
+    now_ms = until;
+}
+
+unsigned long millis(void) { return static_cast<unsigned long>(now_ms); }
+unsigned long micros(void) { return static_cast<unsigned long>(now_ms * 1000); }
+void yield(void) { std::this_thread::yield(); }
+
+/* the main thread drives time, other tasks sleep until it has passed */
+void delay(uint32_t ms)
+{
+    if (!main_registered || (std::this_thread::get_id() == main_thread))
+    {
+        sim_advance(std::max(ms, quantum));
+        return;
+    }
+    std::unique_lock<std::mutex> l(clk_mutex);
+    uint64_t until = now_ms + ms;
+    if (woken_gen && (woken_gen == gen) && (--pending <= 0))
+        asleep_cv.notify_one();
+    woken_gen = 0;
+    if (now_ms >= until)
+        return;
+    auto w = wakes.insert(until);
+    while (now_ms < until)
+        clk_cv.wait(l);
+    wakes.erase(w);
+    woken_gen = gen;
+}
+
+/* a blocking call with a timeout of ms on the virtual clock, pred() checked under l: a task
+   sleeps as in delay(), its deadline is a wake, it looks at the clock every host ms since the
+   clock doesn't know cv; the main thread can't wait for itself to move the clock, whoever it
+   waits for takes no virtual time unless asleep, so once nothing comes through on the host
+   it moves the clock on to the next wake or the deadline */
+template <typename Pred>
+static bool sim_wait(std::unique_lock<std::mutex> &l, std::condition_variable &cv, uint32_t ms, Pred pred)
+{
+    if (pred() || !ms)
+        return pred();
+    if (!main_registered || (std::this_thread::get_id() == main_thread))
+    {
+        uint64_t until = now_ms + ms;
+        while (!cv.wait_for(l, std::chrono::milliseconds(1), pred))
+        {
+            if (now_ms >= until)
+                return false;
+            uint64_t next = until;
+            {
+                std::lock_guard<std::mutex> c(clk_mutex);
+                if (!wakes.empty())
+                    next = std::min(next, std::max(*wakes.begin(), now_ms + 1));
+            }
+            l.unlock();
+            sim_advance(next - now_ms);
+            l.lock();
+        }
+        return true;
+    }
+    uint64_t until;
+    std::multiset<uint64_t>::iterator w;
+    {
+        std::lock_guard<std::mutex> c(clk_mutex);
+        until = now_ms + ms;
+        if (woken_gen && (woken_gen == gen) && (--pending <= 0))
+            asleep_cv.notify_one();
+        woken_gen = 0;
+        w = wakes.insert(until);
+    }
+    bool ok;
+    while (!(ok = pred()) && (now_ms < until))
+        cv.wait_for(l, std::chrono::milliseconds(1));
+    std::lock_guard<std::mutex> c(clk_mutex);
+    wakes.erase(w);
+    if (!ok)
+        woken_gen = gen;
+    return ok;
+}
+
+/* the calling task is busy for ms, e.g. bit-banging a bus: the main thread takes the clock
+   with it, other tasks wait for it to get there */
+void sim_busy(uint32_t ms)
+{
+    if (!main_registered || (std::this_thread::get_id() == main_thread))
+        sim_advance(ms);
+    else
+        delay(ms);
+}
+
+/* gpio */
+static const int max_pins = 40;
+static uint8_t pin_val[max_pins];
+static uint8_t pin_mode[max_pins];
+static uint16_t pin_analog[max_pins];
+static sim_gpio_hook_t gpio_hook;
+
+void sim_set_gpio_hook(sim_gpio_hook_t fn) { gpio_hook = fn; }
+void sim_set_analog(uint8_t pin, uint16_t val)
+{
+    if (pin < max_pins)
+        pin_analog[pin] = val;
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    if (pin < max_pins)
+        pin_mode[pin] = mode;
+}
+
+static unsigned long pin_writes, reg_writes;
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    pin_writes++;
+    if (pin >= max_pins)
+        return;
+    val = val ? HIGH : LOW;
+    if (pin_val[pin] != val && gpio_hook)
+        gpio_hook(now_ms, pin, val);
+    pin_val[pin] = val;
+}
+
+int digitalRead(uint8_t pin) { return (pin < max_pins) ? pin_val[pin] : LOW; }
+
+/* GPIO output registers, soc/gpio_reg.h: set/clear act on the pins like digitalWrite() */
+static void reg_pins(int first, uint32_t mask, uint8_t val)
+{
+    for (int b = 0; b < 32; b++)
+    {
+        int pin = first + b;
+        if (!(mask & (1UL << b)) || (pin >= max_pins))
+            continue;
+        if ((pin_val[pin] != val) && gpio_hook)
+            gpio_hook(now_ms, pin, val);
+        pin_val[pin] = val;
+    }
+}
+
+void sim_reg_write(uint32_t addr, uint32_t v)
+{
+    reg_writes++;
+    switch (addr)
+    {
+    case GPIO_OUT_W1TS_REG:
+        reg_pins(0, v, HIGH);
+        break;
+    case GPIO_OUT_W1TC_REG:
+        reg_pins(0, v, LOW);
+        break;
+    case GPIO_OUT1_W1TS_REG:
+        reg_pins(32, v, HIGH);
+        break;
+    case GPIO_OUT1_W1TC_REG:
+        reg_pins(32, v, LOW);
+        break;
+    }
+}
+
+uint32_t sim_reg_read(uint32_t addr)
+{
+    int first = (addr == GPIO_OUT_REG) ? 0 : ((addr == GPIO_OUT1_REG) ? 32 : -1);
+    uint32_t v = 0;
+    for (int b = 0; (first >= 0) && (b < 32) && (first + b < max_pins); b++)
+        v |= static_cast<uint32_t>(pin_val[first + b] != LOW) << b;
+    return v;
+}
+
+void sim_gpio_writes(unsigned long *pins, unsigned long *regs)
+{
+    *pins = pin_writes;
+    *regs = reg_writes;
+}
+uint16_t analogRead(uint8_t pin) { return (pin < max_pins) ? pin_analog[pin] : 0; }
+
+/* LEDC: duty per channel, channel + 1 per pin (0: none) */
+static const int ledc_channels = 16;
+static uint8_t ledc_bits[ledc_channels];
+static uint32_t ledc_duty[ledc_channels];
+static uint8_t pin_ledc[max_pins];
+
+double ledcSetup(uint8_t chan, double freq, uint8_t bit_num)
+{
+    if (chan < ledc_channels)
+        ledc_bits[chan] = bit_num;
+    return freq;
+}
+void ledcWrite(uint8_t chan, uint32_t duty)
+{
+    if (chan < ledc_channels)
+        ledc_duty[chan] = duty;
+}
+uint32_t ledcRead(uint8_t chan) { return (chan < ledc_channels) ? ledc_duty[chan] : 0; }
+double ledcWriteTone(uint8_t chan, double freq) { return freq; }
+void ledcAttachPin(uint8_t pin, uint8_t chan)
+{
+    if ((pin < max_pins) && (chan < ledc_channels))
+        pin_ledc[pin] = chan + 1;
+}
+void ledcDetachPin(uint8_t pin)
+{
+    if (pin < max_pins)
+        pin_ledc[pin] = 0;
+}
+
+double sim_pin_level(uint8_t pin)
+{
+    if (pin >= max_pins)
+        return 0;
+    if (!pin_ledc[pin])
+        return pin_val[pin];
+    int c = pin_ledc[pin] - 1;
+    return ledc_duty[c] / static_cast<double>((1UL << ledc_bits[c]) - 1);
+}
+
+/* OneWire bus */
+static int onewire_devices;
+void sim_set_onewire_devices(int n) { onewire_devices = n; }
+int sim_onewire_devices(void) { return onewire_devices; }
+
+long map(long x, long in_min, long in_max, long out_min, long out_max)
+{
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+/* FreeRTOS: binary semaphores with mutex API semantics, timeouts on the virtual clock (sim_wait()),
+   tasks as detached threads */
+struct sim_sem
+{
+    std::mutex m;
+    std::condition_variable cv;
+    bool avail = true;
+};
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) { return new sim_sem; }
+void vSemaphoreDelete(SemaphoreHandle_t s) { delete s; }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> l(s->m);
+    auto avail = [s] { return s->avail; };
+    if (ticks == portMAX_DELAY)
+        s->cv.wait(l, avail);
+    else if (!sim_wait(l, s->cv, ticks, avail))
+        return pdFALSE;
+    s->avail = false;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s)
+{
+    {
+        std::lock_guard<std::mutex> l(s->m);
+        if (s->avail)
+            return pdFALSE;
+        s->avail = true;
+    }
+    s->cv.notify_one();
+    return pdTRUE;
+}
+
+/* queues: items copied in and out of a ring, timeouts on the virtual clock like the semaphores */
+struct sim_queue
+{
+    std::mutex m;
+    std::condition_variable cv;
+    std::vector<uint8_t> ring;
+    size_t item_size, len, head = 0, count = 0;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size)
+{
+    sim_queue *q = new sim_queue;
+    q->ring.resize(len * item_size);
+    q->item_size = item_size;
+    q->len = len;
+    return q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks)
+{
+    {
+        std::unique_lock<std::mutex> l(q->m);
+        auto space = [q] { return q->count < q->len; };
+        if (ticks == portMAX_DELAY)
+            q->cv.wait(l, space);
+        else if (!space() && (!ticks || !sim_wait(l, q->cv, ticks, space)))
+            return pdFALSE;
+        memcpy(&q->ring[((q->head + q->count) % q->len) * q->item_size], item, q->item_size);
+        q->count++;
+    }
+    q->cv.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *buf, TickType_t ticks)
+{
+    {
+        std::unique_lock<std::mutex> l(q->m);
+        auto avail = [q] { return q->count > 0; };
+        if (ticks == portMAX_DELAY)
+            q->cv.wait(l, avail);
+        else if (!avail() && (!ticks || !sim_wait(l, q->cv, ticks, avail)))
+            return pdFALSE;
+        memcpy(buf, &q->ring[q->head * q->item_size], q->item_size);
+        q->head = (q->head + 1) % q->len;
+        q->count--;
+    }
+    q->cv.notify_all();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q)
+{
+    std::lock_guard<std::mutex> l(q->m);
+    return q->count;
+}
+
+struct sim_task
+{
+    TaskFunction_t fn;
+    void *arg;
+    UBaseType_t prio;
+    const char *name;
+};
+static thread_local sim_task *current_task;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack,
+                                   void *arg, UBaseType_t prio, TaskHandle_t *h, BaseType_t core)
+{
+    sim_task *t = new sim_task{fn, arg, prio, name};
+    if (h)
+        *h = t;
+    std::thread([t] {
+        current_task = t;
+        t->fn(t->arg);
+    }).detach();
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t t)
+{
+    if (!t || t == current_task)
+        pthread_exit(nullptr);
+    ::printf("sim: vTaskDelete() of another task (%s) isn't supported, ignored.\n", t->name);
+}
+
+void vTaskDelay(TickType_t ticks) { delay(ticks); }
+UBaseType_t uxTaskPriorityGet(TaskHandle_t t)
+{
+    if (!t)
+        t = current_task;
+    return t ? t->prio : 1; /* arduino loopTask */
+}
+
+/* Serial, ESP */
+size_t HardwareSerial::printf(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int r = vprintf(fmt, ap);
+    va_end(ap);
+    return (r < 0) ? 0 : r;
+}
+
+static sim_restart_hook_t restart_hook;
+void sim_set_restart_hook(sim_restart_hook_t fn) { restart_hook = fn; }
+
+void EspClass::restart(void)
+{
+    if (restart_hook)
+    {
+        restart_hook(); /* the caller carries on */
+        return;
+    }
+    ::printf("sim: ESP.restart() requested at %llus, stopping.\n",
+             static_cast<unsigned long long>(now_ms / 1000));
+    fflush(stdout);
+    _exit(3);
+}
+
+/* pretend to be a 320k heap, so memory growth shows up where the firmware reports it */
+uint32_t EspClass::getFreeHeap(void)
+{
+    const size_t heap = 320 * 1024;
+    struct mallinfo2 mi = mallinfo2();
+    return (mi.uordblks < heap) ? static_cast<uint32_t>(heap - mi.uordblks) : 0;
+}
+
+/* time, time() itself is redirected to the virtual clock in sim_time.c */
+static long gmt_offset;
+
+void configTime(long gmtOffset_sec, int daylightOffset_sec, const char *server1,
+                const char *server2, const char *server3)
+{
+    gmt_offset = gmtOffset_sec + daylightOffset_sec;
+}
+
+bool getLocalTime(struct tm *info, uint32_t ms)
+{
+    time_t now = time(nullptr) + gmt_offset;
+    gmtime_r(&now, info);
+    return true;
+}
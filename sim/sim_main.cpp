@@ -0,0 +1,381 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* runs the unmodified setup()/loop() against the simulated HAL, as fast as the host allows, or one of
+   the checks in sim_check_*.cpp; program -h lists the options */
+
+#include <Arduino.h>
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+#include <list>
+#include <algorithm>
+
+#include "sim.h"
+#include "sim_check.h"
+#include "circuits.h"
+#include "rollup.h"
+
+/* the lines a stats function writes to its sink, joined by sep, no trailing newline */
+String stats_text(void (*fn)(log_sink_fn, void *), const char *sep)
+{
+    std::string s, out;
+    fn([](const char *c, size_t len, void *arg) { static_cast<std::string *>(arg)->append(c, len); }, &s);
+    while (!s.empty() && (s.back() == '\n'))
+        s.pop_back();
+    for (char c : s)
+        if (c == '\n')
+            out += sep;
+        else
+            out += c;
+    return String(out.c_str());
+}
+
+/* scripted sensor trace */
+typedef struct
+{
+    uint64_t t_ms;
+    String topic;
+    String value;
+} trace_event_t;
+static std::vector<trace_event_t> trace;
+static size_t trace_pos;
+static uint64_t last_feed_ms; /* latest reading delivered, for the reaction latency */
+
+static bool trace_load(const char *fn)
+{
+    FILE *f = fopen(fn, "r");
+    if (!f)
+        return false;
+    char line[128], name[64], val[32];
+    double sec;
+    while (fgets(line, sizeof(line), f))
+    {
+        if ((line[0] == '#') || (sscanf(line, "%lf,%63[^,],%31s", &sec, name, val) != 3))
+            continue;
+        trace.push_back(trace_event_t{static_cast<uint64_t>(sec * 1000), String("fcce/") + name, String(val)});
+    }
+    fclose(f);
+    /* keep file order for equal timestamps */
+    std::stable_sort(trace.begin(), trace.end(),
+                     [](const trace_event_t &a, const trace_event_t &b) { return a.t_ms < b.t_ms; });
+    return true;
+}
+
+static void trace_feed(void)
+{
+    uint64_t now = sim_now_ms();
+    while ((trace_pos < trace.size()) && (trace[trace_pos].t_ms <= now))
+    {
+        sim_mqtt_inject(trace[trace_pos].topic.c_str(), trace[trace_pos].value.c_str());
+        probe_feed(trace[trace_pos].topic, trace[trace_pos].t_ms, trace[trace_pos].value);
+        last_feed_ms = trace[trace_pos].t_ms;
+        trace_pos++;
+    }
+}
+
+/* switch transitions */
+static FILE *trace_out;
+static unsigned long transitions;
+static uint64_t latency_sum, latency_max; /* latest reading -> transition, if within a minute */
+static unsigned long reactions;
+
+static void record_gpio(uint64_t t_ms, uint8_t pin, uint8_t val)
+{
+    if (pin == TFT_LED)
+        return; /* screensaver backlight, not a switch */
+    transitions++;
+    if (!trace.empty() && (t_ms - last_feed_ms < 60 * 1000))
+    {
+        reactions++;
+        latency_sum += t_ms - last_feed_ms;
+        latency_max = std::max(latency_max, t_ms - last_feed_ms);
+    }
+    if (trace_out)
+        fprintf(trace_out, "%llu,%u,%u\n", static_cast<unsigned long long>(t_ms), pin, val);
+}
+
+/* fcce stand-in: sensor telemetry every 10s, alive message every 30s, following a daily curve */
+void fcce_feed(bool sensors)
+{
+    static uint64_t next_sensors = 0, next_alive = 0;
+    uint64_t now = sim_now_ms();
+    char buf[64];
+
+    if (sensors && (now >= next_sensors))
+    {
+        double day = 2 * M_PI * ((sim_epoch_ms() / 1000) % 86400) / 86400.0;
+        static const struct
+        {
+            const char *topic;
+            double base, amp;
+        } feeds[] = {
+            {"fcce/FCCETemp", 26.0, 2.0},
+            {"fcce/FCCEHum", 65.0, -5.0},
+            {"fcce/BergTemp", 27.0, 3.0},
+            {"fcce/BergHum", 72.0, -6.0},
+            {"fcce/ErdeTemp", 29.5, 1.5},
+            {"fcce/ErdeHum", 68.0, -4.0},
+        };
+        for (auto &f : feeds)
+        {
+            snprintf(buf, sizeof(buf), "%.2f", f.base - f.amp * cos(day));
+            sim_mqtt_inject(f.topic, buf);
+        }
+        next_sensors = now + 10 * 1000;
+    }
+    if (now >= next_alive)
+    {
+        unsigned long upt = now / 1000;
+        snprintf(buf, sizeof(buf), "fcce/ut %02luh:%02lum:%02lus", upt / 3600, (upt % 3600) / 60, upt % 60);
+        sim_mqtt_inject("fcce/config", buf);
+        next_alive = now + 30 * 1000;
+    }
+}
+
+/* checks: ALONE run on their own, AFTER_SETUP once setup() is done, TASKS with the helper tasks
+   preemptive (at their deadlines, reproducibly) */
+enum
+{
+    ALONE,
+    AFTER_SETUP,
+    TASKS
+};
+static const struct
+{
+    const char *opt, *arg;
+    void (*fn)(const char *arg);
+    int when;
+    const char *help;
+} checks[] = {
+    {"-i", nullptr, img_bench, ALONE, "rle image decoder throughput"},
+    {"-l", nullptr, lock_bench, ALONE, "sensor snapshot stress test, seqlock vs. mutex under contention"},
+    {"-L", nullptr, ring_check, ALONE,
+     "logger arena ring, eviction under a lagging cursor, wraps, truncation, 1 writer vs. 3 readers"},
+    {"-m", nullptr, window_check, ALONE, "trimmed mean window against the former sort & crop, cost of both"},
+    {"-R", nullptr, rollup_check, ALONE, "rollups against brute force aggregation, cost per sample"},
+    {"-S", nullptr, sched_check, ALONE, "schedule engine against the rules one by one, midnight and DST days"},
+    {"-T", nullptr, time_check, ALONE, "cached time service against getLocalTime(), cost per query"},
+    {"-G", nullptr, frame_check, ALONE, "output frame against the mocked GPIO registers"},
+    {"-r", nullptr, relay_check, ALONE, "relay protection on a plain and an inverted output, dwell and hourly budget"},
+    {"-P", "hours[:kp:ti:td:window]", pid_bench, ALONE,
+     "heater on a thermal plant, hysteresis vs. PID with kp (1/K), ti, td, relay window (s)"},
+    {"-H", "days[:flush_h]", hist_bench, ALONE, "history store over days of synthetic feeds, flushed every flush_h"},
+    {"-D", nullptr, topic_bench, AFTER_SETUP, "fcce topic dispatch, sorted index vs. the former linear scan"},
+    {"-W", nullptr, web_bench, AFTER_SETUP,
+     "the / page with full logs, peak heap while it's sent vs. the former Strings, again with 32 more sensors"},
+    {"-Q", "wire_us", pub_bench, AFTER_SETUP, "publish call cost, producers sending themselves vs. the publish queue"},
+    {"-f", "mhz[:cpu]", disp_bench, AFTER_SETUP,
+     "frame time per display buffer height, SPI clock of mhz, host render time x cpu"},
+    {"-C", "ticks[:dump]", tlm_bench, TASKS,
+     "telemetry a message per value vs. CBOR frames, frames through an outage; dump: the frames as hex"},
+};
+static const int n_checks = sizeof(checks) / sizeof(checks[0]);
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-q] [-t trace] [-o out.csv] [-s step_ms] [-a] [-w n] [-M] [-O hours] [seconds]\n"
+                    "  seconds: virtual seconds to run, default 1 day\n"
+                    "  -q: no firmware output on stdout\n"
+                    "  -t: scripted sensor trace instead of the builtin daily curve, lines of '<second>,<fcce sensor>,<value>'\n"
+                    "  -o: record every switch transition as '<ms>,<gpio>,<value>', diffable across firmware versions\n"
+                    "  -s: time-warp, minimum virtual ms per loop() (default: firmware delay, 5000ms with -t)\n"
+                    "  -a: fusion probe, BergTemp and ErdeTemp averaged FUSE_FRESH and FUSE_TRIMMED against the live feeds\n"
+                    "  -w: n DS18B20 on a simulated OneWire bus, read like the soil sensor in main.cpp\n"
+                    "  -M: broker outages of 30s, 150s, 280s and 5s, then stalled publishes; loop() rounds, reconnects and alarm latency\n"
+                    "  -O: one broker outage of hours from 1h on, the spool's replay checked against a probe topic\n"
+                    "or one check, then exit:\n",
+            prog);
+    for (auto &c : checks)
+        fprintf(stderr, "  %s%s%s: %s\n", c.opt, c.arg ? " " : "", c.arg ? c.arg : "", c.help);
+}
+
+static void quit(void)
+{
+    sim_fs_cleanup();
+    fflush(stdout);
+    _exit(0); /* helper tasks are still blocked on the virtual clock */
+}
+
+int main(int argc, char **argv)
+{
+    bool quiet = false;
+    unsigned long duration = 24 * 3600;
+    int step = 0;
+    bool probe = false;
+    bool outages = false;
+    float spool_hours = 0;
+    int ds18b20 = 0;
+    const char *trace_fn = nullptr, *out_fn = nullptr;
+    const char *check_arg = nullptr;
+    int check = -1;
+    for (int i = 1; i < argc; i++)
+    {
+        String a(argv[i]);
+        int c = 0;
+        while ((c < n_checks) && (a != checks[c].opt))
+            c++;
+        if ((c < n_checks) && (!checks[c].arg || (i + 1 < argc)))
+        {
+            check = c;
+            check_arg = checks[c].arg ? argv[++i] : nullptr;
+        }
+        else if (a == "-h")
+        {
+            usage(argv[0]);
+            return 0;
+        }
+        else if (a == "-q")
+            quiet = true;
+        else if (a == "-a")
+            probe = true;
+        else if (a == "-M")
+            outages = true;
+        else if ((a == "-O") && (i + 1 < argc))
+            spool_hours = atof(argv[++i]);
+        else if ((a == "-w") && (i + 1 < argc))
+            ds18b20 = atoi(argv[++i]);
+        else if ((a == "-t") && (i + 1 < argc))
+            trace_fn = argv[++i];
+        else if ((a == "-o") && (i + 1 < argc))
+            out_fn = argv[++i];
+        else if ((a == "-s") && (i + 1 < argc))
+            step = atoi(argv[++i]);
+        else if (isdigit(argv[i][0]))
+            duration = strtoul(argv[i], nullptr, 0);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if ((check >= 0) && (checks[check].when == ALONE))
+    {
+        checks[check].fn(check_arg);
+        quit();
+    }
+    if (trace_fn && !trace_load(trace_fn))
+    {
+        fprintf(stderr, "sim: can't read trace %s\n", trace_fn);
+        return 1;
+    }
+    if (out_fn && !(trace_out = (String(out_fn) == "-") ? fdopen(dup(1), "w") : fopen(out_fn, "w")))
+    {
+        fprintf(stderr, "sim: can't write %s\n", out_fn);
+        return 1;
+    }
+    if (quiet && !freopen("/dev/null", "w", stdout))
+        return 1;
+    if (trace_out)
+        fprintf(trace_out, "ms,gpio,value\n");
+    sim_set_gpio_hook(record_gpio);
+
+    if (spool_hours > 0)
+        duration = spool_setup(spool_hours);
+    if (outages || (spool_hours > 0) || ((check >= 0) && (checks[check].when == TASKS)))
+        sim_set_preemptive(true); /* the connection task runs at its deadlines, reproducibly */
+    const char *e = getenv("FCC_SIM_EPOCH");
+    sim_init(e ? static_cast<time_t>(strtoll(e, nullptr, 0)) : 1622505600);
+
+    auto wall = std::chrono::steady_clock::now();
+    unsigned long loops = 0;
+    setup();
+    if (check >= 0)
+    {
+        checks[check].fn(check_arg);
+        quit();
+    }
+    if (probe)
+        probe_setup();
+    if (ds18b20)
+        ds18b20_setup(ds18b20);
+    unsigned long allocs = sim_allocations();
+    if (step > 0)
+        sim_set_quantum(step);
+    else if (trace_fn)
+        sim_set_quantum(5000); /* circuit period */
+    uint64_t round_max = 0, stalled_ms = 0;
+    unsigned long stalled = 0;
+    while (sim_now_ms() < duration * 1000ULL)
+    {
+        fcce_feed(!trace_fn);
+        if (trace_fn)
+            trace_feed();
+        if (outages)
+            outages_run();
+        if (spool_hours > 0)
+            spool_feed();
+        uint64_t t = sim_now_ms();
+        loop();
+        t = sim_now_ms() - t;
+        t -= std::min(t, static_cast<uint64_t>(std::max(glob_delay, step))); /* what blocked, besides the delay() at the end */
+        round_max = std::max(round_max, t);
+        if (t > 100)
+        {
+            stalled++;
+            stalled_ms += t;
+        }
+        probe_check();
+        loops++;
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall).count();
+    allocs = sim_allocations() - allocs;
+
+    fflush(stdout);
+    if (trace_out)
+        fclose(trace_out);
+    if (spool_hours > 0)
+        spool_report();
+    if (outages)
+    {
+        outages_report();
+        fprintf(stderr, "sim: loop() blocked at most %llums per round, %lu rounds over 100ms, %.1fs in all\n",
+                static_cast<unsigned long long>(round_max), stalled, stalled_ms / 1000.0);
+    }
+    if (outages || (spool_hours > 0))
+    {
+        String m = stats_text(mqtt_stats, "\nsim:   ");
+        fprintf(stderr, "sim: mqtt %s\n", m.c_str());
+    }
+    if (reactions)
+        fprintf(stderr, "sim: %lu reactions to readings, latency avg %llums, max %llums, %.0f circuit evaluations/h\n",
+                reactions, static_cast<unsigned long long>(latency_sum / reactions), static_cast<unsigned long long>(latency_max),
+                genCircuit::evaluations() * 3600.0 / duration);
+    if (probe)
+        probe_report();
+    if (genSensor::stale_events())
+        fprintf(stderr, "sim: %lu stale sensor events\n", genSensor::stale_events());
+    fprintf(stderr, "sim: %.0f heap allocations/h after setup\n", allocs * 3600.0 / duration);
+    fprintf(stderr, "sim: worst lv_task_handler() run %.1fms\n", lv_stall_max_us / 1000.0);
+    if (ds18b20)
+    {
+        String acq = stats_text(acq_stats, "\nsim: ");
+        fprintf(stderr, "sim: %s\n", acq.c_str());
+    }
+    fprintf(stderr, "sim: display %s\n", stats_text(disp_stats).c_str());
+    String outs = stats_text(io_stats, "\nsim: ");
+    if (outs.length())
+        fprintf(stderr, "sim: %s\n", outs.c_str());
+    fprintf(stderr, "sim: %lu NVS writes\n", sim_nvs_writes());
+    fprintf(stderr, "sim: gpio %s\n", stats_text(gpio_stats).c_str());
+    String roll = stats_text(rollup_stats, "\nsim: ");
+    fprintf(stderr, "sim: %s\n", roll.c_str());
+    fprintf(stderr, "sim: %lus simulated in %.2fs (x%.0f), %lu loops, %lu switch transitions, %lu mqtt msgs published, %lu px flushed, free heap %u\n",
+            duration, secs, duration / secs, loops, transitions, sim_mqtt_published(), sim_flushed_pixels(), ESP.getFreeHeap());
+    quit();
+}
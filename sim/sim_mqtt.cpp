@@ -0,0 +1,204 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <Arduino.h>
+#include <MQTT.h>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <algorithm>
+#include <chrono>
+#include <atomic>
+
+#include "sim.h"
+
+/* broker stand-in: inbound messages are queued by the simulation and handed out
+   by MQTTClient::loop(), outbound ones are counted and passed to a hook */
+static std::mutex broker_mutex;
+static std::deque<std::pair<String, String>> inbound;
+static std::list<MQTTClient *> clients;
+static bool broker_up = true;
+static sim_publish_hook_t publish_hook;
+static unsigned long published, wire_bytes;
+static const uint32_t connect_timeout_ms = 3000; /* WiFiClient::connect() to an unreachable host */
+static unsigned long connect_tries;
+static uint64_t back_ms = ~0ULL; /* broker up again at, until a client got through */
+static uint64_t reconnect_ms_max;
+static uint32_t wire_us; /* per publish */
+static std::atomic<uint32_t> stall_ms{0}; /* per publish, virtual */
+
+void sim_mqtt_inject(const char *topic, const char *payload)
+{
+    std::lock_guard<std::mutex> l(broker_mutex);
+    inbound.push_back(std::make_pair(String(topic), String(payload)));
+}
+
+void sim_mqtt_set_broker(int up)
+{
+    std::lock_guard<std::mutex> l(broker_mutex);
+    if (up && !broker_up)
+        back_ms = sim_now_ms();
+    broker_up = up;
+}
+
+void sim_mqtt_stats(unsigned long *tries, unsigned long *reconnect_max_ms)
+{
+    std::lock_guard<std::mutex> l(broker_mutex);
+    *tries = connect_tries;
+    *reconnect_max_ms = reconnect_ms_max;
+}
+
+void sim_mqtt_set_publish_hook(sim_publish_hook_t fn) { publish_hook = fn; }
+void sim_mqtt_set_wire_us(uint32_t us) { wire_us = us; }
+void sim_mqtt_set_stall(uint32_t ms) { stall_ms = ms; }
+unsigned long sim_mqtt_published(void) { return published; }
+unsigned long sim_mqtt_wire_bytes(void) { return wire_bytes; }
+
+static bool topic_match(const String &filter, const String &topic)
+{
+    if (filter.endsWith("#"))
+        return topic.startsWith(filter.substring(0, filter.length() - 1));
+    return filter == topic;
+}
+
+MQTTClient::MQTTClient(int buf_size)
+{
+    std::lock_guard<std::mutex> l(broker_mutex);
+    clients.push_back(this);
+}
+
+MQTTClient::~MQTTClient()
+{
+    std::lock_guard<std::mutex> l(broker_mutex);
+    clients.remove(this);
+}
+
+/* with the broker down the TCP connect runs into its timeout, the caller is stuck for that long */
+bool MQTTClient::connect(const char *id, const char *user, const char *pw, bool skip)
+{
+    bool up;
+    {
+        std::lock_guard<std::mutex> l(broker_mutex);
+        up = broker_up;
+        connect_tries++;
+    }
+    if (!up)
+        sim_busy(connect_timeout_ms);
+    std::lock_guard<std::mutex> l(broker_mutex);
+    conn = up && broker_up;
+    err = conn ? LWMQTT_SUCCESS : LWMQTT_NETWORK_FAILED_CONNECT;
+    if (conn && (back_ms != ~0ULL))
+    {
+        reconnect_ms_max = std::max(reconnect_ms_max, sim_now_ms() - back_ms);
+        back_ms = ~0ULL;
+    }
+    return conn;
+}
+
+bool MQTTClient::disconnect(void)
+{
+    conn = false;
+    return true;
+}
+
+bool MQTTClient::connected(void)
+{
+    std::lock_guard<std::mutex> l(broker_mutex);
+    if (!broker_up)
+        conn = false;
+    return conn;
+}
+
+bool MQTTClient::subscribe(const String &topic, int qos)
+{
+    subscriptions.push_back(topic);
+    return conn;
+}
+
+bool MQTTClient::publish(const String &topic, const String &payload, bool retained, int qos)
+{
+    return publish(topic.c_str(), payload.c_str(), retained, qos);
+}
+
+bool MQTTClient::publish(const char topic[], const char payload[], bool retained, int qos)
+{
+    return publish(topic, payload, strlen(payload), retained, qos);
+}
+
+/* host time spent on the wire, spun, so the caller sees it like a socket write; a stall blocks
+   the caller on the virtual clock */
+bool MQTTClient::publish(const char topic[], const char payload[], int length, bool retained, int qos)
+{
+    if (!connected())
+    {
+        err = LWMQTT_NETWORK_FAILED_CONNECT;
+        return false;
+    }
+    if (wire_us)
+    {
+        auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(wire_us);
+        while (std::chrono::steady_clock::now() < until)
+            ;
+    }
+    if (stall_ms)
+        sim_busy(stall_ms);
+    unsigned long rem = 2 + strlen(topic) + length + (qos ? 2 : 0); /* topic length, packet id */
+    wire_bytes += 1 + rem;
+    for (; rem; rem >>= 7) /* remaining length, 7 bits a byte */
+        wire_bytes++;
+    published++;
+    if (publish_hook)
+    {
+        char p[512]; /* terminated for the hook, no heap */
+        length = std::min(length, static_cast<int>(sizeof(p)) - 1);
+        memcpy(p, payload, length);
+        p[length] = '\0';
+        publish_hook(topic, p, length);
+    }
+    return true;
+}
+
+bool MQTTClient::sim_deliver(const String &topic, const String &payload)
+{
+    for (auto &f : subscriptions)
+    {
+        if (topic_match(f, topic))
+        {
+            String t(topic), p(payload);
+            if (cb)
+                cb(t, p);
+            return true;
+        }
+    }
+    return false;
+}
+
+/* hand out everything queued so far, the simulation runs a single client */
+bool MQTTClient::loop(void)
+{
+    if (!connected())
+        return false;
+    std::deque<std::pair<String, String>> msgs;
+    {
+        std::lock_guard<std::mutex> l(broker_mutex);
+        msgs.swap(inbound);
+    }
+    for (auto &m : msgs)
+        sim_deliver(m.first, m.second);
+    return true;
+}
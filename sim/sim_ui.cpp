@@ -0,0 +1,168 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* host replacement for setup-ui.cpp: lvgl renders into a display driver that drops the pixels,
+   the DMA transfer to the TFT is modeled, to size DISP_BUF_LINES without hardware */
+
+#include <chrono>
+#include <algorithm>
+#include "lvgl.h"
+
+#include "ui.h"
+#include "img_rle.h"
+#include "sim.h"
+
+static const int hor_res = 240, ver_res = 320;
+static lv_disp_buf_t disp_buf;
+static lv_color_t buf1[hor_res * LV_VER_RES_MAX];
+static lv_color_t buf2[hor_res * LV_VER_RES_MAX];
+static lv_disp_drv_t *dma_drv;
+static unsigned long flushed_px;
+static uiElements *the_ui;
+
+/* SPI model on a timeline of its own: host render time as measured (times cpu_scale, the host is
+   faster than an ESP32), the transfer as it would take at spi_hz, lvgl only waits for the bus when
+   a flush catches up with the previous one; nothing sleeps, so it doesn't slow the simulation down */
+static double spi_hz = 27e6; /* SPI_FREQUENCY, User_Setup.h */
+static double cpu_scale = 1;
+static double model_us, dma_end_us;
+static std::chrono::steady_clock::time_point mark = std::chrono::steady_clock::now();
+static unsigned long frames, frame_ms, frame_ms_max, frame_px;
+static double stall_us;
+
+static void model_advance(void)
+{
+    auto now = std::chrono::steady_clock::now();
+    model_us += std::chrono::duration<double, std::micro>(now - mark).count() * cpu_scale;
+    mark = now;
+}
+
+static void sim_disp_flush(lv_disp_drv_t *disp, const lv_area_t *area, lv_color_t *color_p)
+{
+    uint32_t px = (area->x2 - area->x1 + 1) * (area->y2 - area->y1 + 1);
+    flushed_px += px;
+    model_advance();
+    dma_end_us = std::max(model_us, dma_end_us) + px * 16 * 1e6 / spi_hz;
+    dma_drv = disp;
+}
+
+static void sim_disp_wait(lv_disp_drv_t *disp)
+{
+    model_advance();
+    if (dma_end_us > model_us)
+    {
+        stall_us += dma_end_us - model_us;
+        model_us = dma_end_us;
+    }
+    if (dma_drv)
+        lv_disp_flush_ready(dma_drv);
+    dma_drv = NULL;
+}
+
+static void sim_disp_monitor(lv_disp_drv_t *disp, uint32_t ms, uint32_t px)
+{
+    frames++;
+    frame_ms += ms;
+    frame_px += px;
+    frame_ms_max = std::max(frame_ms_max, static_cast<unsigned long>(ms));
+}
+
+void disp_stats(log_sink_fn sink, void *arg)
+{
+    char buf[128];
+    int n = snprintf(buf, sizeof(buf), "%lu frames, avg %lums, max %lums, %lukpx/frame, %lums stalled on SPI (modeled), %d lines x2",
+                     frames, frames ? frame_ms / frames : 0, frame_ms_max, frames ? frame_px / frames / 1000 : 0,
+                     static_cast<unsigned long>(stall_us / 1000), DISP_BUF_LINES);
+    sink(buf, n, arg);
+}
+
+/* full screen redraws per buffer height, single vs. double buffered: frame time is render
+   plus whatever of the transfer isn't hidden behind it, up to the last pixel on the wire */
+void sim_disp_bench(double hz, double cpu)
+{
+    static const int heights[] = {5, 10, 20, 40, 80, 160, 320};
+    const int rounds = 20;
+    if (hz > 0)
+        spi_hz = hz;
+    if (cpu > 0)
+        cpu_scale = cpu;
+    fprintf(stderr, "sim: display %dx%d, SPI %.0fMHz, full frame transfer %.1fms, render time x%.0f\n",
+            hor_res, ver_res, spi_hz / 1e6, hor_res * ver_res * 16 * 1e3 / spi_hz, cpu_scale);
+    fprintf(stderr, "sim: lines  buffers  kB  frame ms  stalled ms\n");
+    for (int lines : heights)
+        for (int n = 1; n <= 2; n++)
+        {
+            lv_disp_buf_init(&disp_buf, buf1, (n == 2) ? buf2 : NULL, hor_res * lines);
+            double t = 0, stall = stall_us;
+            for (int r = 0; r < rounds; r++)
+            {
+                model_advance();
+                double start = std::max(model_us, dma_end_us);
+                lv_obj_invalidate(lv_scr_act());
+                lv_refr_now(NULL);
+                sim_disp_wait(dma_drv);
+                t += model_us - start;
+            }
+            fprintf(stderr, "sim: %5d  %7d  %3d  %8.2f  %10.2f\n", lines, n,
+                    static_cast<int>(n * lines * hor_res * sizeof(lv_color_t) / 1024),
+                    t / rounds / 1e3, (stall_us - stall) / rounds / 1e3);
+        }
+    lv_disp_buf_init(&disp_buf, buf1, buf2, hor_res * DISP_BUF_LINES);
+}
+
+static bool sim_touchpad_read(lv_indev_drv_t *indev_driver, lv_indev_data_t *data)
+{
+    data->state = LV_INDEV_STATE_REL;
+    return false;
+}
+
+uiElements *setup_ui(const int ui_ss_timeout)
+{
+    pinMode(TFT_LED, OUTPUT);
+    digitalWrite(TFT_LED, LOW);
+
+    lv_init();
+    img_rle_init();
+    lv_disp_buf_init(&disp_buf, buf1, buf2, hor_res * DISP_BUF_LINES);
+
+    lv_disp_drv_t disp_drv;
+    lv_disp_drv_init(&disp_drv);
+    disp_drv.hor_res = hor_res;
+    disp_drv.ver_res = ver_res;
+    disp_drv.flush_cb = sim_disp_flush;
+    disp_drv.wait_cb = sim_disp_wait;
+    disp_drv.monitor_cb = sim_disp_monitor;
+    disp_drv.buffer = &disp_buf;
+    lv_disp_drv_register(&disp_drv);
+
+    lv_indev_drv_t indev_drv;
+    lv_indev_drv_init(&indev_drv);
+    indev_drv.type = LV_INDEV_TYPE_POINTER;
+    indev_drv.read_cb = sim_touchpad_read;
+    lv_indev_drv_register(&indev_drv);
+
+    lv_task_enable(true);
+
+    the_ui = new uiElements(ui_ss_timeout);
+    log_msg("GUI Setup finished (simulated display).");
+    return the_ui;
+}
+
+uiElements *sim_ui_elements(void) { return the_ui; }
+
+unsigned long sim_flushed_pixels(void) { return flushed_px; }
@@ -0,0 +1,197 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include "acq.h"
+#include "io.h"
+
+/* one sensor on the wheel: a round (one period) may take several acquire() calls,
+   e.g. start a conversion, read it back later */
+typedef struct
+{
+    periodicSensor *sens;
+    unsigned long period;
+    unsigned long round;    /* millis() the next round is due */
+    unsigned long deadline; /* millis() the next acquire() is due */
+    bool in_round;
+    uint32_t overruns; /* rounds skipped, the sensor couldn't keep up with its period */
+    acqHist jitter;    /* round start - due time */
+    acqHist duration;  /* acquire() run time */
+} acq_slot_t;
+
+static const long acq_idle_ms = 1000; /* max. sleep, picks up sensors registered meanwhile */
+
+static acq_slot_t slots[ACQ_MAX_SENSORS];
+static acq_slot_t *wheel[ACQ_MAX_SENSORS]; /* binary heap, the earliest deadline first */
+static int no_slots, no_wheel;
+static SemaphoreHandle_t acq_mutex;
+static SemaphoreHandle_t acq_wake; /* given by acq_register(), the task waits for a first sensor */
+static QueueHandle_t acq_queue;
+static unsigned long dropped; /* readings lost to a full queue */
+
+/* heap order, wrap safe: a is due after b */
+static bool later(const acq_slot_t *a, const acq_slot_t *b)
+{
+    return static_cast<long>(a->deadline - b->deadline) > 0;
+}
+
+static void acq_run(acq_slot_t *s)
+{
+    unsigned long t = micros();
+    bool start = !s->in_round;
+    unsigned long next = s->sens->acquire();
+    unsigned long now = millis();
+    P(acq_mutex);
+    if (start)
+        s->jitter.add(t - s->round * 1000UL);
+    s->duration.add(micros() - t);
+    s->in_round = (next != 0);
+    if (s->in_round)
+        s->deadline = now + next;
+    else
+    {
+        s->round += s->period; /* on the grid, no drift */
+        if (static_cast<long>(now - s->round) >= 0)
+        {
+            s->overruns++;
+            s->round = now + s->period;
+        }
+        s->deadline = s->round;
+    }
+    wheel[no_wheel++] = s;
+    std::push_heap(wheel, wheel + no_wheel, later);
+    V(acq_mutex);
+}
+
+static void acq_task(void *arg)
+{
+    for (;;)
+    {
+        acq_slot_t *s = nullptr;
+        long wait;
+        P(acq_wake); /* nothing to do before the first sensor */
+        V(acq_wake);
+        P(acq_mutex);
+        wait = std::min(acq_idle_ms, static_cast<long>(wheel[0]->deadline - millis()));
+        if (wait <= 0)
+        {
+            std::pop_heap(wheel, wheel + no_wheel, later);
+            s = wheel[--no_wheel];
+        }
+        V(acq_mutex);
+        if (s)
+            acq_run(s);
+        else
+            vTaskDelay(pdMS_TO_TICKS(wait));
+    }
+}
+
+/* ui thread, lv_task_handler() */
+static void acq_drain(lv_task_t *t)
+{
+    acq_result_t r;
+    while (xQueueReceive(acq_queue, &r, 0) == pdTRUE)
+        r.sens->deliver(r);
+}
+
+void setup_acq(UBaseType_t prio, BaseType_t core)
+{
+    acq_mutex = xSemaphoreCreateMutex();
+    V(acq_mutex);
+    acq_wake = xSemaphoreCreateMutex();
+    P(acq_wake); /* until the first sensor is registered, by this task as well */
+    acq_queue = xQueueCreate(ACQ_QUEUE_LEN, sizeof(acq_result_t));
+    lv_task_create(acq_drain, 0, LV_TASK_PRIO_MID, nullptr);
+    TaskHandle_t handle;
+    xTaskCreatePinnedToCore(acq_task, "sensor-acq", 4000, nullptr, prio, &handle, core);
+}
+
+void acq_register(periodicSensor *s, unsigned long period)
+{
+    if (!acq_mutex || (no_slots >= ACQ_MAX_SENSORS))
+    {
+        log_msg("can't schedule sensor " + s->get_name());
+        return;
+    }
+    P(acq_mutex);
+    acq_slot_t *slot = &slots[no_slots++];
+    slot->sens = s;
+    slot->period = period;
+    slot->round = slot->deadline = millis() + period;
+    wheel[no_wheel++] = slot;
+    std::push_heap(wheel, wheel + no_wheel, later);
+    V(acq_mutex);
+    if (no_slots == 1)
+        V(acq_wake);
+}
+
+void acq_post(const acq_result_t &r)
+{
+    if (xQueueSend(acq_queue, &r, 0) != pdTRUE)
+        dropped++;
+}
+
+uint32_t acqHist::percentile(int p) const
+{
+    uint32_t total = 0, sum = 0;
+    for (int b = 0; b < buckets; b++)
+        total += cnt[b];
+    for (int b = 0; b < buckets; b++)
+    {
+        sum += cnt[b];
+        if (sum * 100ULL >= total * static_cast<unsigned long long>(p))
+            return (b < buckets - 1) ? (64UL << b) : max_us;
+    }
+    return 0;
+}
+
+String acqHist::to_string(void) const
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "p50<%.1fms p99<%.1fms max %.1fms",
+             percentile(50) / 1000.0, percentile(99) / 1000.0, max_us / 1000.0);
+    return String(buf);
+}
+
+void acq_stats(log_sink_fn sink, void *arg)
+{
+    char buf[192];
+    if (!acq_mutex)
+        return;
+    for (int i = 0;; i++)
+    {
+        P(acq_mutex);
+        if (i >= no_slots)
+        {
+            V(acq_mutex);
+            break;
+        }
+        acq_slot_t sl = slots[i]; /* a copy, the sink may block on the network */
+        V(acq_mutex);
+        uint32_t rounds = 0;
+        for (int b = 0; b < acqHist::buckets; b++)
+            rounds += sl.jitter.count(b);
+        int n = snprintf(buf, sizeof(buf), "%s: %lu rounds/%lums, late %s, read %s, %lu overruns\n",
+                         sl.sens->get_name().c_str(), static_cast<unsigned long>(rounds), sl.period,
+                         sl.jitter.to_string().c_str(), sl.duration.to_string().c_str(),
+                         static_cast<unsigned long>(sl.overruns));
+        sink(buf, std::min(n, static_cast<int>(sizeof(buf)) - 1), arg);
+    }
+    int n = snprintf(buf, sizeof(buf), "%lu readings dropped\n", dropped);
+    sink(buf, n, arg);
+}
@@ -0,0 +1,84 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __acq_h__
+#define __acq_h__
+
+#include <Arduino.h>
+#include <WString.h>
+#include "logger.h"
+
+/* sensor acquisition: a FreeRTOS task of its own reads the periodic sensors in deadline order,
+   the readings go through a queue to the ui thread, which publishes them, updates the display
+   and evaluates the circuits - so sampling doesn't wait for rendering and vice versa */
+
+class periodicSensor;
+
+/* one reading, from the acquisition task to the ui thread */
+typedef struct
+{
+    periodicSensor *sens;
+    float val;
+    float hum;        /* multi property sensors, NAN otherwise */
+    unsigned long ts; /* millis() of the reading */
+    uint8_t idx;      /* reading idx of n taken in one round, e.g. DS18B20 on one bus */
+    uint8_t n;
+    bool error;
+} acq_result_t;
+
+/* log2 histogram of microseconds: [0, 64us), [64us, 128us), ... [~1s, inf) */
+class acqHist
+{
+public:
+    static const int buckets = 16;
+
+private:
+    uint32_t cnt[buckets] = {};
+    uint32_t max_us = 0;
+
+public:
+    void add(uint32_t us)
+    {
+        int b = 0;
+        for (uint32_t v = us >> 6; v && (b < buckets - 1); v >>= 1)
+            b++;
+        cnt[b]++;
+        if (us > max_us)
+            max_us = us;
+    }
+    uint32_t count(int b) const { return cnt[b]; }
+    uint32_t max(void) const { return max_us; }
+    /* upper bound of the bucket holding the p-th percentile */
+    uint32_t percentile(int p) const;
+    String to_string(void) const;
+};
+
+#define ACQ_MAX_SENSORS 16
+#define ACQ_QUEUE_LEN 16
+
+/* create the queue, its consumer (an lv_task) and the acquisition task, before any periodicSensor;
+   core: tskNO_AFFINITY or the core to pin the task to */
+void setup_acq(UBaseType_t prio, BaseType_t core = tskNO_AFFINITY);
+/* add a sensor to the wheel, first due one period from now */
+void acq_register(periodicSensor *s, unsigned long period);
+/* acquisition task: hand a reading over to the ui thread, never blocks */
+void acq_post(const acq_result_t &r);
+/* per sensor jitter (start - deadline) and read duration, one line each, written to sink */
+void acq_stats(log_sink_fn sink, void *arg);
+
+#endif
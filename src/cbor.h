@@ -0,0 +1,108 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __cbor_h__
+#define __cbor_h__
+
+#include <stdint.h>
+#include <string.h>
+
+/* minimal CBOR (RFC 8949) encoder into a caller's buffer, no heap: unsigned and negative integers,
+   text, arrays and maps of known size, floats, true/false/null - shortest head for every item.
+   Writing past the end sets overflow and drops the rest, size() is 0 then */
+class cborWriter
+{
+    uint8_t *const buf;
+    const size_t cap;
+    size_t len = 0;
+    bool overflow = false;
+
+    void byte(uint8_t b)
+    {
+        if (len < cap)
+            buf[len++] = b;
+        else
+            overflow = true;
+    }
+    void be(uint32_t v, int n) /* n bytes, big endian */
+    {
+        while (n--)
+            byte(v >> (8 * n));
+    }
+    void head(uint8_t major, uint32_t v)
+    {
+        major <<= 5;
+        if (v < 24)
+            byte(major | v);
+        else if (v <= 0xff)
+        {
+            byte(major | 24);
+            be(v, 1);
+        }
+        else if (v <= 0xffff)
+        {
+            byte(major | 25);
+            be(v, 2);
+        }
+        else
+        {
+            byte(major | 26);
+            be(v, 4);
+        }
+    }
+
+public:
+    cborWriter(uint8_t *b, size_t n) : buf(b), cap(n) {}
+
+    void put_uint(uint32_t v) { head(0, v); }
+    void put_int(int32_t v)
+    {
+        if (v < 0)
+            head(1, static_cast<uint32_t>(-1 - v));
+        else
+            head(0, v);
+    }
+    void put_text(const char *s, size_t n)
+    {
+        head(3, n);
+        if (len + n > cap)
+        {
+            overflow = true;
+            return;
+        }
+        memcpy(buf + len, s, n);
+        len += n;
+    }
+    void put_text(const char *s) { put_text(s, strlen(s)); }
+    void put_array(uint32_t n) { head(4, n); }
+    void put_map(uint32_t pairs) { head(5, pairs); }
+    void put_float(float f)
+    {
+        uint32_t v;
+        memcpy(&v, &f, sizeof(v));
+        byte(0xfa);
+        be(v, 4);
+    }
+    void put_bool(bool b) { byte(b ? 0xf5 : 0xf4); }
+    void put_null(void) { byte(0xf6); }
+
+    bool ok(void) const { return !overflow; }
+    size_t size(void) const { return overflow ? 0 : len; }
+};
+
+#endif
@@ -22,17 +22,96 @@
 #include "ui.h"
 #include "io.h"
 #include "wifi.h"
+#include "pid.h"
+#include "schedule.h"
 
 class genCircuit
 {
 protected:
     const String circuit_name;
 
+    /* circuit log entries are stored binary, text is only built when the log is read */
+    typedef enum
+    {
+        EV_IDLE,      /* in range, nothing to do */
+        EV_SWITCH,    /* out of range, switched */
+        EV_FORCE_ON,  /* pure time switch on duty */
+        EV_OFF_DUTY,  /* switched off outside duty cycle */
+        EV_IO_SET,    /* set explicitly (mqtt, fallback) */
+        EV_DUTY       /* PID output, state in % */
+    } log_event_t;
+    typedef struct
+    {
+        genCircuit *circuit;
+        uint8_t event;
+        uint8_t day;   /* range used: day or night */
+        uint8_t state; /* io state */
+        float val, lo, hi;
+    } log_rec_t;
+
+    static size_t log_format(const void *rec, char *buf, size_t len)
+    {
+        const log_rec_t *r = static_cast<const log_rec_t *>(rec);
+        const char *n = r->circuit->get_name().c_str();
+        const char *d = r->day ? "day" : "night";
+        int res = 0;
+        switch (r->event)
+        {
+        case EV_IDLE:
+            res = snprintf(buf, len, "%s: %s[%.2f-%.2f]: val=%.2f...nothing to do.", n, d, r->lo, r->hi, r->val);
+            break;
+        case EV_SWITCH:
+            res = snprintf(buf, len, "%s: %s[%.2f-%.2f]: val=%.2f...switching %s", n, d, r->lo, r->hi, r->val, (r->state == HIGH) ? "on" : "off");
+            break;
+        case EV_FORCE_ON:
+            res = snprintf(buf, len, "%s[%.2f-%.2f] switching on - %d", n, r->lo, r->hi, r->state);
+            break;
+        case EV_OFF_DUTY:
+            res = snprintf(buf, len, "%s - not on duty, switching off", n);
+            break;
+        case EV_IO_SET:
+            res = snprintf(buf, len, "Circuit %s sets IO to %d", n, r->state);
+            break;
+        case EV_DUTY:
+            res = snprintf(buf, len, "%s: %s[%.2f-%.2f]: val=%.2f...duty %d%%", n, d, r->lo, r->hi, r->val, r->state);
+            break;
+        }
+        return (res > 0) ? res : 0;
+    }
+    /* on-time: the span since the last mark ran in the state recorded then, on in [0, 1] for PWM */
+    myRollup on_time;
+    time_t io_since = 0;
+    float io_on = 0;
+    void mark_io(float on)
+    {
+        time_t now = time(nullptr);
+        if (io_since)
+            on_time.add_span(io_since, now, io_on);
+        io_since = now;
+        io_on = on;
+    }
+
+    void log_circuit(log_event_t ev, uint8_t state, bool day = false, float val = 0, myRange<float> *range = nullptr)
+    {
+        log_rec_t r{this, static_cast<uint8_t>(ev), day, state, val,
+                    range ? range->get_lbound() : 0, range ? range->get_ubound() : 0};
+        log_rec(log_format, &r, sizeof(r), myLogger::LOG_CIRCUIT);
+    }
+
 public:
-    genCircuit(const String &n) : circuit_name(n) {}
+    genCircuit(const String &n) : circuit_name(n), on_time(n, true) {}
     ~genCircuit() = default;
 
     inline const String &get_name(void) { return circuit_name; }
+    const myRollup &get_on_time(void) const { return on_time; }
+    /* the output as last marked, on in [0, 1] */
+    float get_output(void) const { return io_on; }
+    virtual void update(void) = 0;
+    static unsigned long &evaluations(void) /* all circuits, statistics */
+    {
+        static unsigned long n = 0;
+        return n;
+    }
     virtual void io_set(uint8_t v, bool ign_inverse = false, bool update_button = false) = 0;
     virtual myRange<float> &get_range(bool) = 0;
 };
@@ -46,15 +125,103 @@ class myCircuit : public genCircuit
     Sensor &sensor;
     ioSwitch &io;
     myRange<struct tm> duty_cycle;
+    mySchedule duty_sched{duty_cycle}; /* follow the ui spinboxes */
+    mySchedule day_sched{def_day};
     myRange<float> range_day;
     myRange<float> range_night;
     float period;
     circuit_fb_func_t fb_mode_func;
     bool fb_mode = false;
     lv_task_t *circuit_task;
+    lv_task_t *edge_task = nullptr; /* one shot at the next duty cycle or day/night edge */
     button_label_c *button;
     slider_label_c *slider_day, *slider_night;
 
+    /* PID mode: the output is a duty cycle, PWM if the io can, else a relay switched on for
+       duty * tp_window at the start of each window (pulses shorter than tp_window / 20 skipped) */
+    myPID *pid = nullptr;
+    bool pid_on = false; /* the last update() ran the PID, not fallback/off duty */
+    bool pwm = false;
+    float duty = 0;
+    unsigned long pid_last;
+    lv_task_t *tp_task = nullptr;
+    unsigned long tp_window, tp_start, tp_on;
+    uint8_t tp_level;
+
+    /* sleep until the next edge instead of catching it with the watchdog poll up to a period late */
+    void arm_edge(const time_snapshot_t &now)
+    {
+        int32_t a = duty_sched.next(now), b = day_sched.next(now);
+        int32_t ahead = (a < 0) ? b : ((b < 0) ? a : std::min(a, b));
+        if (!edge_task)
+            return;
+        if (!now.valid || (ahead < 0))
+        {
+            lv_task_set_prio(edge_task, LV_TASK_PRIO_OFF);
+            return;
+        }
+        lv_task_set_period(edge_task, ahead * 1000);
+        lv_task_reset(edge_task);
+        lv_task_set_prio(edge_task, LV_TASK_PRIO_LOW);
+    }
+
+    void io_write(uint8_t v, bool ign_invers = false)
+    {
+        io.set(v, ign_invers);
+        mark_io(io.state() != LOW); /* as the button shows it */
+    }
+
+    static void tp_wrapper(lv_task_t *t)
+    {
+        static_cast<myCircuit<Sensor> *>(t->user_data)->tp_run();
+    }
+    void tp_run(void)
+    {
+        unsigned long now = millis();
+        if (!pid_on || ui->check_manual())
+            return;
+        if (now - tp_start >= tp_window)
+        {
+            tp_start = now;
+            tp_on = duty * tp_window;
+            if (tp_on < tp_window / 20)
+                tp_on = 0;
+            else if (tp_on > tp_window - tp_window / 20)
+                tp_on = tp_window;
+        }
+        uint8_t v = (now - tp_start < tp_on) ? HIGH : LOW;
+        if (v == tp_level)
+            return;
+        tp_level = v;
+        io_write(v);
+        button->set(io.state());
+    }
+
+    /* on duty, sensor fine: setpoint is the middle of the range; cont: the previous update() ran it too */
+    void run_pid(float v, myRange<float> &range, bool day, bool cont)
+    {
+        unsigned long now = millis();
+        float dt = cont ? (now - pid_last) / 1000.0 : 0;
+        if (!cont)
+        {
+            pid->reset();
+            tp_start = now - tp_window; /* new window right away */
+            tp_level = 0xff;
+        }
+        pid_on = true;
+        pid_last = now;
+        duty = pid->update((range.get_lbound() + range.get_ubound()) / 2, v, dt);
+        log_circuit(EV_DUTY, static_cast<uint8_t>(lroundf(duty * 100)), day, v, &range);
+        if (pwm)
+        {
+            io.set_duty(duty);
+            mark_io(duty);
+        }
+        else
+            tp_run();
+        button->set(io.state());
+    }
+
 public:
     myCircuit(uiElements *ui, const String &n, Sensor &s, ioSwitch &i, float p, myRange<float> rday, myRange<float> rnight, myRange<float> dr, circuit_fb_func_t fb_func = nullptr, myRange<struct tm> dc = {{0, 0, 0}, {0, 0, 24}})
         : genCircuit(n), ui(ui), sensor(s), io(i), duty_cycle(dc), range_day(rday), range_night(rnight), period(p), fb_mode_func(fb_func)
@@ -72,8 +239,12 @@ public:
             ui->add2ui(UI_CFG1, (new rangeSpinbox<myRange<struct tm>>(ui, UI_CFG1, n.c_str(), duty_cycle, 230, 72))->get_area());
         }
         mqtt_register_circuit(this);
+        telemetry_add(this);
+        sensor.add_circuit(this); /* evaluate on every new reading... */
+        /* ...at duty cycle/day boundaries, and poll slowly for the fallback timeout */
         circuit_task = lv_task_create(myCircuit::update_circuit, static_cast<uint32_t>(period * 1000), LV_TASK_PRIO_LOW, this);
-        if (!circuit_task)
+        edge_task = lv_task_create(myCircuit::update_circuit, 1000, LV_TASK_PRIO_OFF, this);
+        if (!circuit_task || !edge_task)
         {
             log_msg(circuit_name + ": task create failed.");
         }
@@ -85,14 +256,29 @@ public:
     ~myCircuit() = default;
 
     inline myRange<float> &get_range(bool day = true) override { return day ? range_day : range_night; }
+    /* more windows on top of the ui range, e.g. weekdays only, over midnight */
+    inline mySchedule &get_duty(void) { return duty_sched; }
     void io_set(uint8_t v, bool ign_invers = false, bool update_button = false) override
     {
-        log_msg("Circuit " + get_name() + " sets IO to " + String(v), myLogger::LOG_CIRCUIT);
-        io.set(v, ign_invers);
+        log_circuit(EV_IO_SET, v);
+        io_write(v, ign_invers);
         if (update_button)
             button->set(io.state());
     }
 
+    /* PID instead of the hysteresis: kp in 1/K (duty per K of error), ti, td in s;
+       window_s: time proportioning period for on/off outputs */
+    void set_pid(float kp, float ti, float td, unsigned long window_s = 900)
+    {
+        pid = new myPID(kp, ti, td);
+        tp_window = window_s * 1000;
+        pwm = io.set_duty(0);
+        if (!pwm && !tp_task)
+            tp_task = lv_task_create(myCircuit::tp_wrapper, 1000, LV_TASK_PRIO_LOW, this);
+        log_msg(circuit_name + ": PID kp=" + String(kp) + " ti=" + String(ti, 0) + "s td=" + String(td, 0) + "s" +
+                (tp_task ? ", window " + String(window_s) + "s" : String(", PWM")));
+    }
+
     void set_fallback_mode(bool m)
     {
         fb_mode = m;
@@ -106,35 +292,42 @@ public:
         c->update();
     }
 
-    void update(void)
+    void update(void) override
     {
+        evaluations()++;
+        bool pid_was = pid_on;
+        pid_on = false; /* until run_pid() says otherwise */
+        mark_io(pwm ? io_on : (io.state() != LOW)); /* credit the span so far, the guard may have switched since */
+        time_snapshot_t t = time_obj->now();
+        arm_edge(t);
         if (ui->check_manual())
             return; /* don't do anything in manual mode */
-        struct tm t;
         //log_msg(circuit_name + " - update...");
         //log_msg(this->to_string());
-        if (!time_obj->get_time(&t))
+        if (!t.valid)
         {
             ui->log_event((circuit_name + "Failed to obtain time").c_str());
             set_fallback_mode(true);
             return;
         }
-        if (duty_cycle.is_in(t))
+        if (duty_sched.is_on(t))
         {
-            myRange<float> &range = get_range(def_day.is_in(t));
+            bool day = day_sched.is_on(t);
+            myRange<float> &range = get_range(day);
             /* we're on duty */
             if (sensor.get_type() == JUST_SWITCH)
             {
-                log_msg(circuit_name + range.to_string() + " switching on - " + String(io.state()), myLogger::LOG_CIRCUIT);
-                io.set(HIGH, true); // force switching on
+                log_circuit(EV_FORCE_ON, io.state(), day, 0, &range);
+                io_write(HIGH, true); // force switching on
                 button->set(io.state());
                 set_fallback_mode(false);
                 return;
             }
             float v1 = sensor.get_data();
-            if (isnan(v1))
+            if (isnan(v1) || sensor.stale())
             {
-                ui->log_event(String(get_name() + ": sens fail-fallback mode.").c_str(), myLogger::LOG_CIRCUIT);
+                ui->log_event(String(get_name() + (isnan(v1) ? ": sens fail-fallback mode." : ": sens stale-fallback mode.")).c_str(),
+                              myLogger::LOG_CIRCUIT);
                 set_fallback_mode(true);
                 return;
             }
@@ -142,26 +335,28 @@ public:
             {
                 set_fallback_mode(false);
             }
+            if (pid)
+            {
+                run_pid(v1, range, day, pid_was);
+                return;
+            }
             if (range.is_in(v1))
             {
-                log_msg(circuit_name + ": " + (def_day.is_in(t) ? "day" : "night") +
-                        range.to_string() + ": val=" + String(v1) + "...nothing to do.", myLogger::LOG_CIRCUIT);
+                log_circuit(EV_IDLE, io.state(), day, v1, &range);
                 //                io.toggle();
                 button->set(io.state());
                 return;
             }
             if (range.is_below(v1))
             {
-                io.set(HIGH);
-                log_msg(circuit_name + ": " + (def_day.is_in(t) ? "day" : "night") +
-                        range.to_string() + ": val=" + String(v1) + "...switching " + io.to_string(), myLogger::LOG_CIRCUIT);
+                io_write(HIGH);
+                log_circuit(EV_SWITCH, io.state(), day, v1, &range);
                 button->set(io.state());
             }
             if (range.is_above(v1))
             {
-                io.set(LOW);
-                log_msg(circuit_name + ": " + (def_day.is_in(t) ? "day" : "night") +
-                        range.to_string() + ": val=" + String(v1) + "...switching " + io.to_string(), myLogger::LOG_CIRCUIT);
+                io_write(LOW);
+                log_circuit(EV_SWITCH, io.state(), day, v1, &range);
                 button->set(io.state());
             }
         }
@@ -169,16 +364,16 @@ public:
         {
             io_set(LOW, true); // force off if circuit is not on duty
             button->set(io.state());
-            log_msg(circuit_name + " - not on duty, switching off", myLogger::LOG_CIRCUIT);
+            log_circuit(EV_OFF_DUTY, io.state());
         }
     }
 
     inline String to_string(void)
     {
-        return circuit_name + ": duty" + duty_cycle.to_string() +
+        return circuit_name + ": duty" + duty_sched.to_string() +
                ", range_day" + range_day.to_string() +
                ", range_night" + range_night.to_string() +
-               ", cycle: " + period + "s" +
+               ", watchdog: " + period + "s" +
                (io.is_invers() ? ", invers logic" : "");
     }
 };
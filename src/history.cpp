@@ -0,0 +1,490 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <LittleFS.h>
+#include <algorithm>
+#include "history.h"
+#include "io.h"
+#include "wifi.h"
+
+static const size_t hdr_size = 10; /* blk_hdr_t on flash, little endian, no padding */
+static const uint16_t in_ram = 0xffff;
+static myHistory *history;
+
+static void put_hdr(uint8_t *p, const myHistory::blk_hdr_t &h)
+{
+    p[0] = h.t0;
+    p[1] = h.t0 >> 8;
+    p[2] = h.t0 >> 16;
+    p[3] = h.t0 >> 24;
+    p[4] = h.count;
+    p[5] = h.count >> 8;
+    p[6] = h.id;
+    p[7] = h.id >> 8;
+    p[8] = h.len;
+    p[9] = h.bits;
+}
+
+static void get_hdr(const uint8_t *p, myHistory::blk_hdr_t &h)
+{
+    h.t0 = p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    h.count = p[4] | (p[5] << 8);
+    h.id = p[6] | (p[7] << 8);
+    h.len = p[8];
+    h.bits = p[9];
+}
+
+static inline uint32_t zigzag(int32_t d) { return (static_cast<uint32_t>(d) << 1) ^ static_cast<uint32_t>(d >> 31); }
+static inline int32_t unzigzag(uint32_t z) { return static_cast<int32_t>(z >> 1) ^ -static_cast<int32_t>(z & 1); }
+
+/* MSB first bit reader over one block */
+class bitReader
+{
+    const uint8_t *p;
+    size_t pos = 0;
+
+public:
+    bitReader(const uint8_t *data) : p(data) {}
+    uint32_t get(int n)
+    {
+        uint32_t v = 0;
+        while (n--)
+        {
+            v = (v << 1) | ((p[pos >> 3] >> (7 - (pos & 7))) & 1);
+            pos++;
+        }
+        return v;
+    }
+    /* next value, prev updated */
+    void value(int32_t &prev)
+    {
+        if (!get(1))
+            return;
+        if (!get(1))
+            prev += unzigzag(get(1) + 1);
+        else if (!get(1))
+            prev += unzigzag(get(3) + 3);
+        else if (!get(1))
+            prev += unzigzag(get(8) + 11);
+        else
+            prev = static_cast<int32_t>(get(32));
+    }
+};
+
+uint16_t myHistory::hash(const String &s)
+{
+    uint16_t h = 0xffff; /* crc16-ccitt */
+    for (size_t i = 0; i < s.length(); i++)
+    {
+        h ^= static_cast<uint8_t>(s[i]) << 8;
+        for (int b = 0; b < 8; b++)
+            h = (h & 0x8000) ? (h << 1) ^ 0x1021 : (h << 1);
+    }
+    return h;
+}
+
+String myHistory::seg_path(uint16_t nr)
+{
+    char buf[16];
+    snprintf(buf, sizeof(buf), "/h%05u.ts", nr);
+    return String(buf);
+}
+
+myHistory::myHistory(size_t b, unsigned interval_s, unsigned long f)
+    : budget(b), interval(interval_s), flush_ms(f)
+{
+    seg = static_cast<uint8_t *>(malloc(seg_size));
+    mutex = xSemaphoreCreateMutex();
+    V(mutex);
+    last_flush = millis();
+}
+
+myHistory::track_t *myHistory::find(const String &name)
+{
+    for (auto &t : tracks)
+        if (t.name == name)
+            return &t;
+    return nullptr;
+}
+
+void myHistory::add(genSensor *s)
+{
+    add(s->get_name());
+    tracks.back().sens = s;
+}
+
+void myHistory::add(const String &name)
+{
+    track_t t;
+    t.sens = nullptr;
+    t.name = name;
+    t.id = hash(t.name);
+    for (auto &o : tracks)
+        if (o.id == t.id)
+            log_msg("history: " + t.name + " collides with " + o.name + ", rename one.");
+    t.hdr.count = 0;
+    t.nbits = 0;
+    t.last = 0;
+    t.next_t = 0;
+    tracks.push_back(t);
+}
+
+bool myHistory::begin(void)
+{
+    if (!seg || !LittleFS.begin(true))
+    {
+        log_msg("history: no file system, not recording.");
+        return false;
+    }
+    mounted = true;
+    P(mutex);
+    load();
+    V(mutex);
+    log_msg("history: " + stats());
+    return true;
+}
+
+/* rebuild the index from the segment headers, the newest segment becomes the current one */
+void myHistory::load(void)
+{
+    std::vector<uint16_t> nrs;
+    File root = LittleFS.open("/");
+    for (File f = root.openNextFile(); f; f = root.openNextFile())
+    {
+        const char *n = f.name();
+        unsigned nr;
+        if (*n == '/')
+            n++;
+        if (sscanf(n, "h%05u.ts", &nr) == 1)
+            nrs.push_back(nr);
+    }
+    if (nrs.empty())
+        return;
+    std::sort(nrs.begin(), nrs.end());
+    first_seg = nrs.front();
+    seg_nr = nrs.back();
+    for (uint16_t nr : nrs)
+    {
+        File f = LittleFS.open(seg_path(nr), "r");
+        size_t size = f ? f.read(seg, seg_size) : 0;
+        f.close();
+        for (size_t pos = 0; pos + hdr_size <= size;)
+        {
+            blk_hdr_t h;
+            get_hdr(seg + pos, h);
+            if (pos + hdr_size + h.len > size)
+                break; /* torn write */
+            for (auto &t : tracks)
+                if (t.id == h.id)
+                    t.blocks.push_back(blk_ref_t{h.t0, h.t0 + h.count * interval, nr, static_cast<uint16_t>(pos)});
+            pos += hdr_size + h.len;
+        }
+        seg_fill = size; /* the last one read stays in the buffer */
+    }
+}
+
+void myHistory::put_bits(track_t &t, uint32_t v, int n)
+{
+    while (n--)
+    {
+        uint8_t &b = t.buf[t.nbits >> 3];
+        if (!(t.nbits & 7))
+            b = 0;
+        b |= ((v >> n) & 1) << (7 - (t.nbits & 7));
+        t.nbits++;
+    }
+}
+
+/* move the open block into the current segment */
+void myHistory::close_block(track_t &t)
+{
+    if (!t.hdr.count)
+        return;
+    t.hdr.len = (t.nbits + 7) / 8;
+    t.hdr.bits = t.nbits & 7;
+    size_t need = hdr_size + t.hdr.len;
+    if (seg_fill + need > seg_size)
+        new_seg();
+    put_hdr(seg + seg_fill, t.hdr);
+    memcpy(seg + seg_fill + hdr_size, t.buf, t.hdr.len);
+    blk_ref_t &r = t.blocks.back();
+    r.seg = seg_nr;
+    r.pos = seg_fill;
+    seg_fill += need;
+    encoded += need;
+    seg_dirty = true;
+    t.hdr.count = 0;
+    t.nbits = 0;
+}
+
+/* current segment to flash: closed blocks, and copies of the open ones that fit if open_too */
+void myHistory::write_seg(bool open_too)
+{
+    if (!mounted)
+        return;
+    File f = LittleFS.open(seg_path(seg_nr), "w");
+    if (!f)
+    {
+        log_msg("history: can't write " + seg_path(seg_nr));
+        return;
+    }
+    size_t size = f.write(seg, seg_fill);
+    for (auto &t : tracks)
+    {
+        if (!open_too || !t.hdr.count || (size + hdr_size + (t.nbits + 7) / 8 > seg_size))
+            continue;
+        uint8_t h[hdr_size];
+        blk_hdr_t th = t.hdr;
+        th.len = (t.nbits + 7) / 8;
+        th.bits = t.nbits & 7;
+        put_hdr(h, th);
+        size += f.write(h, hdr_size);
+        size += f.write(t.buf, th.len);
+    }
+    f.close();
+    seg_writes++;
+    seg_bytes += size;
+    seg_dirty = false;
+}
+
+/* the current segment is full: final write, start the next one, drop the oldest if over budget */
+void myHistory::new_seg(void)
+{
+    write_seg(false); /* the open blocks are going to end up in the next one */
+    seg_nr++;
+    seg_fill = 0;
+    while (mounted && ((seg_nr - first_seg + 1) * seg_size > budget))
+    {
+        LittleFS.remove(seg_path(first_seg));
+        for (auto &t : tracks)
+        {
+            auto e = std::find_if(t.blocks.begin(), t.blocks.end(),
+                                  [&](const blk_ref_t &r) { return r.seg != first_seg; });
+            t.blocks.erase(t.blocks.begin(), e);
+        }
+        first_seg++;
+    }
+}
+
+void myHistory::append(size_t i, time_t now, float v)
+{
+    P(mutex);
+    put(tracks[i], now, v);
+    V(mutex);
+}
+
+/* mutex held */
+void myHistory::put(track_t &t, time_t now, float v)
+{
+    uint32_t slot = now;
+    if (t.hdr.count && (isnan(v) || (slot != t.next_t) || (t.hdr.count == 0xffff)))
+        close_block(t); /* a gap starts a new block */
+    if (isnan(v))
+        return;
+    int32_t q = lroundf(v * 10);
+    const size_t cap = (max_blk - hdr_size) * 8;
+    if (t.hdr.count && (t.nbits + 36 > cap))
+        close_block(t);
+    if (!t.hdr.count)
+    {
+        t.hdr.t0 = slot;
+        t.hdr.id = t.id;
+        t.blocks.push_back(blk_ref_t{slot, slot, in_ram, 0});
+        put_bits(t, 0xf, 4);
+        put_bits(t, q, 32);
+    }
+    else
+    {
+        uint32_t z = zigzag(q - t.last);
+        if (z == 0)
+            put_bits(t, 0, 1);
+        else if (z < 3)
+            put_bits(t, (0x2 << 1) | (z - 1), 3);
+        else if (z < 11)
+            put_bits(t, (0x6 << 3) | (z - 3), 6);
+        else if (z < 267)
+            put_bits(t, (0xe << 8) | (z - 11), 12);
+        else
+        {
+            put_bits(t, 0xf, 4);
+            put_bits(t, q, 32);
+        }
+    }
+    t.hdr.count++;
+    t.last = q;
+    t.next_t = slot + interval;
+    t.blocks.back().t1 = t.next_t;
+    samples++;
+}
+
+void myHistory::sample(time_t now)
+{
+    if (now < TIME_VALID_EPOCH)
+        return;
+    uint32_t slot = now - now % interval;
+    if (slot == last_slot)
+        return;
+    last_slot = slot;
+    P(mutex);
+    for (auto &t : tracks)
+    {
+        if (!t.sens)
+            continue;
+        sens_snapshot_t snap = t.sens->snapshot();
+        put(t, slot, (snap.error || !snap.ts || t.sens->stale()) ? NAN : snap.val);
+    }
+    V(mutex);
+    if (millis() - last_flush >= flush_ms)
+        flush();
+}
+
+void myHistory::flush(void)
+{
+    P(mutex);
+    last_flush = millis();
+    if (seg_dirty || (samples != flushed))
+        write_seg(true);
+    flushed = samples;
+    V(mutex);
+}
+
+/* mutex held */
+bool myHistory::read_block(const blk_ref_t &r, blk_hdr_t &h, uint8_t *data)
+{
+    if (r.seg == in_ram)
+        return false;
+    if (r.seg == seg_nr)
+    {
+        get_hdr(seg + r.pos, h);
+        memcpy(data, seg + r.pos + hdr_size, h.len);
+        return true;
+    }
+    File f = LittleFS.open(seg_path(r.seg), "r");
+    uint8_t hb[hdr_size];
+    bool ok = f && f.seek(r.pos) && (f.read(hb, hdr_size) == hdr_size);
+    if (ok)
+    {
+        get_hdr(hb, h);
+        ok = (f.read(data, h.len) == h.len);
+    }
+    f.close();
+    return ok;
+}
+
+size_t myHistory::query(const String &name, time_t from, time_t to, hist_sink_fn fn, void *arg)
+{
+    size_t n = 0;
+    P(mutex);
+    track_t *t = find(name);
+    if (!t)
+    {
+        V(mutex);
+        return 0;
+    }
+    /* first block that may reach into [from, to) */
+    auto b = std::upper_bound(t->blocks.begin(), t->blocks.end(), static_cast<uint32_t>(from),
+                              [](uint32_t v, const blk_ref_t &r) { return v < r.t1; });
+    for (; (b != t->blocks.end()) && (static_cast<time_t>(b->t0) < to); b++)
+    {
+        blk_hdr_t h;
+        uint8_t data[max_blk];
+        if (b->seg == in_ram)
+        {
+            h = t->hdr;
+            memcpy(data, t->buf, (t->nbits + 7) / 8);
+        }
+        else if (!read_block(*b, h, data))
+            continue;
+        bitReader br(data);
+        int32_t v = 0;
+        time_t ts = h.t0;
+        for (unsigned k = 0; (k < h.count) && (ts < to); k++, ts += interval)
+        {
+            br.value(v);
+            if (ts >= from)
+            {
+                fn(ts, v / 10.0, arg);
+                n++;
+            }
+        }
+    }
+    V(mutex);
+    return n;
+}
+
+size_t myHistory::stored_bytes(void) const
+{
+    return (seg_nr - first_seg) * seg_size + seg_fill;
+}
+
+String myHistory::stats(void)
+{
+    unsigned long kept = 0;
+    uint32_t oldest = UINT32_MAX;
+    for (auto &t : tracks)
+        for (auto &b : t.blocks)
+        {
+            kept += (b.t1 - b.t0) / interval;
+            oldest = std::min(oldest, b.t0);
+        }
+    char buf[160];
+    snprintf(buf, sizeof(buf), "%lu samples of %u sensors in %u segments, %.2f bits/sample, %.1f days back, %lu segment writes",
+             kept, static_cast<unsigned>(tracks.size()), static_cast<unsigned>(seg_nr - first_seg + 1),
+             kept ? stored_bytes() * 8.0 / kept : 0.0, (oldest == UINT32_MAX) ? 0.0 : (time(nullptr) - oldest) / 86400.0,
+             seg_writes);
+    return String(buf);
+}
+
+static void history_task(lv_task_t *t)
+{
+    history->sample(time(nullptr));
+}
+
+void setup_history(myHistory *h)
+{
+    history = h;
+    if (h->begin())
+        lv_task_create(history_task, 10 * 1000, LV_TASK_PRIO_LOWEST, nullptr);
+}
+
+void history_stats(log_sink_fn sink, void *arg)
+{
+    String s = history ? history->stats() : String("off");
+    sink(s.c_str(), s.length(), arg);
+}
+
+typedef struct
+{
+    log_sink_fn sink;
+    void *arg;
+} csv_arg_t;
+
+static void csv_line(time_t t, float v, void *arg)
+{
+    csv_arg_t *a = static_cast<csv_arg_t *>(arg);
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), "%ld,%.1f\n", static_cast<long>(t), v);
+    a->sink(buf, n, a->arg);
+}
+
+void stream_history(const String &name, time_t from, time_t to, log_sink_fn sink, void *arg)
+{
+    csv_arg_t a{sink, arg};
+    if (history)
+        history->query(name, from, to, csv_line, &a);
+}
@@ -0,0 +1,142 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __history_h__
+#define __history_h__
+
+#include <Arduino.h>
+#include <WString.h>
+#include <vector>
+#include "logger.h"
+
+/* sensor history on LittleFS: one sample per sensor and interval, kept to 0.1 units and
+   delta encoded bit by bit; the samples of one sensor without a gap form a block, blocks go
+   into 4k segment files (one flash block each), written only when full or every flush_ms,
+   the oldest segment is removed once over budget. An index in RAM (block start times per
+   sensor, rebuilt from the block headers at boot) lets a query decode only what it needs.
+
+   value codes, d = v - previous v in 0.1 units, z = zigzag(d):
+   0           d == 0
+   10   + 1b   d == +-1, z - 1
+   110  + 3b   d in -5..5, z - 3
+   1110 + 8b   d in -133..133, z - 11
+   1111 + 32b  absolute value, the first sample of each block */
+
+#ifndef HIST_BUDGET
+#define HIST_BUDGET (7 * 4096) /* spiffs partition (64k, 16 blocks) less LittleFS' superblock pair,
+                                  SPOOL_BUDGET (3 blocks) and room for copy on write */
+#endif
+
+class genSensor;
+
+typedef void (*hist_sink_fn)(time_t t, float v, void *arg);
+
+class myHistory
+{
+public:
+    static const size_t seg_size = 4096;
+    static const size_t max_blk = 256; /* header included */
+    typedef struct
+    {
+        uint32_t t0;    /* time of the first sample */
+        uint16_t count; /* samples, one per interval from t0 on */
+        uint16_t id;    /* sensor name hash */
+        uint8_t len;    /* encoded bytes following the header */
+        uint8_t bits;   /* valid bits in the last byte, 0: 8 */
+    } blk_hdr_t;
+
+private:
+    typedef struct
+    {
+        uint32_t t0, t1; /* first sample, one past the last */
+        uint16_t seg;    /* segment number, 0xffff: still open in RAM */
+        uint16_t pos;    /* offset in the segment */
+    } blk_ref_t;
+    typedef struct
+    {
+        genSensor *sens;
+        String name;
+        uint16_t id;
+        std::vector<blk_ref_t> blocks; /* ascending t0 */
+        /* open block */
+        blk_hdr_t hdr;
+        uint8_t buf[max_blk];
+        size_t nbits;
+        int32_t last; /* previous value, 0.1 units */
+        uint32_t next_t; /* slot the next sample continues the block at */
+    } track_t;
+
+    std::vector<track_t> tracks;
+    uint8_t *seg;           /* current segment, seg_fill bytes of closed blocks */
+    size_t seg_fill = 0;
+    uint16_t seg_nr = 0, first_seg = 0;
+    bool seg_dirty = false;
+    size_t budget;
+    unsigned interval;      /* s */
+    unsigned long flush_ms; /* write the current segment at least that often */
+    unsigned long last_flush;
+    uint32_t last_slot = 0;
+    bool mounted = false;
+    SemaphoreHandle_t mutex;
+
+    /* statistics */
+    unsigned long samples = 0, flushed = 0, seg_writes = 0, seg_bytes = 0;
+    unsigned long encoded = 0; /* bytes of all blocks closed so far */
+
+    static uint16_t hash(const String &s);
+    track_t *find(const String &name);
+    void put_bits(track_t &t, uint32_t v, int n);
+    void put(track_t &t, time_t now, float v);
+    void close_block(track_t &t);
+    void write_seg(bool open_too);
+    void new_seg(void);
+    void load(void);
+    bool read_block(const blk_ref_t &r, blk_hdr_t &h, uint8_t *data);
+    static String seg_path(uint16_t nr);
+
+public:
+    myHistory(size_t budget = HIST_BUDGET, unsigned interval_s = 60, unsigned long flush_ms = 6 * 3600 * 1000UL);
+    ~myHistory() = default;
+
+    /* mount LittleFS and rebuild the index, false if there's no file system */
+    bool begin(void);
+    void add(genSensor *s);
+    /* a track fed by append() only, e.g. replayed data */
+    void add(const String &name);
+    /* take one sample of every sensor if a new interval started, called by the lv_task */
+    void sample(time_t now);
+    /* append v (NAN: no reading) for sensor i at slot time t */
+    void append(size_t i, time_t t, float v);
+    /* write the current segment now */
+    void flush(void);
+    /* feed the samples of sensor name in [from, to) to fn in time order, returns their number */
+    size_t query(const String &name, time_t from, time_t to, hist_sink_fn fn, void *arg);
+    String stats(void);
+    unsigned long get_samples(void) const { return samples; }
+    unsigned long encoded_bytes(void) const { return encoded; }
+    size_t stored_bytes(void) const;
+};
+
+/* mount, load and sample h every 10s from an lv_task */
+void setup_history(myHistory *h);
+/* one line to sink */
+void history_stats(log_sink_fn sink, void *arg);
+/* csv lines "<epoch>,<value>" of sensor name in [from, to) */
+void stream_history(const String &name, time_t from, time_t to, log_sink_fn sink, void *arg);
+
+#endif
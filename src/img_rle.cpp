@@ -0,0 +1,110 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+#include <string.h>
+#include <algorithm>
+#include <lvgl.h>
+
+#include "img_rle.h"
+
+static const size_t hdr_size = 8; /* magic, px_size, w, h */
+
+static inline uint16_t get16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+static inline uint32_t get32(const uint8_t *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24); }
+
+bool img_rle_check(const uint8_t *data, size_t size, uint8_t px_size)
+{
+    if (!data || (size < hdr_size) || memcmp(data, "RLE", 3) || (data[3] != px_size))
+        return false;
+    return size >= hdr_size + 4 * get16(data + 6);
+}
+
+void img_rle_read_line(const uint8_t *data, uint16_t x, uint16_t y, uint16_t len, uint8_t *buf)
+{
+    const size_t px = data[3];
+    const uint8_t *p = data + get32(data + hdr_size + 4 * y);
+    unsigned pos = 0, end = x + len;
+
+    while (pos < end)
+    {
+        uint8_t c = *p++;
+        unsigned n = (c & 0x7f) + 1;
+        unsigned from = std::max(pos, static_cast<unsigned>(x));
+        unsigned to = std::min(pos + n, end);
+        if (c & 0x80)
+        {
+            for (unsigned i = from; i < to; i++)
+                memcpy(buf + (i - x) * px, p, px);
+            p += px;
+        }
+        else
+        {
+            if (to > from)
+                memcpy(buf + (from - x) * px, p + (from - pos) * px, (to - from) * px);
+            p += n * px;
+        }
+        pos += n;
+    }
+}
+
+/* lvgl glue: img_data stays NULL, so lvgl fetches the image line by line
+   straight into its draw buffer, nothing is decoded or cached as a whole */
+static bool is_rle(const void *src)
+{
+    if (lv_img_src_get_type(src) != LV_IMG_SRC_VARIABLE)
+        return false;
+    const lv_img_dsc_t *d = static_cast<const lv_img_dsc_t *>(src);
+    return (d->header.cf == LV_IMG_CF_RAW) && img_rle_check(d->data, d->data_size, sizeof(lv_color_t));
+}
+
+static lv_res_t rle_info(lv_img_decoder_t *dec, const void *src, lv_img_header_t *header)
+{
+    if (!is_rle(src))
+        return LV_RES_INV;
+    *header = static_cast<const lv_img_dsc_t *>(src)->header;
+    return LV_RES_OK;
+}
+
+static lv_res_t rle_open(lv_img_decoder_t *dec, lv_img_decoder_dsc_t *dsc)
+{
+    if (!is_rle(dsc->src))
+        return LV_RES_INV;
+    dsc->img_data = NULL;
+    return LV_RES_OK;
+}
+
+static lv_res_t rle_read_line(lv_img_decoder_t *dec, lv_img_decoder_dsc_t *dsc,
+                              lv_coord_t x, lv_coord_t y, lv_coord_t len, uint8_t *buf)
+{
+    const lv_img_dsc_t *d = static_cast<const lv_img_dsc_t *>(dsc->src);
+    if ((x < 0) || (y < 0) || (y >= d->header.h) || (x + len > d->header.w))
+        return LV_RES_INV;
+    img_rle_read_line(d->data, x, y, len, buf);
+    return LV_RES_OK;
+}
+
+static void rle_close(lv_img_decoder_t *dec, lv_img_decoder_dsc_t *dsc) {}
+
+void img_rle_init(void)
+{
+    lv_img_decoder_t *dec = lv_img_decoder_create();
+    lv_img_decoder_set_info_cb(dec, rle_info);
+    lv_img_decoder_set_open_cb(dec, rle_open);
+    lv_img_decoder_set_read_line_cb(dec, rle_read_line);
+    lv_img_decoder_set_close_cb(dec, rle_close);
+}
@@ -0,0 +1,37 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+#ifndef __img_rle_h__
+#define __img_rle_h__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* RLE compressed images, generated from assets/ by tools/img_rle.py into src/img_*.c;
+   the lv_img_dsc_t is tagged LV_IMG_CF_RAW, data points to the stream:
+   'R' 'L' 'E' px_size, uint16 w, uint16 h, uint32 line_offset[h], packets...
+   packet: n < 0x80: n+1 literal pixels follow, n >= 0x80: next pixel repeated n-0x7f times */
+
+/* true if data is an rle stream with pixels of px_size bytes */
+bool img_rle_check(const uint8_t *data, size_t size, uint8_t px_size);
+/* decode pixels [x, x + len) of line y into buf */
+void img_rle_read_line(const uint8_t *data, uint16_t x, uint16_t y, uint16_t len, uint8_t *buf);
+/* register the lvgl decoder, call after lv_init() */
+void img_rle_init(void);
+
+#endif
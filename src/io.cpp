@@ -17,131 +17,409 @@
  */
 
 #include <list>
+#include <Preferences.h>
+#include <soc/soc.h>
+#include <soc/gpio_reg.h>
 #include "ui.h"
 #include "io.h"
 #include "mqtt.h"
+#include "circuits.h"
 
 void setup_io(void)
 {
     Wire.begin();
 }
 
-void periodicSensor::periodic_wrapper(lv_task_t *t)
+/* output frame, pins 0-31 and 32-39 in one mask each way */
+static uint64_t staged_hi, staged_lo;
+static unsigned long last_on; /* millis() of the last switch on */
+static unsigned long commits, reg_writes, stages, staggered;
+
+void gpio_stage(uint8_t pin, uint8_t v)
+{
+    uint64_t b = 1ULL << pin;
+    stages++;
+    if (v == HIGH)
+    {
+        staged_hi |= b;
+        staged_lo &= ~b;
+    }
+    else
+    {
+        staged_lo |= b;
+        staged_hi &= ~b;
+    }
+}
+
+int gpio_staged(uint8_t pin)
+{
+    uint64_t b = 1ULL << pin;
+    return (staged_hi & b) ? HIGH : ((staged_lo & b) ? LOW : -1);
+}
+
+static void gpio_write(uint32_t reg0, uint32_t reg1, uint64_t mask)
+{
+    if (static_cast<uint32_t>(mask))
+        REG_WRITE(reg0, static_cast<uint32_t>(mask));
+    if (mask >> 32)
+        REG_WRITE(reg1, static_cast<uint32_t>(mask >> 32));
+    reg_writes += !!static_cast<uint32_t>(mask) + !!(mask >> 32);
+}
+
+/* loop() thread, like all staging: lv_tasks, mqtt */
+void gpio_commit(void)
+{
+    uint64_t out = REG_READ(GPIO_OUT_REG) | (static_cast<uint64_t>(REG_READ(GPIO_OUT1_REG)) << 32);
+    uint64_t clr = staged_lo & out; /* changes only */
+    uint64_t set = 0;
+    staged_lo = 0;
+    staged_hi &= ~out;
+    if (staged_hi && (millis() - last_on >= GPIO_STAGGER_MS))
+    {
+        set = staged_hi & ~(staged_hi - 1); /* lowest pin first, the others wait for the next commits */
+        staged_hi &= ~set;
+        last_on = millis();
+    }
+    if (!clr && !set)
+        return;
+    commits++;
+    staggered += !!staged_hi;
+    gpio_write(GPIO_OUT_W1TC_REG, GPIO_OUT1_W1TC_REG, clr);
+    gpio_write(GPIO_OUT_W1TS_REG, GPIO_OUT1_W1TS_REG, set);
+}
+
+void gpio_stats(log_sink_fn sink, void *arg)
+{
+    char buf[128];
+    int n = snprintf(buf, sizeof(buf), "%lu pin levels staged, %lu commits, %lu register writes, %lu commits with switch ons held back",
+                     stages, commits, reg_writes, staggered);
+    sink(buf, n, arg);
+}
+
+/* relay protection: the guarded outputs, served by one lv_task */
+static std::list<ioSwitch *> guarded;
+static lv_task_t *guard_task_h;
+static bool guard_saved;              /* written to NVS since boot */
+static unsigned long guard_saved_at; /* millis() of the last NVS write */
+static const unsigned long guard_save_ms = 60 * 60 * 1000;
+
+static String guard_key(uint8_t pin) { return String("c") + pin; }
+
+void ioSwitch::protect(unsigned long min_on_s, unsigned long min_off_s, int max_cph)
+{
+    if (!guard)
+        guard = new io_guard_t{};
+    guard->min_on = min_on_s * 1000;
+    guard->min_off = min_off_s * 1000;
+    guard->max_cph = std::min(max_cph, IO_GUARD_MAX_CPH);
+    guard->idle = LOW; /* invers flips what the circuit asks for, HIGH on the pin is on for every output */
+    guard->last_change = millis() - std::max(guard->min_on, guard->min_off);
+    guard->pending = -1;
+    Preferences nvs;
+    nvs.begin("ioguard", true);
+    guard->cycles = guard->saved = nvs.getUInt(guard_key(pin).c_str(), 0);
+    nvs.end();
+    guarded.push_back(this);
+    if (!guard_task_h)
+        guard_task_h = lv_task_create(ioSwitch::guard_task, 1000, LV_TASK_PRIO_MID, nullptr);
+}
+
+bool ioSwitch::guard_may(uint8_t n, unsigned long now)
+{
+    unsigned long dwell = (state() != guard->idle) ? guard->min_on : guard->min_off;
+    if (now - guard->last_change < dwell)
+        return false;
+    if ((n == guard->idle) || !guard->max_cph)
+        return true;
+    if (guard->n_starts < guard->max_cph)
+        return true;
+    /* the oldest of the last max_cph switch ons must be an hour ago */
+    int oldest = (guard->next_start + IO_GUARD_MAX_CPH - guard->max_cph) % IO_GUARD_MAX_CPH;
+    return now - guard->starts[oldest] >= 60 * 60 * 1000UL;
+}
+
+void ioSwitch::guard_apply(uint8_t n, unsigned long now)
+{
+    _set(pin, n);
+    guard->last_change = now;
+    guard->pending = -1;
+    if (n == guard->idle)
+        return;
+    guard->starts[guard->next_start] = now;
+    guard->next_start = (guard->next_start + 1) % IO_GUARD_MAX_CPH;
+    guard->n_starts = std::min(guard->n_starts + 1, IO_GUARD_MAX_CPH);
+    guard->cycles++;
+}
+
+void ioSwitch::guarded_set(uint8_t n)
+{
+    unsigned long now = millis();
+    if (n == state())
+    {
+        guard->pending = -1; /* back where it is, nothing to hold */
+        return;
+    }
+    if (guard_may(n, now))
+        guard_apply(n, now);
+    else if (guard->pending != n)
+    {
+        guard->pending = n;
+        guard->deferred++;
+    }
+}
+
+/* held back changes as soon as they're allowed, counters to NVS on the first switch on after boot,
+   then at most hourly */
+void ioSwitch::guard_task(lv_task_t *t)
+{
+    unsigned long now = millis();
+    bool dirty = false;
+    for (auto io : guarded)
+    {
+        io_guard_t *g = io->guard;
+        if ((g->pending >= 0) && io->guard_may(g->pending, now))
+            io->guard_apply(g->pending, now);
+        dirty |= (g->cycles != g->saved);
+    }
+    if (dirty && (!guard_saved || (now - guard_saved_at >= guard_save_ms)))
+        guard_save();
+}
+
+void ioSwitch::guard_save(void)
+{
+    guard_saved = true;
+    guard_saved_at = millis();
+    Preferences nvs;
+    nvs.begin("ioguard", false);
+    for (auto io : guarded)
+        if (io->guard->cycles != io->guard->saved)
+        {
+            nvs.putUInt(guard_key(io->pin).c_str(), io->guard->cycles);
+            io->guard->saved = io->guard->cycles;
+        }
+    nvs.end();
+}
+
+void io_guard_flush(void)
+{
+    for (auto io : guarded)
+        if (io->guard->cycles != io->guard->saved)
+        {
+            ioSwitch::guard_save();
+            return;
+        }
+}
+
+void io_stats(log_sink_fn sink, void *arg)
+{
+    unsigned long now = millis();
+    for (auto io : guarded)
+    {
+        const io_guard_t *g = io->get_guard();
+        int hour = 0;
+        for (int i = 1; i <= g->n_starts; i++)
+            hour += (now - g->starts[(g->next_start + IO_GUARD_MAX_CPH - i) % IO_GUARD_MAX_CPH] < 60 * 60 * 1000UL);
+        char buf[128];
+        int n = snprintf(buf, sizeof(buf), "GPIO%u: %u switch ons, %d last hour (max %d), min on/off %lu/%lus, %lu held back%s\n",
+                         io->get_pin(), g->cycles, hour, g->max_cph, g->min_on / 1000, g->min_off / 1000, g->deferred,
+                         (g->pending >= 0) ? ", one pending" : "");
+        sink(buf, n, arg);
+    }
+}
+
+/* new data: evaluate the circuits depending on this sensor, directly or via an average */
+void genSensor::notify_circuits(void)
+{
+    std::for_each(circuits.begin(), circuits.end(),
+                  [](genCircuit *c) { c->update(); });
+    std::for_each(parents.begin(), parents.end(),
+                  [](avgSensor *p) { p->notify_circuits(); });
+}
+
+/* no reading for max_age: show it, drop it from averages and let the circuits fall back;
+   one shot, the next reading arms it again */
+void genSensor::stale_wrapper(lv_task_t *t)
 {
-    periodicSensor *obj = static_cast<periodicSensor *>(t->user_data);
-    obj->cb();
+    genSensor *obj = static_cast<genSensor *>(t->user_data);
+    if (!obj->stale())
+        return; /* max_age was raised meanwhile, check again a period later */
+    lv_task_set_prio(t, LV_TASK_PRIO_OFF);
+    stale_events()++;
+    log_msg(obj->name + ": no reading for " + String(obj->age() / 1000) + "s, stale.");
+    std::for_each(obj->parents.begin(), obj->parents.end(),
+                  [](avgSensor *p) { p->refresh(); });
+    obj->update_display();
+    obj->notify_circuits();
+}
+
+void genSensor::set_max_age(unsigned long ms)
+{
+    max_age = ms;
+    if (!stale_task)
+        stale_task = lv_task_create(genSensor::stale_wrapper, ms + 1000, LV_TASK_PRIO_LOW, this);
+    else
+        lv_task_set_period(stale_task, ms + 1000);
 }
 
 periodicSensor::periodicSensor(uiElements *ui, const String n, int period)
     : genSensor(ui, n)
 {
-    ticker_task = lv_task_create(periodicSensor::periodic_wrapper, period, LV_TASK_PRIO_LOW, this);
-    if (!ticker_task)
-        log_msg("Failed to create periodic task for sensor " + name);
+    acq_register(this, period);
+}
+
+void periodicSensor::deliver(const acq_result_t &r)
+{
+    P(mutex);
+    if (r.error)
+        set_error(true);
+    else
+        publish(r.val, r.hum, r.ts);
+    V(mutex);
+    if (!r.error)
+        feed_parents(r);
+    update_display();
+    notify_circuits();
+}
+
+void periodicSensor::feed_parents(const acq_result_t &r)
+{
+    std::for_each(parents.begin(), parents.end(),
+                  [&](avgSensor *p) { p->add_sample(r.val, this); });
+}
+
+void multiPropertySensor::feed_parents(const acq_result_t &r)
+{
+    std::for_each(parents.begin(), parents.end(),
+                  [&](genSensor *p) { p->update_data(this); });
 }
 
 /* Temperature DS18B20 */
 
 myDS18B20::myDS18B20(uiElements *ui, const String n, int pin, int period)
-    : periodicSensor(ui, n, period)
+    : periodicSensor(ui, n, period), pin(pin)
 {
-    uint8_t address[8];
     wire = new OneWire(pin);
     temps = new DallasTemperature(wire);
-    temps->begin();
-    temps->requestTemperatures();
-    /* temps->getDS18Count() doesn't work */
-    while (wire->search(address))
-    {
-        no_DS18B20++;
-    }
+    scan();
     log_msg(name + " found " + String(no_DS18B20) + " sensors.");
-    if (no_DS18B20 == 0)
-        error = true;
 }
 
-void myDS18B20::update_data(void)
+/* the only full bus walk, at startup and after a sensor dropped out */
+void myDS18B20::scan(void)
 {
     temps->begin();
-    temps->requestTemperatures();
-
+    temps->setWaitForConversion(false);
+    conv_ms = temps->millisToWaitForConversion(temps->getResolution());
+    /* temps->getDS18Count() doesn't work */
+    no_DS18B20 = 0;
+    wire->reset_search();
+    while ((no_DS18B20 < max_DS18B20) && wire->search(addr[no_DS18B20]))
+        no_DS18B20++;
+    rescan = false;
     P(mutex);
-    for (int i = 0; i < no_DS18B20; i++)
+    set_error(no_DS18B20 == 0);
+    V(mutex);
+}
+
+unsigned long myDS18B20::acquire(void)
+{
+    if (converting)
     {
-        all_temps[i] = temps->getTempCByIndex(i);
-        if (all_temps[i] != DEVICE_DISCONNECTED_C)
-        {
-            error = false;
-            //log_msg(name + ":" + String(all_temps[i]) + " Sensor " + String(i + 1) + "/" + String(no_DS18B20));
-            mqtt_publish(name + "-" + String(i), String(all_temps[i]));
-        }
-        else
+        /* conv_ms have passed, the scheduler was told so */
+        converting = false;
+        collecting = 0;
+    }
+    if (collecting >= 0)
+    {
+        float t = temps->getTempC(addr[collecting]);
+        bool failed = (t == DEVICE_DISCONNECTED_C);
+        if (failed)
         {
             log_msg("Getting data from " + name + " failed.");
-            error = true;
+            rescan = true;
         }
+        post(t, NAN, failed, collecting, no_DS18B20);
+        if (++collecting < no_DS18B20)
+            return 1; /* next one, other sensors due meanwhile go first */
+        collecting = -1;
+        return 0;
     }
+    if (rescan)
+        scan();
+    if (no_DS18B20 == 0)
+        return 0;
+    temps->requestTemperatures(); /* returns right after the convert command */
+    converting = true;
+    return conv_ms;
+}
+
+void myDS18B20::deliver(const acq_result_t &r)
+{
+    if (r.idx >= max_DS18B20)
+        return;
+    P(mutex);
+    all_temps[r.idx] = r.val;
+    set_error(r.error);
     V(mutex);
+    if (!r.error && !telemetry_bundled()) /* bundled, the frame carries the parent averages */
+        mqtt_publish(name + "-" + String(r.idx), String(r.val));
+    //log_msg(name + ":" + String(r.val) + " Sensor " + String(r.idx + 1) + "/" + String(r.n));
+    if (r.idx + 1 < r.n)
+        return; /* round not complete yet */
+    no_shown = r.n;
     std::for_each(parents.begin(), parents.end(),
                   [&](avgSensor *p) {
-                      for (int i = 0; i < no_DS18B20; i++)
-                          p->add_data(all_temps[i]);
+                      for (int i = 0; i < no_shown; i++)
+                          p->add_sample(all_temps[i], this);
                   });
+    update_display();
+    notify_circuits();
 }
 
 /* Temperature & Humidity */
 myDHT::myDHT(uiElements *ui, String n, int p, DHTesp::DHT_MODEL_t m, int period)
-    : multiPropertySensor(ui, n, period), pin(p), model(m), temp(-500), hum(-99)
+    : multiPropertySensor(ui, n, period), pin(p), model(m)
 {
+    publish(-500, -99, 0);
     dht_obj.setup(pin, m);
 }
 
-void myDHT::update_data(void)
+unsigned long myDHT::acquire(void)
 {
-    error = false;
     TempAndHumidity newValues = dht_obj.getTempAndHumidity();
     if (dht_obj.getStatus() != 0)
     {
         log_msg(name + "(" + get_pin() + ") - error status: " + String(dht_obj.getStatusString()));
-        error = true;
-        return;
+        post(NAN, NAN, true);
+        return 0;
     }
-    P(mutex);
-    temp = newValues.temperature;
-    hum = newValues.humidity; // ((rand() % 100) - 50.0) / 20.0;
-    V(mutex);
-    std::for_each(parents.begin(), parents.end(),
-                  [&](genSensor *p) { p->update_data(this); });
+    post(newValues.temperature, newValues.humidity); // ((rand() % 100) - 50.0) / 20.0;
+    return 0;
 }
 
 /* BME280 Sensor */
 myBM280::myBM280(uiElements *ui, String n, int a, int period)
-    : multiPropertySensor(ui, n, period), address(a), temp(-777), hum(-88)
+    : multiPropertySensor(ui, n, period), address(a)
 {
+    publish(-777, -88, 0);
     bme = new Adafruit_BME280;
+    P(mutex);
     if (!bme->begin(address))
     {
         log_msg("failed to initialize BME280 sensor " + name);
-        error = true;
+        set_error(true);
     }
-    P(mutex);
     bme_temp = bme->getTemperatureSensor();
     bme_humidity = bme->getHumiditySensor();
     V(mutex);
 }
 
-void myBM280::update_data(void)
+unsigned long myBM280::acquire(void)
 {
     sensors_event_t temp_event, humidity_event;
-    P(mutex);
-    error = false;
     bme_temp->getEvent(&temp_event);
     bme_humidity->getEvent(&humidity_event);
-    temp = temp_event.temperature;
-    hum = humidity_event.relative_humidity;
-    if ((temp == NAN) || (hum == NAN))
-        error = true;
-    V(mutex);
-    std::for_each(parents.begin(), parents.end(),
-                  [&](genSensor *p) { p->update_data(this); });
+    post(temp_event.temperature, humidity_event.relative_humidity,
+         isnan(temp_event.temperature) || isnan(humidity_event.relative_humidity));
+    return 0;
 }
@@ -28,16 +28,34 @@
 #include <Adafruit_BME280.h>
 #include <list>
 #include <array>
+#include <algorithm>
 #include "ui.h"
 #include "mqtt.h"
+#include "acq.h"
+#include "rollup.h"
+#include "telemetry.h"
+#include "seqlock.h"
 
 void setup_io(void);
+/* protected outputs, one line each to sink: lifetime switch ons, last hour, changes held back */
+void io_stats(log_sink_fn sink, void *arg);
+/* switch on counters to NVS now, e.g. before a reboot */
+void io_guard_flush(void);
+
+/* output frame: ioDigitalIO stages pin levels, gpio_commit() (once per loop()) writes them through the
+   set/clear registers - all clears at once, switch ons one per GPIO_STAGGER_MS against inrush */
+#define GPIO_STAGGER_MS 100
+void gpio_stage(uint8_t pin, uint8_t v);
+int gpio_staged(uint8_t pin); /* level waiting for the commit, -1: none */
+void gpio_commit(void);
+void gpio_stats(log_sink_fn sink, void *arg);
 
 /* forware declaration */
 class avgDHT;
 class periodicSensor;
 class multiPropertySensor;
 class avgSensor;
+class genCircuit;
 
 typedef enum
 {
@@ -46,6 +64,15 @@ typedef enum
     JUST_SWITCH
 } sens_type_t;
 
+/* what a sensor publishes to its readers, always consistent as a whole */
+typedef struct
+{
+    float val;        /* the reading, temperature of multi property sensors */
+    float hum;        /* humidity of multi property sensors, NAN otherwise */
+    unsigned long ts; /* millis() of the reading, 0 for the default value */
+    bool error;
+} sens_snapshot_t;
+
 class genSensor
 {
 protected:
@@ -54,7 +81,30 @@ protected:
     const sens_type_t type;
     SemaphoreHandle_t mutex;
     std::list<avgSensor *> parents{};
-    bool error = false;
+    std::list<genCircuit *> circuits{}; /* evaluated whenever new data arrives */
+    seqLock<sens_snapshot_t> snap{sens_snapshot_t{NAN, NAN, 0, false}};
+    unsigned long max_age = 0;      /* ms a reading stays valid, 0: forever */
+    lv_task_t *stale_task = nullptr; /* fires once, max_age after the last reading */
+    myRollup *rollup = nullptr; /* not for switches */
+    static void stale_wrapper(lv_task_t *t);
+
+    /* writer side, mutex held */
+    void publish(float v, float h = NAN, unsigned long ts = millis())
+    {
+        if (rollup && ts && (ts != snap.read().ts)) /* a new reading, not the default or a re-publish */
+            rollup->add(time(nullptr) - (millis() - ts) / 1000, v);
+        snap.write(sens_snapshot_t{v, h, ts, false});
+        if (!stale_task || (millis() - ts > max_age))
+            return; /* re-publishing old data, e.g. an average dropping stale samples */
+        lv_task_reset(stale_task);
+        lv_task_set_prio(stale_task, LV_TASK_PRIO_LOW);
+    }
+    void set_error(bool e)
+    {
+        sens_snapshot_t s = snap.read();
+        s.error = e;
+        snap.write(s);
+    }
 
 public:
     genSensor(uiElements *ui, String n, const sens_type_t t = REAL_SENSOR) : ui(ui), name(n), type(t)
@@ -63,16 +113,35 @@ public:
         V(mutex);
         if (type == REAL_SENSOR) /* don't register switch sensors (yet) */
             ui->register_sensor(this);
+        if (type != JUST_SWITCH)
+        {
+            rollup = new myRollup(name);
+            telemetry_add(this);
+        }
     }
     virtual ~genSensor() = default;
 
     sens_type_t get_type() { return type; }
-    String get_name() { return name; };
+    const String &get_name() { return name; };
     virtual String _to_string() = 0;
+    /* lock free, safe from any task */
+    sens_snapshot_t snapshot(void) const { return snap.read(); }
+    /* freshness: ms since the last reading, stale once older than max_age */
+    unsigned long age(void) const { return millis() - snapshot().ts; }
+    bool stale(void) const { return max_age && (age() > max_age); }
+    const myRollup *get_rollup(void) const { return rollup; }
+    void set_max_age(unsigned long ms);
+    static unsigned long &stale_events(void)
+    {
+        static unsigned long n = 0;
+        return n;
+    }
     virtual String to_string(void)
     {
-        if (error)
+        if (snapshot().error)
             return name + ": #ff0000 <ERROR>";
+        else if (stale())
+            return name + ": #ff8000 <STALE " + String(age() / 1000) + "s>";
         else
             return name + ": " + _to_string();
     }
@@ -103,22 +172,30 @@ public:
     }
     virtual void publish_data(void)
     {
-        mqtt_publish(to_string(), String(get_data()));
+        if (!telemetry_bundled()) /* else it goes with the next frame */
+            mqtt_publish(to_string(), String(get_data()));
         log_msg("Sensor " + name + " updated to: " + String(get_data()));
     }
 
     virtual void add_parent(avgSensor *p) { parents.push_back(p); }
+    virtual void add_circuit(genCircuit *c) { circuits.push_back(c); }
+    void notify_circuits(void);
 };
 
+/* sampled by the acquisition task (acq.h), readings come back to the ui thread through deliver() */
 class periodicSensor : public genSensor
 {
 protected:
-    lv_task_t *ticker_task;
+    /* acquisition task: hand a reading over to the ui thread */
+    void post(float v, float h = NAN, bool error = false, uint8_t idx = 0, uint8_t n = 1)
+    {
+        acq_post(acq_result_t{this, v, h, millis(), idx, n, error});
+    }
+    virtual void feed_parents(const acq_result_t &r);
 
 public:
     periodicSensor(uiElements *ui, const String n, int period = 2000);
     virtual ~periodicSensor() = default;
-    static void periodic_wrapper(lv_task_t *t);
     virtual String _to_string(void) override
     {
         float v = get_data();
@@ -127,12 +204,12 @@ public:
         return String(v);
     };
     virtual float get_data(void) override = 0;
-    virtual void update_data(void) = 0;
-    virtual void cb(void)
-    {
-        update_data();
-        update_display();
-    }
+    virtual void update_data(void) override {} /* readings arrive through deliver() */
+    /* acquisition task: read the hardware, post() the reading(s); 0 when done for this period,
+       otherwise the ms until it wants to go on, e.g. once a conversion has finished */
+    virtual unsigned long acquire(void) = 0;
+    /* ui thread: publish a posted reading, update display and circuits */
+    virtual void deliver(const acq_result_t &r);
 };
 
 class multiPropertySensor : public periodicSensor
@@ -145,99 +222,200 @@ public:
     virtual float get_data(void) override = 0;
     virtual float get_temp(void) = 0;
     virtual float get_hum(void) = 0;
+
+protected:
+    /* the averages pick temperature or humidity from the snapshot */
+    virtual void feed_parents(const acq_result_t &r) override;
+};
+
+/* fixed size sample window, a sorted shadow copy is kept up to date on every add,
+   so the trimmed mean can be read without sorting or allocating anything */
+template <typename T, size_t N>
+class trimmedWindow
+{
+    std::array<T, N> ring;   /* samples in arrival order */
+    std::array<T, N> sorted; /* non-NaN samples ascending, valid in [0, valid) */
+    size_t act_ind = 0;
+    size_t valid = 0;
+
+    void remove(T v)
+    {
+        if (isnan(v))
+            return; /* NaNs never make it into the sorted part */
+        auto p = std::lower_bound(sorted.begin(), sorted.begin() + valid, v);
+        std::copy(p + 1, sorted.begin() + valid, p);
+        valid--;
+    }
+    void insert(T v)
+    {
+        if (isnan(v))
+            return;
+        auto p = std::upper_bound(sorted.begin(), sorted.begin() + valid, v);
+        std::copy_backward(p, sorted.begin() + valid, sorted.begin() + valid + 1);
+        *p = v;
+        valid++;
+    }
+
+public:
+    trimmedWindow(T def_val = 0) { fill(def_val); }
+    ~trimmedWindow() = default;
+
+    void fill(T v)
+    {
+        ring.fill(v);
+        sorted.fill(v);
+        act_ind = 0;
+        valid = isnan(v) ? 0 : N;
+    }
+    void add(T v)
+    {
+        remove(ring[act_ind]);
+        insert(v);
+        ring[act_ind] = v;
+        act_ind = (act_ind + 1) % N;
+    }
+    inline size_t size(void) const { return valid; }
+
+    /* same semantics as the former sort & crop: drop 1 sample at each end for
+       3..6 valid samples, 2 beyond that; NaN if no valid sample at all */
+    T trimmed_mean(void) const
+    {
+        size_t crop = 0;
+        T res = 0;
+        if (valid > 2)
+            crop = (valid > 6) ? 2 : 1;
+        for (size_t i = crop; i < valid - crop; i++)
+            res = res + sorted[i];
+        return res / (valid - 2 * crop);
+    }
 };
 
+typedef enum
+{
+    FUSE_TRIMMED, /* trimmed mean of the last sample_no samples, however old */
+    FUSE_FRESH    /* samples weighted by source and age, dropped at max_age or if their source is stale */
+} fuse_mode_t;
+
 class avgSensor : public genSensor
 {
 protected:
     static const int sample_no = 12;
-    std::array<float, sample_no> data;
+    typedef struct
+    {
+        float v;
+        unsigned long ts;
+        genSensor *src;
+    } sample_t;
+    trimmedWindow<float, sample_no> window;
+    std::array<sample_t, sample_no> samples{};
+    size_t act_sample = 0;
     std::list<genSensor *> sensors;
-    int act_ind;
-    float cached_data = 0.0;
+    std::list<std::pair<genSensor *, float>> weights;
+    fuse_mode_t mode = FUSE_TRIMMED;
+
+    float weight(genSensor *src) const
+    {
+        for (auto &w : weights)
+            if (w.first == src)
+                return w.second;
+        return 1.0;
+    }
+    /* mutex held; the snapshot carries the newest sample that made it in */
+    void fuse(void)
+    {
+        if ((mode == FUSE_TRIMMED) || !max_age)
+        {
+            publish(window.trimmed_mean(), NAN, samples[(act_sample + sample_no - 1) % sample_no].ts);
+            return;
+        }
+        unsigned long now = millis(), newest = 0;
+        float sum = 0, wsum = 0;
+        for (auto &s : samples)
+        {
+            if (!s.ts || isnan(s.v) || (now - s.ts >= max_age) || (s.src && s.src->stale()))
+                continue;
+            float w = weight(s.src) * (1.0 - static_cast<float>(now - s.ts) / max_age);
+            sum += w * s.v;
+            wsum += w;
+            if (now - s.ts < now - newest) /* wrap safe s.ts > newest */
+                newest = s.ts;
+        }
+        publish((wsum > 0) ? sum / wsum : NAN, NAN, newest);
+    }
 
 public:
     avgSensor(uiElements *ui, String n, std::list<genSensor *> s, float def_val = 0.0)
-        : genSensor(ui, n, AVG_SENSOR), sensors(s), act_ind(0)
+        : genSensor(ui, n, AVG_SENSOR), window(def_val), sensors(s)
     {
         mutex = xSemaphoreCreateMutex();
         for_each(sensors.begin(), sensors.end(),
                  [&](genSensor *sens) { sens->add_parent(this); });
-        for (int i = 0; i < sample_no; i++)
-            data[i] = def_val;
+        publish(window.trimmed_mean(), NAN, 0);
         V(mutex);
     }
     ~avgSensor() = default;
 
+    /* FUSE_FRESH needs a max_age, readings older than that don't count at all */
+    void set_fusion(fuse_mode_t m, unsigned long age_ms = 0)
+    {
+        mode = m;
+        if (age_ms)
+            set_max_age(age_ms);
+    }
+    void set_weight(genSensor *src, float w) { weights.push_back({src, w}); }
+    void add_sample(float v, genSensor *src)
+    {
+        P(mutex);
+        window.add(v);
+        samples[act_sample] = sample_t{v, millis(), src};
+        act_sample = (act_sample + 1) % sample_no;
+        fuse();
+        V(mutex);
+    }
+    /* a source went stale, drop its samples now */
+    void refresh(void)
+    {
+        P(mutex);
+        fuse();
+        V(mutex);
+    }
+
     virtual void update_data(void) override
     { /* log_msg(name + ": update_data called - shouldn't happen!!!"); */
     }
-    virtual String _to_string(void) { return String(cached_data); };
+    virtual String _to_string(void) { return String(snapshot().val); };
 
     // virtual void update_display(float) = 0;
     // virtual void update_display(void) = 0;
     virtual void _add_data(float d) override
     {
-        data[act_ind] = d;
-        act_ind = ((act_ind + 1) % sample_no);
-    }
-    float get_data() override
-    {
-        float res = 0.0;
-        int crop = 0;
-
-        std::list<float> s;
-        P(mutex);
-        for (size_t i = 0; i < data.size(); i++)
-            if (!isnan(data[i]))
-                s.push_back(data[i]);
-        V(mutex);
-
-        if (s.size() > 2)
-        {
-            s.sort();
-            crop = (s.size() > 6) ? 2 : 1;
-        }
-        while (crop-- > 0)
-        {
-            s.pop_front();
-            s.pop_back();
-        }
-        for (auto i = s.begin(); i != s.end(); i++)
-            res = res + *i;
-        res = res / s.size();
-        cached_data = res;
-#if 0
-        printf("%s data:           [", name.c_str());
-        fflush(stdout);
-        for (int i = 0; i < sample_no; i++)
-        {
-            printf("%.2f,", data[i]);
-            fflush(stdout);
-        }
-        printf("]\n");
-        fflush(stdout);
-        printf("%s sorted data:    [", name.c_str());
-        fflush(stdout);
-        for (auto i = s.begin(); i != s.end(); i++)
-        {
-            printf("%.2f,", *i);
-            fflush(stdout);
-        }
-        printf("]\n");
-#endif
-        return res;
+        window.add(d);
+        samples[act_sample] = sample_t{d, millis(), nullptr};
+        act_sample = (act_sample + 1) % sample_no;
+        fuse();
     }
+    float get_data() override { return snapshot().val; }
 };
 
+/* never blocks on the bus for a conversion: one acquire() starts it on all sensors at once,
+   conv_ms later the following ones read back one sensor each, by cached ROM address */
 class myDS18B20 : public periodicSensor
 {
-    float temp;
+    static const int max_DS18B20 = 8;
     OneWire *wire;
     DallasTemperature *temps;
     int pin;
-    int no_DS18B20 = 0;
-    float all_temps[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    int no_DS18B20 = 0; /* acquisition side */
+    DeviceAddress addr[max_DS18B20];
+    int no_shown = 0; /* ui side, readings of the last round */
+    float all_temps[max_DS18B20] = {0, 0, 0, 0, 0, 0, 0, 0};
+    bool converting = false;
+    int collecting = -1; /* next sensor to read back, -1: idle */
+    bool rescan = false; /* a sensor dropped out, search the bus again when idle */
+    unsigned long conv_ms;
+
+    void scan(void);
+    bool collect(int i);
 
 public:
     myDS18B20(uiElements *ui, const String n, int pin, int perdiod = 2000);
@@ -246,28 +424,21 @@ public:
     virtual String _to_string(void)
     {
         String s;
-        for (int i = 0; i < no_DS18B20; i++)
+        for (int i = 0; i < no_shown; i++)
         {
             s += String(all_temps[i]);
             s += "C ";
         }
         return s;
     }
-    virtual void _add_data(float v) override { temp = v; }
-    virtual void update_data() override;
-    virtual float get_data(void) override
-    {
-        float r;
-        P(mutex);
-        r = temp;
-        V(mutex);
-        return r;
-    }
+    virtual void _add_data(float v) override { publish(v); }
+    virtual unsigned long acquire(void) override;
+    virtual void deliver(const acq_result_t &r) override;
+    virtual float get_data(void) override { return snapshot().val; }
 };
 
 class myCapMoisture : public periodicSensor
 {
-    float val;
     int pin;
 
 public:
@@ -275,21 +446,13 @@ public:
         : periodicSensor(ui, n, period), pin(p) {}
     virtual ~myCapMoisture() = default;
 
-    virtual void _add_data(float v) override { val = v; }
-    virtual void update_data() override
+    virtual void _add_data(float v) override { publish(v); }
+    virtual unsigned long acquire(void) override
     {
-        P(mutex);
-        val = analogRead(pin);
-        V(mutex);
-    }
-    virtual float get_data(void) override
-    {
-        float r;
-        P(mutex);
-        r = val;
-        V(mutex);
-        return r;
+        post(analogRead(pin));
+        return 0;
     }
+    virtual float get_data(void) override { return snapshot().val; }
 };
 
 class myDHT : public multiPropertySensor
@@ -297,25 +460,31 @@ class myDHT : public multiPropertySensor
     DHTesp dht_obj;
     int pin;
     DHTesp::DHT_MODEL_t model;
-    float temp, hum;
 
 public:
     myDHT(uiElements *ui, String n, int pin, DHTesp::DHT_MODEL_t m = DHTesp::DHT22, int period = 2000);
     virtual ~myDHT() = default;
 
-    virtual String _to_string(void) { return String(get_temp()) + "C," + String(get_hum()) + "%"; }
-    virtual void update_data() override;
+    virtual String _to_string(void)
+    {
+        sens_snapshot_t s = snapshot();
+        return String(s.val) + "C," + String(s.hum) + "%";
+    }
+    virtual unsigned long acquire(void) override;
     inline int get_pin(void) { return pin; }
-    virtual float get_data(void) { return -temp * hum; } /* dummy, never used directly here */
-    virtual void _add_data(float v) { return; }          /* dummy, never used directly */
-    inline float get_temp(void) { return temp; }
-    inline float get_hum(void) { return hum; }
+    virtual float get_data(void) /* dummy, never used directly here */
+    {
+        sens_snapshot_t s = snapshot();
+        return -s.val * s.hum;
+    }
+    virtual void _add_data(float v) { return; } /* dummy, never used directly */
+    inline float get_temp(void) { return snapshot().val; }
+    inline float get_hum(void) { return snapshot().hum; }
 };
 
 class myBM280 : public multiPropertySensor
 {
     int address;
-    float temp, hum;
     Adafruit_BME280 *bme; // use I2C interface
     Adafruit_Sensor *bme_temp;
     Adafruit_Sensor *bme_humidity;
@@ -325,26 +494,20 @@ public:
     myBM280(uiElements *ui, String n, int address = 0x76, int period = 2000);
     virtual ~myBM280() = default;
 
-    virtual String _to_string(void) { return String(get_temp()) + "C," + String(get_hum()) + "%"; }
-    virtual void update_data() override;
-    virtual float get_data(void) { return temp * hum; } /* dummy, never used directly here */
-    virtual void _add_data(float v) { return; }         /* dummy, never used directly */
-    inline float get_temp()
+    virtual String _to_string(void)
     {
-        float r;
-        P(mutex);
-        r = temp;
-        V(mutex);
-        return r;
+        sens_snapshot_t s = snapshot();
+        return String(s.val) + "C," + String(s.hum) + "%";
     }
-    inline float get_hum()
+    virtual unsigned long acquire(void) override;
+    virtual float get_data(void) /* dummy, never used directly here */
     {
-        float r;
-        P(mutex);
-        r = hum;
-        V(mutex);
-        return r;
+        sens_snapshot_t s = snapshot();
+        return s.val * s.hum;
     }
+    virtual void _add_data(float v) { return; } /* dummy, never used directly */
+    inline float get_temp() { return snapshot().val; }
+    inline float get_hum() { return snapshot().hum; }
 };
 
 class tempSensorMulti : public avgSensor
@@ -357,8 +520,9 @@ public:
     virtual void update_data(multiPropertySensor *s) override
     {
         float v = s->get_temp();
-        add_data(v);
-        mqtt_publish(name, String(v));
+        add_sample(v, s);
+        if (!telemetry_bundled())
+            mqtt_publish(name, String(v));
     }
 
 #if 0
@@ -379,8 +543,9 @@ public:
     virtual void update_data(multiPropertySensor *s) override
     {
         float v = s->get_hum();
-        add_data(v);
-        mqtt_publish(name, String(v));
+        add_sample(v, s);
+        if (!telemetry_bundled())
+            mqtt_publish(name, String(v));
     }
 
 #if 0
@@ -399,12 +564,11 @@ public:
 
 class remoteSensor : public genSensor
 {
-    float d;
-
 public:
     remoteSensor(uiElements *ui, const char *n = "<RemoteSensor>", float def_val = -99.0)
-        : genSensor(ui, String{n}, REAL_SENSOR), d(def_val)
+        : genSensor(ui, String{n}, REAL_SENSOR)
     {
+        publish(def_val, NAN, 0);
         mqtt_register_sensor(this);
     };
     virtual ~remoteSensor() = default;
@@ -418,18 +582,11 @@ public:
         return String(v);
     };
 
-    virtual float get_data(void) override
-    {
-        float r;
-        P(mutex);
-        r = d;
-        V(mutex);
-        return r;
-    }
+    virtual float get_data(void) override { return snapshot().val; }
 
     virtual void _add_data(float v)
     {
-        d = v;
+        publish(v);
     }
     void update_data(float v)
     {
@@ -437,19 +594,42 @@ public:
         //log_msg("Remote Sensor " + get_name() + " updated to " + String(get_data()));
         std::for_each(parents.begin(), parents.end(),
                       [&](avgSensor *p) {
-                          p->add_data(v);
+                          p->add_sample(v, this);
                           p->update_data();
                       });
         update_display();
+        notify_circuits();
     }
 };
 
 /* Digital IO switches */
 
+/* relay protection, see ioSwitch::protect() */
+#define IO_GUARD_MAX_CPH 16
+typedef struct
+{
+    unsigned long min_on, min_off; /* ms */
+    int max_cph;                   /* switch ons per hour, 0: no limit */
+    uint8_t idle;                  /* pin level at rest (off) */
+    unsigned long last_change;     /* millis() */
+    unsigned long starts[IO_GUARD_MAX_CPH]; /* the last switch ons, a ring */
+    int next_start, n_starts;
+    int pending;                   /* level held back, -1: none */
+    uint32_t cycles, saved;        /* lifetime switch ons, and as last written to NVS */
+    unsigned long deferred;        /* changes held back since boot */
+} io_guard_t;
+
 class ioSwitch
 {
     uint8_t pin;
     bool invers;
+    io_guard_t *guard = nullptr;
+
+    bool guard_may(uint8_t n, unsigned long now);
+    void guard_apply(uint8_t n, unsigned long now);
+    static void guard_task(lv_task_t *t);
+    static void guard_save(void);
+    friend void io_guard_flush(void);
 
 public:
     ioSwitch(uint8_t gpio, bool i = false) : pin(gpio), invers(i) {}
@@ -466,9 +646,20 @@ public:
         {
             n = (n == HIGH) ? LOW : HIGH;
         }
-        _set(pin, n);
+        if (guard)
+            guarded_set(n);
+        else
+            _set(pin, n);
         return res;
     }
+    /* relay protection: a change within min_on_s/min_off_s of the last one, or a switch on beyond
+       max_cph in the last hour, is held back and applied as soon as allowed (a later set() back to
+       the current level cancels it); switching off is never held back by the hourly budget.
+       Switch ons are counted for the lifetime of the relay, in NVS, written at most hourly */
+    void protect(unsigned long min_on_s, unsigned long min_off_s, int max_cph);
+    void guarded_set(uint8_t n);
+    const io_guard_t *get_guard(void) const { return guard; }
+    uint8_t get_pin(void) const { return pin; }
     inline int toggle()
     {
         int res = state();
@@ -477,6 +668,8 @@ public:
     }
 
     inline bool is_invers(void) { return invers; }
+    /* proportional output, d in [0, 1]; false: on/off only, the caller time-proportions */
+    virtual bool set_duty(float d) { return false; }
 };
 
 class ioDigitalIO : public ioSwitch
@@ -490,12 +683,13 @@ public:
 
     void _set(uint8_t pin, int v) override
     {
-        digitalWrite(pin, v);
+        gpio_stage(pin, v);
         //printf("digital write IO%d = %d\n", pin, v);
     }
     int _state(uint8_t pin) override
     {
-        return digitalRead(pin);
+        int s = gpio_staged(pin);
+        return (s >= 0) ? s : digitalRead(pin);
     }
 
     const String to_string(void) override
@@ -507,6 +701,39 @@ public:
     }
 };
 
+/* LEDC PWM, e.g. a MOSFET or a zero cross SSR; HIGH/LOW is full on/off */
+class ioPWM : public ioSwitch
+{
+    uint8_t channel;
+    uint32_t duty_max;
+
+public:
+    ioPWM(uint8_t pin, uint8_t ch, bool i = false, double freq = 1000, uint8_t bits = 10)
+        : ioSwitch(pin, i), channel(ch), duty_max((1UL << bits) - 1)
+    {
+        ledcSetup(channel, freq, bits);
+        ledcAttachPin(pin, channel);
+        ledcWrite(channel, 0);
+    }
+    ~ioPWM() = default;
+
+    void _set(uint8_t pin, int v) override { ledcWrite(channel, (v == HIGH) ? duty_max : 0); }
+    int _state(uint8_t pin) override { return ledcRead(channel) ? HIGH : LOW; }
+    bool set_duty(float d) override
+    {
+        if (is_invers())
+            d = 1 - d;
+        ledcWrite(channel, lroundf(std::max(0.0f, std::min(1.0f, d)) * duty_max));
+        return true;
+    }
+    float get_duty(void) { return ledcRead(channel) / static_cast<float>(duty_max); }
+
+    const String to_string(void) override
+    {
+        return String(get_duty() * 100, 0) + "%";
+    }
+};
+
 class ioServo : public ioSwitch
 {
     Servo *servo;
@@ -16,13 +16,14 @@
  *
  */
 
+#include <algorithm>
 #include "logger.h"
 #include "ui.h"
 #include "mqtt.h"
 
-static myLogger msg_logger("/msg-log", 50, 10 * 1000);
-static myLogger sensor_logger("/sensors-log", 50);
-static myLogger circuit_logger("/circuits-log", 50);
+static myLogger msg_logger("/msg-log", 6 * 1024, 10 * 1000);
+static myLogger sensor_logger("/sensors-log", 4 * 1024);
+static myLogger circuit_logger("/circuits-log", 6 * 1024);
 
 #if 0
 void logger_task(void *arg)
@@ -57,27 +58,29 @@ void log_publish(void)
 void log_publish(void) {}
 #endif
 /* helpers */
-void log_msg(String s, myLogger::myLog_t where, bool publish)
+static myLogger *get_logger(myLogger::myLog_t where)
 {
-    printf("%s\n", s.c_str());
-    fflush(stdout);
-
-    myLogger *l;
     switch (where)
     {
     case myLogger::LOG_MSG:
-        l = &msg_logger;
-        break;
+        return &msg_logger;
     case myLogger::LOG_SENSOR:
-        l = &sensor_logger;
-        break;
+        return &sensor_logger;
     case myLogger::LOG_CIRCUIT:
-        l = &circuit_logger;
-        break;
+        return &circuit_logger;
     default:
-        return;
+        return nullptr;
     }
-    l->log(s, publish);
+}
+
+void log_msg(String s, myLogger::myLog_t where, bool publish)
+{
+    printf("%s\n", s.c_str());
+    fflush(stdout);
+
+    myLogger *l = get_logger(where);
+    if (l)
+        l->log(s, publish);
 }
 
 void log_msg(const char *s, myLogger::myLog_t where, bool publish)
@@ -91,74 +94,208 @@ void log_msg(const char *s, myLogger::myLog_t where, bool publish)
     log_msg(String(s), where, publish);
 }
 
-myLogger::myLogger(String n, size_t max, unsigned long p)
-    : name(n), max(max), len(0), last_cycle(millis()), period(p), nr(1)
+/* binary records aren't printed, they're formatted only when the log is read */
+void log_rec(log_fmt_fn fmt, const void *rec, size_t len, myLogger::myLog_t where)
 {
+    myLogger *l = get_logger(where);
+    if (l)
+        l->log(fmt, rec, len);
+}
+
+const size_t myLogger::max_msg_len;
+const size_t myLogger::max_rec_len;
+
+myLogger::myLogger(String n, size_t budget, unsigned long p)
+    : size(budget), head(0), tail(0), first_nr(1), nr(1), name(n), last_cycle(millis()), period(p)
+{
+    arena = static_cast<uint8_t *>(malloc(size));
     mutex = xSemaphoreCreateMutex();
     V(mutex);
 }
 
 void myLogger::log(String m, bool publish)
+{
+    log(m.c_str(), m.length(), publish);
+}
+
+void myLogger::log(const char *m, size_t l, bool publish)
 {
     if (publish && log_mqtt_client)
     {
-        log_entry_t e{0, time(nullptr), m};
-        mqtt_publish("/msg", entry2String(e, false), log_mqtt_client);
+        log_entry_t e;
+        e.nr = 0;
+        e.t = time(nullptr);
+        e.len = std::min(l, max_msg_len);
+        memcpy(e.msg, m, e.len);
+        e.msg[e.len] = '\0';
+        mqtt_publish("/msg", entry2String(e, false), log_mqtt_client, 0, MQTT_ALARM);
         return;
     }
+    store(m, std::min(l, max_msg_len), nullptr);
+}
+
+void myLogger::log(log_fmt_fn fmt, const void *rec, size_t len)
+{
+    if (len <= max_rec_len)
+        store(rec, len, fmt);
+}
+
+void myLogger::store(const void *m, size_t l, log_fmt_fn fmt)
+{
+    if (!arena)
+        return;
+
+    log_hdr_t h;
+    h.len = std::min(l, size - sizeof(log_hdr_t));
+    h.fmt = fmt;
+    size_t need = sizeof(log_hdr_t) + h.len;
 
     P(mutex);
-    if (len++ >= max)
+    h.nr = nr;
+    h.t = time(nullptr);
+    if (first_nr == nr)
+        head = tail = 0; /* empty, start over */
+    if (tail + need > size)
     {
-        len = max;
-        msgs.erase(msgs.begin());
+        /* doesn't fit at the end, drop what's still stored behind tail and wrap */
+        while ((first_nr != nr) && (head >= tail))
+            evict();
+        if (tail + sizeof(log_hdr_t) <= size)
+        {
+            log_hdr_t w{0, 0, wrap_mark, nullptr};
+            memcpy(arena + tail, &w, sizeof(log_hdr_t));
+        }
+        tail = 0;
     }
-    msgs.push_back(log_entry_t{nr++, time(nullptr), m});
+    while ((first_nr != nr) && (head >= tail) && (head < tail + need))
+        evict();
+    memcpy(arena + tail, &h, sizeof(log_hdr_t));
+    memcpy(arena + tail + sizeof(log_hdr_t), m, h.len);
+    tail += need;
+    nr++;
     V(mutex);
 }
 
-String get_log(myLogger::myLog_t where, bool ashtml)
+/* position of the record following the one at pos, must only be called if there is one */
+size_t myLogger::next_pos(size_t pos)
 {
-    myLogger *l;
-    switch (where)
+    log_hdr_t h;
+    read_hdr(pos, h);
+    pos += sizeof(log_hdr_t) + h.len;
+    if (pos + sizeof(log_hdr_t) > size)
+        return 0;
+    read_hdr(pos, h);
+    return (h.len == wrap_mark) ? 0 : pos;
+}
+
+/* drop oldest record, called with mutex held */
+void myLogger::evict(void)
+{
+    first_nr++;
+    if (first_nr == nr)
+        head = tail = 0;
+    else
+        head = next_pos(head);
+}
+
+/* copy the record following cursor c into e and advance c;
+   records evicted since the last call are skipped, returns false if there's nothing newer */
+bool myLogger::fetch(log_cursor_t &c, log_entry_t &e)
+{
+    log_hdr_t h;
+    P(mutex);
+    if (c.nr + 1 >= nr)
     {
-    case myLogger::LOG_MSG:
-        l = &msg_logger;
-        break;
-    case myLogger::LOG_SENSOR:
-        l = &sensor_logger;
-        break;
-    case myLogger::LOG_CIRCUIT:
-        l = &circuit_logger;
-        break;
-    default:
-        return "";
+        V(mutex);
+        return false;
+    }
+    if (c.nr < first_nr)
+    {
+        c.nr = first_nr;
+        c.pos = head;
+    }
+    else
+    {
+        c.nr++;
+        c.pos = next_pos(c.pos);
     }
-    return l->to_string(ashtml);
+    read_hdr(c.pos, h);
+    e.nr = h.nr;
+    e.t = h.t;
+    e.len = h.len;
+    if (h.fmt)
+    {
+        uint64_t rec[(max_rec_len + 7) / 8]; /* aligned copy for the formatter */
+        memcpy(rec, arena + c.pos + sizeof(log_hdr_t), h.len);
+        V(mutex);
+        e.len = std::min(h.fmt(rec, e.msg, sizeof(e.msg)), max_msg_len);
+        e.msg[e.len] = '\0';
+        return true;
+    }
+    memcpy(e.msg, arena + c.pos + sizeof(log_hdr_t), h.len);
+    V(mutex);
+    e.msg[e.len] = '\0';
+    return true;
+}
+
+String get_log(myLogger::myLog_t where, bool ashtml)
+{
+    myLogger *l = get_logger(where);
+    return l ? l->to_string(ashtml) : String("");
+}
+
+void stream_log(myLogger::myLog_t where, log_sink_fn sink, void *arg, bool ashtml)
+{
+    myLogger *l = get_logger(where);
+    if (l)
+        l->stream(sink, arg, ashtml);
 }
+
 String myLogger::to_string(bool ashtml)
 {
     String ret{""};
-    P(mutex);
-    for (auto t = msgs.begin(); t != msgs.end(); t++)
+    log_cursor_t c{0, 0};
+    log_entry_t e;
+    while (fetch(c, e))
     {
         if (ashtml)
         {
             ret += "<tr>";
-            ret += entry2String(*t, ashtml);
+            ret += entry2String(e, ashtml);
             ret += "</tr>";
         }
         else
         {
-            ret += entry2String(*t, ashtml);
+            ret += entry2String(e, ashtml);
             ret += '\n';
         }
     }
-    V(mutex);
     return ret;
 }
 
-/* should be called within a task context, as it delays to not flood mqtt over the net too quickly */
+/* hand out one formatted entry at a time, peak memory is one entry independent of the log size */
+void myLogger::stream(log_sink_fn sink, void *arg, bool ashtml)
+{
+    log_cursor_t c{0, 0};
+    log_entry_t e;
+    char buf[max_msg_len + 64];
+    while (fetch(c, e))
+    {
+        char ts[26];
+        ctime_r(&e.t, ts);
+        char *nl = strchr(ts, '\n');
+        if (nl)
+            *nl = '\0';
+        int n;
+        if (ashtml)
+            n = snprintf(buf, sizeof(buf), "<tr><td>%s</td><td>%s</td></tr>", ts, e.msg);
+        else
+            n = snprintf(buf, sizeof(buf), "%s: %s\n", ts, e.msg);
+        sink(buf, std::min(static_cast<size_t>(n), sizeof(buf) - 1), arg);
+    }
+}
+
+/* queues what is new since the last call, a full publish queue leaves the rest for the next period */
 void myLogger::publish(myMqtt *c)
 {
     if (!c)
@@ -168,36 +305,17 @@ void myLogger::publish(myMqtt *c)
 
     last_cycle = millis();
 
-    P(mutex);
-    std::list<log_entry_t> tmp = msgs;
-    V(mutex);
-    static unsigned long last_published = 0;
-
- //   int siz = tmp.size();
- //   int i = 0;
-    for (auto t = tmp.begin(); t != tmp.end(); t++)
-    {
-        time_t msgt = std::get<0>(*t);
-        if (msgt > last_published)
-        {
-#if 0            
-            char buf[256];
-            snprintf(buf, 256, "%d/%d - %s", i, siz, entry2String(*t, false).c_str());
-            printf("XXXXXXXXXXXXXXXSending: %s\n", buf);
-#endif
-            mqtt_publish(name.c_str(), entry2String(*t, false), c);
-            last_published = msgt;
-            delay(250);
-            //i++;
-        }
-    }
+    log_entry_t e;
+    log_cursor_t cur = pub_cursor;
+    while (fetch(cur, e) && mqtt_publish(name.c_str(), entry2String(e, false), c, 0, MQTT_EVENT))
+        pub_cursor = cur;
 }
 
 /* private functions */
-String myLogger::entry2String(log_entry_t &t, bool ashtml)
+String myLogger::entry2String(log_entry_t &e, bool ashtml)
 {
     String ret{""};
-    char *str = ctime(&(std::get<1>(t)));
+    char *str = ctime(&e.t);
     char *nl = strchr(str, '\n');
     if (nl)
         *nl = '\0';
@@ -207,14 +325,14 @@ String myLogger::entry2String(log_entry_t &t, bool ashtml)
         ret += str;
         ret += "</td>";
         ret += "<td>";
-        ret += std::get<2>(t);
+        ret += e.msg;
         ret += "</td>";
     }
     else
     {
         ret += str;
         ret += ": ";
-        ret += std::get<2>(t);
+        ret += e.msg;
     }
     return ret;
 }
@@ -29,23 +29,71 @@
 
 class myMqtt;
 
+typedef void (*log_sink_fn)(const char *s, size_t len, void *arg);
+/* renders a binary record as text, only when the log is read */
+typedef size_t (*log_fmt_fn)(const void *rec, char *buf, size_t len);
+
 class myLogger
 {
-    typedef std::tuple<unsigned long, time_t, String> log_entry_t;
-    std::list<log_entry_t> msgs;
-    String name;        /* used as topic prefix on mqtt */
-    size_t max, len;
+public:
+    static const size_t max_msg_len = 200; /* longer messages get truncated */
+    static const size_t max_rec_len = 32;  /* binary records */
+    typedef struct
+    {
+        unsigned long nr;
+        time_t t;
+        size_t len;
+        char msg[max_msg_len + 1];
+    } log_entry_t;
+    typedef struct
+    {
+        unsigned long nr; /* last record read, 0: nothing read yet */
+        size_t pos;       /* its position in the arena */
+    } log_cursor_t;
+
+private:
+    /* records are stored back to back in one arena: [log_hdr_t][payload], where
+       the payload is either unterminated text or, if fmt is set, a binary record;
+       a header with len == wrap_mark sends readers back to the start, as does an
+       arena tail too short for a header */
+    typedef struct
+    {
+        unsigned long nr;
+        time_t t;
+        uint16_t len;
+        log_fmt_fn fmt;
+    } log_hdr_t;
+    static const uint16_t wrap_mark = 0xffff;
+
+    uint8_t *arena;
+    size_t size;               /* arena size in bytes */
+    size_t head, tail;         /* oldest record, next free byte */
+    unsigned long first_nr, nr; /* oldest record present, next to be written */
+    String name;               /* used as topic prefix on mqtt */
     SemaphoreHandle_t mutex;
     unsigned long last_cycle, period;
-    unsigned long nr;
+    log_cursor_t pub_cursor{0, 0};
 
+    inline void read_hdr(size_t pos, log_hdr_t &h) { memcpy(&h, arena + pos, sizeof(log_hdr_t)); }
+    size_t next_pos(size_t pos);
+    void evict(void);
     String entry2String(log_entry_t &e, bool asthml = true);
+    void store(const void *m, size_t len, log_fmt_fn fmt);
+
 public:
-    myLogger(String name, size_t len = 100, unsigned long period = 5 * 60 * 1000);
-    ~myLogger() = default;
+    myLogger(String name, size_t budget = 4096, unsigned long period = 5 * 60 * 1000);
+    ~myLogger()
+    {
+        free(arena);
+        vSemaphoreDelete(mutex);
+    }
 
     void log(String m, bool publish = false);
+    void log(const char *m, size_t len, bool publish = false);
+    void log(log_fmt_fn fmt, const void *rec, size_t len);
+    bool fetch(log_cursor_t &c, log_entry_t &e);
     String to_string(bool ashtml = true);
+    void stream(log_sink_fn sink, void *arg, bool ashtml = true);
 
     void publish(myMqtt *client);
 
@@ -60,7 +108,9 @@ public:
 
 void log_msg(const char *s, myLogger::myLog_t where = myLogger::LOG_MSG, bool publish = false);
 void log_msg(const String s, myLogger::myLog_t where = myLogger::LOG_MSG, bool publish = false);
+void log_rec(log_fmt_fn fmt, const void *rec, size_t len, myLogger::myLog_t where);
 String get_log(myLogger::myLog_t w, bool ashtml = true);
+void stream_log(myLogger::myLog_t w, log_sink_fn sink, void *arg, bool ashtml = true);
 void setup_logger(void);
 void log_publish(void);
 
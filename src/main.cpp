@@ -21,6 +21,9 @@
 #include "ui.h"
 #include "io.h"
 #include "circuits.h"
+#include "acq.h"
+#include "history.h"
+#include "telemetry.h"
 
 /* some globals */
 myRange<float> ctrl_temprange1{21.0, 31.0};
@@ -29,7 +32,14 @@ myRange<float> ctrl_temprange2{28.0, 35.0};
 myRange<float> ctrl_humrange2{60.0, 90.0};
 myRange<struct tm> def_day{{0, 0, 7}, {0, 0, 18}};
 const int ui_ss_timeout = 30; /* screensaver timeout in s */
+const float circuit_watchdog = 60; /* circuit poll in s, sensor updates trigger circuits directly */
+const unsigned long remote_max_age = 10 * 60 * 1000; /* ms, fcce readings older than that are stale */
+const unsigned long relay_dwell = 60; /* s, min. on and off time of the relay outputs */
+const int relay_max_cph = 12;         /* relay switch ons per hour */
+const BaseType_t acq_core = tskNO_AFFINITY; /* sensor acquisition task, e.g. 0 to keep it off the loop() core */
+const unsigned long telemetry_frame_s = 0;  /* s, all values in one CBOR frame (telemetry.h), 0: a message per value */
 int glob_delay = 10;
+unsigned long lv_stall_us, lv_stall_max_us; /* longest lv_task_handler() run: since the last alive message, ever */
 
 // module locals
 #if 0
@@ -59,6 +69,7 @@ static myCircuit<genSensor> *circuit_dhum;
 //static myCircuit<tempSensor> *circuit_spare2;
 
 static uiElements *ui;
+static myHistory *history;
 
 void setup()
 {
@@ -66,9 +77,11 @@ void setup()
     Serial.printf("Formicula Control Centre (AC OTA) - V1.1\n");
 
     ui = setup_ui(ui_ss_timeout);
+    setup_acq(uxTaskPriorityGet(nullptr) + 1, acq_core); /* preempts rendering, reads are short */
     //setup_io();
     setup_wifi(ui);
     setup_mqtt(ui);
+    setup_telemetry(telemetry_frame_s);
     setup_logger();
 
     tswitch = new timeSwitch(ui, "Tag/Nacht");
@@ -79,10 +92,12 @@ void setup()
     io_fog = new ioDigitalIO(32);
     //io_spare2 = new ioDigitalIO(25);
     io_humswitch = new ioServo(14, false, 0, 120);
+    for (auto io : {io_tswitch, io_infrared, io_heater, io_fan, io_fog})
+        io->protect(relay_dwell, relay_dwell, relay_max_cph);
 
     circuit_timeswitch =
         new myCircuit<genSensor>(ui, "Zeitschalter", *tswitch, *io_tswitch,
-                                 5,
+                                 circuit_watchdog,
                                  myRange<float>{0.0, 0.0},
                                  myRange<float>{0.0, 0.0},
                                  ctrl_temprange1,
@@ -110,6 +125,13 @@ void setup()
     erde_hum = new remoteSensor{ui, "/ErdeHum", 65.0};
     berg_temp = new remoteSensor{ui, "/BergTemp", 27.0};
     berg_hum = new remoteSensor{ui, "/BergHum", 65.0};
+    history = new myHistory();
+    for (auto s : {fcce_temp, fcce_hum, erde_temp, erde_hum, berg_temp, berg_hum})
+    {
+        s->set_max_age(remote_max_age);
+        history->add(s);
+    }
+    setup_history(history);
 
 #if 0
     genSensor *avg_temp1 = new avgSensor(ui, "Total Average Temp", std::list<genSensor *>{berg_temp});
@@ -121,13 +143,13 @@ void setup()
 
     circuit_infrared =
         new myCircuit<genSensor>(ui, "Infrarot", *berg_temp, *io_infrared,
-                                 5,
+                                 circuit_watchdog,
                                  myRange<float>{27.0, 29.0},
                                  myRange<float>{24.0, 27.0},
                                  ctrl_temprange1);
     circuit_heater =
         new myCircuit<genSensor>(ui, "Heizmatte", *erde_temp, *io_heater,
-                                 5,
+                                 circuit_watchdog,
                                  myRange<float>{30.0, 31.0},
                                  myRange<float>{29.0, 30.0},
                                  ctrl_temprange2,
@@ -145,7 +167,7 @@ void setup()
                                  });
     circuit_fan =
         new myCircuit<genSensor>(ui, "Luefter", *berg_hum, *io_fan,
-                                 5,
+                                 circuit_watchdog,
                                  myRange<float>{72.0, 80.0},
                                  myRange<float>{72.0, 80.0},
                                  ctrl_humrange1,
@@ -161,10 +183,15 @@ void setup()
                                          last = millis();
                                      }
                                  }); // inverse logic for fan as hum drops
+#if 0
+    /* PID instead of the hysteresis, tuned on the sim plant (-P): rms error 0.54K -> 0.18K, overshoot
+       0.9K -> 0.5K, but 8 relay cycles/h instead of 4 with the 15 min window; on an SSR (ioPWM) 0.05K */
+    circuit_heater->set_pid(0.2, 1800, 300, 900);
+#endif
 
     circuit_dhum =
         new myCircuit<genSensor>(ui, "Nebler", *berg_hum, *io_fog,
-                                 5,
+                                 circuit_watchdog,
                                  myRange<float>{65.0, 68.0},
                                  myRange<float>{65.0, 68.0},
                                  ctrl_humrange1);
@@ -172,13 +199,13 @@ void setup()
 #if 0
     circuit_fog =
         new myCircuit<genSensor>(ui, "Nebel Berg", *hrem2, *io_fog,
-                                 5,
+                                 circuit_watchdog,
                                  myRange<float>{60.0, 65.0},
                                  myRange<float>{60.0, 65.0},
                                  ctrl_humrange);
     circuit_fog2 =
         new myCircuit<genSensor>(ui, "Nebel Erde", *hrem3, *io_fog,
-                                 5,
+                                 circuit_watchdog,
                                  myRange<float>{65.0, 80.0},
                                  myRange<float>{65.0, 80.0},
                                  ctrl_humrange);
@@ -197,7 +224,12 @@ void loop()
     loop_mqtt();
 
     ui->ui_P();        // mqtt & alarm handling is separate and if interaction with UI is needed, masterlock is needed.
+    unsigned long t = micros();
     lv_task_handler(); // most tasks (incl. local sensors) are managed by lvgl!
+    t = micros() - t;
     ui->ui_V();
+    gpio_commit(); /* the outputs staged by this round, mqtt and circuits, in one go */
+    lv_stall_us = std::max(lv_stall_us, t);
+    lv_stall_max_us = std::max(lv_stall_max_us, t);
     delay(glob_delay);
 }
\ No newline at end of file
@@ -0,0 +1,101 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __mpsc_h__
+#define __mpsc_h__
+
+#include <atomic>
+#include <stdint.h>
+
+/* bounded multi producer, single consumer ring, lock free: a producer claims a cell by a CAS on
+   the tail, fills it in place and hands it over by its sequence number; the consumer takes cells
+   in claim order once they are handed over. N a power of 2. A full ring refuses, nobody waits */
+template <typename T, uint32_t N>
+class mpscRing
+{
+    static_assert((N & (N - 1)) == 0, "mpscRing: N must be a power of 2");
+    struct cell_t
+    {
+        std::atomic<uint32_t> seq;
+        T val;
+    };
+    cell_t cells[N];
+    std::atomic<uint32_t> tail{0}; /* next cell to claim, producers */
+    uint32_t head = 0;             /* next cell to take, consumer */
+
+public:
+    mpscRing()
+    {
+        for (uint32_t i = 0; i < N; i++)
+            cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    /* fill(T &) writes the element in place, false: ring full */
+    template <typename F>
+    bool push(F fill)
+    {
+        uint32_t pos = tail.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell_t &c = cells[pos & (N - 1)];
+            int32_t d = static_cast<int32_t>(c.seq.load(std::memory_order_acquire) - pos);
+            if (d == 0)
+            {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    fill(c.val);
+                    c.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (d < 0)
+                return false; /* the consumer hasn't taken this cell of the last lap yet */
+            else
+                pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    /* consumer: use(T &) the oldest element, false: empty or its producer is still filling it */
+    template <typename F>
+    bool pop(F use)
+    {
+        cell_t &c = cells[head & (N - 1)];
+        if (static_cast<int32_t>(c.seq.load(std::memory_order_acquire) - (head + 1)) < 0)
+            return false;
+        use(c.val);
+        c.seq.store(head + N, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+    /* consumer: look at the i-th element after the oldest, false: not (yet) there */
+    template <typename F>
+    bool peek(uint32_t i, F use) const
+    {
+        const cell_t &c = cells[(head + i) & (N - 1)];
+        if ((i >= N) || (c.seq.load(std::memory_order_acquire) != head + i + 1))
+            return false;
+        use(c.val);
+        return true;
+    }
+
+    uint32_t size(void) const { return tail.load(std::memory_order_relaxed) - head; } /* consumer, about */
+    static constexpr uint32_t capacity(void) { return N; }
+};
+
+#endif
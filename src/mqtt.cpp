@@ -1,6 +1,8 @@
 #include <Arduino.h>
 #include <MQTT.h>
 #include <list>
+#include <vector>
+#include <algorithm>
 #include <ESPmDNS.h>
 #include <WiFiClientSecure.h>
 
@@ -8,13 +10,82 @@
 #include "circuits.h"
 #include "mqtt.h"
 #include "logger.h"
+#include "mpsc.h"
+#include "spool.h"
+#include "wifi.h"
 
 static uiElements *ui;
 
 static SemaphoreHandle_t mqtt_mutex; /* ensure exclusive access to mqtt client lib */
-static std::list<genSensor *> remote_sensors;
-static std::list<genCircuit *> circuits;
-static std::list<myMqtt *> mqtt_connections;
+/* append only, at setup: slot first, then the count, so the connection task reads without a lock */
+#define MQTT_MAX_CONNECTIONS 4
+static myMqtt *mqtt_connections[MQTT_MAX_CONNECTIONS];
+static std::atomic<int> no_connections{0};
+
+/* connection task -> ui thread */
+typedef struct
+{
+    myMqtt *c;
+    uint8_t ev;
+    uint16_t attempt;
+    uint32_t down_s; /* since the first failed attempt */
+    uint32_t wait_ms; /* until the next attempt */
+} mqtt_event_t;
+#define MQTT_EVENT_QUEUE_LEN 8
+#define MQTT_POLL_MS 250 /* connection task: notices a lost connection */
+static QueueHandle_t mqtt_events;
+static unsigned long events_dropped;
+static std::atomic<bool> mqtt_reboot{false}; /* given up on the broker, the connection task reboots */
+
+/* producers -> connection task, copied in place, no heap */
+typedef struct
+{
+    myMqtt *c;
+    uint32_t t; /* epoch at mqtt_publish(), 0: clock not set */
+    uint8_t cls;
+    uint8_t qos;
+    uint8_t len; /* payload bytes */
+    bool raw;    /* binary payload, not a string */
+    char topic[MQTT_TOPIC_LEN];
+    char payload[MQTT_PAYLOAD_LEN];
+} mqtt_msg_t;
+static_assert(MQTT_PAYLOAD_LEN < 256, "mqtt_msg_t: the payload length is a byte");
+typedef struct
+{
+    std::atomic<uint32_t> queued{0}, refused{0};   /* producers */
+    uint32_t coalesced = 0, sent = 0, spooled = 0; /* connection task */
+} mqtt_lane_stats_t;
+static mpscRing<mqtt_msg_t, MQTT_QUEUE_LEN> pub_queue;
+static mpscRing<mqtt_msg_t, MQTT_ALARM_QUEUE_LEN> alarm_queue;
+static mqtt_lane_stats_t pub_stats, alarm_stats;
+static mySpool *spool; /* fcce telemetry while the broker is away */
+
+/* topic -> sensor/circuit index, kept sorted by topic at registration time,
+   so dispatch is a binary search on the raw topic without building Strings */
+typedef struct
+{
+    String topic;
+    genSensor *sensor;
+    genCircuit *circuit;
+} topic_entry_t;
+static std::vector<topic_entry_t> topic_index;
+
+static bool topic_less(const topic_entry_t &e, const char *t) { return strcmp(e.topic.c_str(), t) < 0; }
+static bool topic_greater(const char *t, const topic_entry_t &e) { return strcmp(t, e.topic.c_str()) < 0; }
+
+static void topic_index_add(const String &t, genSensor *s, genCircuit *c)
+{
+    auto it = std::upper_bound(topic_index.begin(), topic_index.end(), t.c_str(), topic_greater);
+    topic_index.insert(it, topic_entry_t{t, s, c});
+}
+
+/* the entries of a topic, all next to each other */
+typedef std::vector<topic_entry_t>::const_iterator topic_iter_t;
+static std::pair<topic_iter_t, topic_iter_t> topic_range(const char *t)
+{
+    auto first = std::lower_bound(topic_index.cbegin(), topic_index.cend(), t, topic_less);
+    return std::make_pair(first, std::upper_bound(first, topic_index.cend(), t, topic_greater));
+}
 
 static myMqtt *fcce_connection;       /* specific for fcc/fcce application, must exist */
 static const char *client_id = "fcc"; /* identify fcc uniquely on mqtt */
@@ -31,14 +102,164 @@ static void fcce_upstream(String &t, String &payload);
 #define MQTT_LOG_PW "mqtt-pw"
 #endif
 
-/* doesn't work anyway, so commented out */
-//#define MQTT_MULTITHREADED
+static void mqtt_post(myMqtt *c, myMqtt::event_t ev, int attempt = 0, unsigned long down_s = 0, unsigned long wait_ms = 0)
+{
+    mqtt_event_t e{c, static_cast<uint8_t>(ev), static_cast<uint16_t>(attempt), static_cast<uint32_t>(down_s),
+                   static_cast<uint32_t>(wait_ms)};
+    if (xQueueSend(mqtt_events, &e, 0) != pdTRUE)
+        events_dropped++;
+}
+
+/* ui thread, lv_task_handler() */
+static void mqtt_drain(lv_task_t *t)
+{
+    mqtt_event_t e;
+    while (xQueueReceive(mqtt_events, &e, 0) == pdTRUE)
+    {
+        String n(e.c->get_name());
+        switch (e.ev)
+        {
+        case myMqtt::EV_CONNECTING:
+            ui->log_event(("mqtt connecting..." + String(e.attempt)).c_str());
+            break;
+        case myMqtt::EV_CONNECTED:
+            log_msg(n + " connected.");
+            mqtt_publish("/config", "Formicula Control Center - aloha...", e.c, 0, MQTT_EVENT);
+            break;
+        case myMqtt::EV_FAILED:
+            log_msg(n + " connection lost for: " + String(e.down_s) + "s, next attempt in " + String(e.wait_ms / 1000) + "s...");
+            if ((e.down_s > MQTT_GIVE_UP) && !mqtt_reboot)
+            {
+                io_guard_flush(); /* the relays' switch on counters survive the reboot */
+                log_msg("mqtt reconnections failed for 5min... rebooting", myLogger::LOG_MSG, true);
+                mqtt_reboot = true; /* after the next batch, that one still goes out */
+            }
+            break;
+        case myMqtt::EV_LOST:
+            log_msg(n + " connection lost.");
+            break;
+        }
+    }
+}
+
+static void copy_trunc(char *dst, const char *src, size_t len)
+{
+    size_t n = strnlen(src, len - 1);
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+}
+
+/* telemetry superseded by a later message of the same topic, further down the handed over run */
+template <typename R>
+static bool superseded(R &ring, const mqtt_msg_t &m)
+{
+    bool found = false;
+    for (uint32_t i = 1; !found; i++)
+        if (!ring.peek(i, [&](const mqtt_msg_t &n) { found = (n.c == m.c) && !strcmp(n.topic, m.topic); }))
+            break;
+    return found;
+}
+
+/* the oldest message of a lane, false if it's empty */
+template <typename R>
+static bool mqtt_send_next(R &ring, mqtt_lane_stats_t &st)
+{
+    return ring.pop([&](const mqtt_msg_t &m)
+                    {
+                        if ((m.cls == MQTT_TELEMETRY) && superseded(ring, m))
+                        {
+                            st.coalesced++;
+                            return;
+                        }
+                        myMqtt *c = (m.c ? m.c : fcce_connection);
+                        if ((m.cls == MQTT_TELEMETRY) && (c == fcce_connection) && !c->connected() && m.t &&
+                            spool && spool->put(m.t, m.topic, reinterpret_cast<const uint8_t *>(m.payload), m.len, m.raw))
+                        {
+                            st.spooled++;
+                            return;
+                        }
+                        if (c->send(m.topic, reinterpret_cast<const uint8_t *>(m.payload), m.len, m.qos))
+                            st.sent++;
+                    });
+}
+
+/* spooled messages once the broker is back, to /replay<topic> as "<epoch>,<payload>",
+   binary ones as they are, they carry their epoch */
+static void mqtt_replay(void)
+{
+    char topic[MQTT_TOPIC_LEN + 8] = "/replay", p[MQTT_PAYLOAD_LEN], payload[MQTT_PAYLOAD_LEN + 12];
+    const size_t pre = strlen(topic);
+    uint32_t t;
+    for (int n = 0; (n < MQTT_REPLAY_PER_BATCH) && fcce_connection->connected(); n++)
+    {
+        size_t len = sizeof(p);
+        bool raw;
+        if (!spool->peek(t, topic + pre, sizeof(topic) - pre, reinterpret_cast<uint8_t *>(p), len, raw))
+            break;
+        if (raw)
+            memcpy(payload, p, len);
+        else
+            len = std::min(static_cast<size_t>(snprintf(payload, sizeof(payload), "%lu,%.*s", static_cast<unsigned long>(t),
+                                                         static_cast<int>(len), p)),
+                           sizeof(payload) - 1);
+        if (!fcce_connection->send(topic, reinterpret_cast<const uint8_t *>(payload), len))
+            break;
+        spool->done();
+    }
+}
+
+/* one batch, bounded: alarms go first, before every other message, the spool last */
+static void mqtt_flush(void)
+{
+    int n;
+    for (n = 0; n < MQTT_QUEUE_LEN + MQTT_ALARM_QUEUE_LEN; n++)
+        if (!mqtt_send_next(alarm_queue, alarm_stats) && !mqtt_send_next(pub_queue, pub_stats))
+            break;
+    if (spool && (n < MQTT_QUEUE_LEN + MQTT_ALARM_QUEUE_LEN))
+        mqtt_replay();
+    if (spool)
+        spool->flush();
+}
+
+/* all the blocking of (re)connecting and publishing happens here, the connections are polled for losses */
+static void mqtt_conn_task(void *arg)
+{
+    for (;;)
+    {
+        unsigned long wait = MQTT_BATCH_MS;
+        for (int i = 0; i < no_connections; i++)
+            wait = std::min(wait, mqtt_connections[i]->manage());
+        mqtt_flush();
+        if (mqtt_reboot.exchange(false))
+        {
+            if (spool)
+                spool->flush(true); /* what's in RAM survives the reboot */
+            ESP.restart();
+        }
+        vTaskDelay(pdMS_TO_TICKS(wait));
+    }
+}
+
+/* first attempt right away, boot waits for it, then the connection task takes over */
+static void mqtt_add(myMqtt *c)
+{
+    c->manage();
+    if (no_connections >= MQTT_MAX_CONNECTIONS)
+    {
+        log_msg(String(c->get_name()) + ": too many mqtt connections.");
+        return;
+    }
+    mqtt_connections[no_connections] = c;
+    no_connections++;
+}
 
 void setup_mqtt(uiElements *u)
 {
     ui = u;
     mqtt_mutex = xSemaphoreCreateMutex();
     V(mqtt_mutex);
+    mqtt_events = xQueueCreate(MQTT_EVENT_QUEUE_LEN, sizeof(mqtt_event_t));
+    lv_task_create(mqtt_drain, 100, LV_TASK_PRIO_LOW, nullptr);
 
     while (true)
     {
@@ -53,31 +274,70 @@ void setup_mqtt(uiElements *u)
             delay(500);
         }
     }
+    spool = new mySpool();
+    if (!spool->begin())
+    {
+        delete spool;
+        spool = nullptr;
+    }
+    mqtt_add(fcce_connection);
+    TaskHandle_t handle;
+    /* core 0 with the WiFi stack, a TLS handshake doesn't take cycles from loop() */
+    xTaskCreatePinnedToCore(mqtt_conn_task, "mqtt-conn", 6000, nullptr, 1, &handle, 0);
 }
 
+/* connected clients only, the connection task deals with the others */
 void loop_mqtt()
 {
-    std::for_each(mqtt_connections.begin(), mqtt_connections.end(),
-                  [](myMqtt *c)
-                  {
-                      if (c->connected())
-                          c->loop();
-                      else
-                          c->reconnect();
-                  });
+    for (int i = 0; i < no_connections; i++)
+        if (mqtt_connections[i]->connected())
+            mqtt_connections[i]->loop();
 }
 
-void mqtt_publish(String topic, String msg, myMqtt *c, int qos)
+/* any task, lock free, no system call */
+static bool mqtt_enqueue(const char *topic, const uint8_t *data, size_t len, bool raw, myMqtt *c, int qos, mqtt_class_t cls)
 {
-    P(mqtt_mutex); /* ensure mut-excl acces into MQTTClient library */
-    myMqtt *client = (c ? c : fcce_connection);
-    client->publish(topic, msg, qos);
-    V(mqtt_mutex);
+    uint32_t now = 0;
+    if (time_obj)
+    {
+        time_snapshot_t ts = time_obj->now();
+        now = ts.valid ? ts.now : 0;
+    }
+    auto fill = [&](mqtt_msg_t &m)
+    {
+        m.c = c;
+        m.t = now;
+        m.cls = cls;
+        m.qos = qos;
+        m.len = len;
+        m.raw = raw;
+        copy_trunc(m.topic, topic, sizeof(m.topic));
+        memcpy(m.payload, data, len);
+    };
+    mqtt_lane_stats_t &st = (cls == MQTT_ALARM) ? alarm_stats : pub_stats;
+    bool ok = (cls == MQTT_ALARM) ? alarm_queue.push(fill) : pub_queue.push(fill);
+    (ok ? st.queued : st.refused)++;
+    return ok;
 }
 
-void mqtt_P(void)
+bool mqtt_publish(const char *topic, const char *msg, myMqtt *c, int qos, mqtt_class_t cls)
 {
-    P(mqtt_mutex);
+    return mqtt_enqueue(topic, reinterpret_cast<const uint8_t *>(msg), strnlen(msg, MQTT_PAYLOAD_LEN - 1), false, c, qos, cls);
+}
+
+bool mqtt_publish_raw(const char *topic, const uint8_t *data, size_t len, myMqtt *c, int qos, mqtt_class_t cls)
+{
+    if (len > MQTT_PAYLOAD_LEN)
+    {
+        ((cls == MQTT_ALARM) ? alarm_stats : pub_stats).refused++;
+        return false;
+    }
+    return mqtt_enqueue(topic, data, len, true, c, qos, cls);
+}
+
+bool mqtt_P(void)
+{
+    return xSemaphoreTake(mqtt_mutex, 0) == pdTRUE;
 }
 
 void mqtt_V(void)
@@ -88,13 +348,20 @@ void mqtt_V(void)
 /* sensors register to be called when topic /fcce/<SENSORNAME> appears */
 void mqtt_register_sensor(genSensor *s)
 {
-    remote_sensors.push_back(s);
+    topic_index_add(s->get_name(), s, nullptr);
 }
 
 /* circuit register to be called when topic /fcce/<CIRCUITNAME> appears */
 void mqtt_register_circuit(genCircuit *s)
 {
-    circuits.push_back(s);
+    topic_index_add(String("/") + s->get_name(), nullptr, s);
+}
+
+void mqtt_topic_lookup(const char *topic, void (*fn)(genSensor *s, genCircuit *c, void *arg), void *arg)
+{
+    auto r = topic_range(topic);
+    for (auto e = r.first; e != r.second; e++)
+        fn(e->sensor, e->circuit, arg);
 }
 
 myMqtt *mqtt_register_logger(void)
@@ -104,10 +371,12 @@ myMqtt *mqtt_register_logger(void)
         try
         {
 #ifdef MQTT_LOG_LOCAL
-            return new myMqttLocal(client_id, MQTT_LOG, nullptr, "log broker", 1883, MQTT_LOG_USER, MQTT_LOG_PW);
+            myMqtt *c = new myMqttLocal(client_id, MQTT_LOG, nullptr, "log broker", 1883, MQTT_LOG_USER, MQTT_LOG_PW);
 #else
-            return new myMqttSec(client_id, MQTT_LOG, nullptr, "log broker", 8883, MQTT_LOG_USER, MQTT_LOG_PW);
+            myMqtt *c = new myMqttSec(client_id, MQTT_LOG, nullptr, "log broker", 8883, MQTT_LOG_USER, MQTT_LOG_PW);
 #endif
+            mqtt_add(c);
+            return c;
         }
         catch (String msg)
         {
@@ -131,134 +400,134 @@ myMqtt::myMqtt(const char *id, upstream_fn f, const char *n, const char *user, c
     V(mutex);
 }
 
+/* loop() thread, connected: a failing loop() hands the client over to the connection task;
+   a round with a publish in flight is skipped, loop() doesn't wait for the wire */
 void myMqtt::loop(void)
 {
-    //    if (!connected())
-    //        reconnect();
-    P(mutex);
-    client->loop();
+    bool gone = false;
+    if (xSemaphoreTake(mutex, 0) != pdTRUE)
+    {
+        skipped++;
+        return;
+    }
+    if ((conn_stat == CONN) && !(client->loop() && client->connected()))
+    {
+        conn_stat = NO_CONN;
+        lost++;
+        gone = true;
+    }
     V(mutex);
+    if (gone)
+        mqtt_post(this, EV_LOST);
 }
 
-#ifdef MQTT_MULTITHREADED
-static void mqtt_connect_wrapper(void *arg)
+/* connection task */
+unsigned long myMqtt::manage(void)
 {
-    myMqtt *p = static_cast<myMqtt *>(arg);
-    log_msg(String(p->get_name()) + "mqtt connection task launched...");
-    while (!p->connected())
+    if (conn_stat == CONN)
+        return MQTT_POLL_MS;
+    if (conn_stat == NO_CONN) /* lost or never connected: take over, after a publish in flight */
     {
-        p->reconnect_body();
+        P(mutex);
+        conn_stat = RECONN;
+        V(mutex);
+        next_try = millis() + backoff;
     }
-    log_msg(String(p->get_name()) + "mqtt connection task wating to be killed.");
-    while (1)
+    unsigned long now = millis();
+    if (static_cast<long>(next_try - now) > 0)
+        return next_try - now;
+    if (!connection_wd)
+        connection_wd = now;
+    reconnects++;
+    mqtt_post(this, EV_CONNECTING, reconnects);
+    client->disconnect(); /* whatever is left of the old socket */
+    bool ok = connect();
+    unsigned long t = millis();
+    connect_max_ms = std::max(connect_max_ms, t - now);
+    if (ok)
     {
-        delay(1000); /* wait to be killed */
-        p->cleanup();
+        client->subscribe("fcce/#", 0);
+        reconnects = 0;
+        connection_wd = 0;
+        backoff = 0;
+        connects++;
+        P(mutex);
+        conn_stat = CONN;
+        V(mutex);
+        mqtt_post(this, EV_CONNECTED);
+        return MQTT_POLL_MS;
     }
+    backoff = backoff ? std::min(2 * backoff, static_cast<unsigned long>(MQTT_BACKOFF_MAX)) : MQTT_BACKOFF_MIN;
+    next_try = t + backoff;
+    mqtt_post(this, EV_FAILED, reconnects, (t - connection_wd) / 1000, backoff);
+    return backoff;
 }
-#endif
 
-bool myMqtt::connected(void)
+String myMqtt::stats(void)
 {
-    bool r;
-    P(mutex);
-    r = client->connected();
-    conn_stat = (r ? CONN : NO_CONN);
-    V(mutex);
-    return r;
+    static const char *st[] = {"down", "connected", "connecting"};
+    return String(name) + ": " + st[conn_stat] + ", " + String(connects) + " connects, " + String(lost) +
+           " lost, longest connect " + String(connect_max_ms) + "ms, " + String(dropped) + " msgs dropped while down, " +
+           String(skipped) + " loop() rounds skipped for a publish";
 }
 
-void myMqtt::reconnect(void)
+void mqtt_stats(log_sink_fn sink, void *arg)
 {
-#ifdef MQTT_MULTITHREADED
-    //printf("reconnect requested...%p, connstat = %d, th = %p\n", this, conn_stat, th);
-    P(mutex);
-    if ((conn_stat != CONN) &&
-        (th == nullptr))
+    char buf[128];
+    for (int i = 0; i < no_connections; i++)
     {
-        int prio = uxTaskPriorityGet(nullptr);
-        printf("reconnect requested...creating task for %p, priority = %d\n", this, prio);
-        conn_stat = RECONN; /* safe as wrapped by mutex */
-        xTaskCreate(mqtt_connect_wrapper, "mqtt-conn", 4000, this, prio /*configMAX_PRIORITIES - 1*/, &th);
+        String c = mqtt_connections[i]->stats() + "\n";
+        sink(c.c_str(), c.length(), arg);
     }
-    V(mutex);
-#endif
-    reconnect_body();
-}
-
-void myMqtt::cleanup(void)
-{
-#ifdef MQTT_MULTITHREADED
-    P(mutex);
-    if (conn_stat == CONN && th)
+    int n = snprintf(buf, sizeof(buf), "%lu events dropped\n", events_dropped);
+    sink(buf, n, arg);
+    for (auto l : {std::make_pair("queue", &pub_stats), std::make_pair("alarms", &alarm_stats)})
     {
-        log_msg(String(name) + " killing mqtt task... ");
-        TaskHandle_t t = th;
-        th = nullptr;
-        V(mutex);
-        vTaskDelete(t);
-        return;
+        n = snprintf(buf, sizeof(buf), "%s: %lu queued, %lu refused, %lu coalesced, %lu sent, %lu spooled\n", l.first,
+                     static_cast<unsigned long>(l.second->queued), static_cast<unsigned long>(l.second->refused),
+                     static_cast<unsigned long>(l.second->coalesced), static_cast<unsigned long>(l.second->sent),
+                     static_cast<unsigned long>(l.second->spooled));
+        sink(buf, n, arg);
     }
-    V(mutex);
-    printf("cleanup done.\n");
-#endif
+    String sp = "spool: " + (spool ? spool->stats() : String("off")) + "\n";
+    sink(sp.c_str(), sp.length(), arg);
 }
 
-void myMqtt::reconnect_body(void)
+unsigned long mqtt_spool_pending(void)
 {
+    return spool ? spool->pending() : 0;
+}
 
-    // Loop until we're reconnected
-    if (client->connected())
-    {
-        set_conn_stat(CONN);
-        log_msg("reconnect_body, client is connected - shouldn't happen here");
-    }
-    if ((millis() - last) < 2500)
-    {
-        delay(500);
-        return;
-    }
-    if (connection_wd == 0)
-        connection_wd = millis();
-    last = millis();
-    reconnects++;
-    //log_msg("fcc not connected, attempting MQTT connection..." + String(reconnects));
-    ui->log_event(("mqtt connecting..." + String(reconnects)).c_str());
+unsigned long mqtt_refused(void)
+{
+    return pub_stats.refused + alarm_stats.refused;
+}
 
-    // Attempt to connect
-    if (connect())
-    {
-        reconnects = 0;
-        connection_wd = 0;
-        log_msg("fcc connected.");
-        P(mutex);
-        client->subscribe("fcce/#", 0);
-        V(mutex);
-        mqtt_publish("/config", "Formicula Control Center - aloha...", this);
-        set_conn_stat(CONN);
-    }
-    else
-    {
-        unsigned long t1 = (millis() - connection_wd) / 1000;
-        log_msg(String("Connection lost for: ") + String(t1) + "s...");
-        if (t1 > 300)
-        {
-            log_msg("mqtt reconnections failed for 5min... rebooting", myLogger::LOG_MSG, true);
-            delay(250);
-            ESP.restart();
-        }
-    }
+/* connection task, the client mutex (and the lib's) held for one publish */
+bool myMqtt::send(const char *t, const char *p, int qos)
+{
+    return send(t, reinterpret_cast<const uint8_t *>(p), strlen(p), qos);
 }
 
-void myMqtt::publish(String &t, String &p, int qos)
+bool myMqtt::send(const char *t, const uint8_t *p, size_t len, int qos)
 {
+    char topic[MQTT_TOPIC_LEN + 16];
+    snprintf(topic, sizeof(topic), "%s%s", client_id, t);
+    P(mqtt_mutex); /* not while the portal is served */
     P(mutex);
-    if (!client->connected() ||
-        !client->publish(client_id + t, p, false, qos))
+    if (conn_stat != CONN)
     {
-        log_msg(String(name) + " mqtt failed, rc=" + String(client->lastError()) + ", discarding: " + t + ":" + p);
+        dropped++;
+        V(mutex);
+        V(mqtt_mutex);
+        return false;
     }
+    bool ok = client->publish(topic, reinterpret_cast<const char *>(p), len, false, qos);
     V(mutex);
+    V(mqtt_mutex);
+    if (!ok)
+        log_msg(String(name) + " mqtt failed, rc=" + String(client->lastError()) + ", discarding: " + t + " (" + String(len) + " bytes)");
+    return ok;
 }
 
 void myMqtt::register_callback(upstream_fn fn)
@@ -274,23 +543,18 @@ myMqttSec::myMqttSec(const char *id, const char *server, upstream_fn fn, const c
     client = new MQTTClient{256};
     client->begin(server, port, net);
     client->onMessage(up_fn);
-    mqtt_connections.push_back(this);
-    log_msg(String(name) + " mqtt client created." + String{(unsigned int)mutex});
+    log_msg(String(name) + " mqtt client created." + String{(uintptr_t)mutex});
 
     delay(50);
 }
 
 bool myMqttSec::connect(void)
 {
-    P(mutex);
-    if (!client->connected() &&
-        !client->connect(id, user, pw))
+    if (!client->connect(id, user, pw))
     {
         log_msg(String(name) + " mqtt connect failed, rc=" + String(client->lastError()));
-        V(mutex);
         return false;
     }
-    V(mutex);
     return true;
 }
 
@@ -307,8 +571,6 @@ myMqttLocal::myMqttLocal(const char *id, const char *server, upstream_fn fn, con
 */
     client->begin(server, port, net);
     client->onMessage(up_fn);
-
-    mqtt_connections.push_back(this);
     log_msg(String(name) + " mqtt client created.");
 
     delay(50);
@@ -321,24 +583,21 @@ char *myMqttLocal::get_id(void)
 }
 bool myMqttLocal::connect(void)
 {
-    P(mqtt_mutex);
-    if (!client->connected() &&
-        !client->connect(id, "hugo", "schrammel"))
+    if (!client->connect(id, "hugo", "schrammel"))
     {
         log_msg(String(name) + " mqtt connect failed, rc=" + String(client->lastError()));
-        V(mqtt_mutex);
         return false;
     }
-    V(mqtt_mutex);
     return true;
 }
 
 static void fcce_upstream(String &t, String &payload)
 {
     //log_msg("fcc mqtt cb: " + t + ":" + payload);
-    String topic = t.substring(t.indexOf('/'));
+    int sep = t.indexOf('/');
+    const char *topic = t.c_str() + ((sep < 0) ? t.length() : sep);
     // check if config things arriving
-    if (topic.startsWith("/config"))
+    if (strncmp(topic, "/config", 7) == 0)
     {
         ui->update_config(payload);
     }
@@ -348,7 +607,7 @@ static void fcce_upstream(String &t, String &payload)
     if (payload.startsWith("<ERR>"))
     {
         ui->ui_P();
-        ui->log_event((topic + payload).c_str(), myLogger::LOG_SENSOR);
+        ui->log_event((String(topic) + payload).c_str(), myLogger::LOG_SENSOR);
         //ui->log_event(payload.c_str(), myLogger::LOG_SENSOR);
         ui->ui_V();
         //log_msg(topic + payload);
@@ -356,37 +615,33 @@ static void fcce_upstream(String &t, String &payload)
         goto out;
     }
 
-    /* check circuit controlled via mqtt */
-    std::for_each(circuits.begin(), circuits.end(),
-                  [&](genCircuit *c)
-                  {
-                      if ((String("/") + c->get_name()) == topic)
-                      {
-                          ui->ui_P();
-                          if (!strchr(payload.c_str(), '1'))
-                              if (!strchr(payload.c_str(), '0'))
-                                  log_msg("Circuit " + c->get_name() + " unknown request: " + payload);
-                              else
-                                  c->io_set(LOW, true, true);
-                          else
-                              c->io_set(HIGH, true, true);
-                          ui->ui_V();
-                      }
-                  });
-
-    /* check sensor update, find the corresponding sensor by name & update */
-    std::for_each(remote_sensors.begin(), remote_sensors.end(),
-                  [&](genSensor *sensor)
-                  {
-                      //log_msg(String("checking '") + topic + "' against '" + sensor->get_name() + '\'');
-                      if (*sensor == topic)
-                      {
-                          ui->ui_P();
-                          sensor->update_data(strtof(payload.c_str(), NULL));
-                          ui->ui_V();
-                          fcce_alive = true;
-                      }
-                  });
+    /* look up circuits controlled via mqtt and sensors by topic & update */
+    {
+        auto r = topic_range(topic);
+        for (auto e = r.first; e != r.second; e++)
+        {
+            if (e->circuit)
+            {
+                genCircuit *c = e->circuit;
+                ui->ui_P();
+                if (!strchr(payload.c_str(), '1'))
+                    if (!strchr(payload.c_str(), '0'))
+                        log_msg("Circuit " + c->get_name() + " unknown request: " + payload);
+                    else
+                        c->io_set(LOW, true, true);
+                else
+                    c->io_set(HIGH, true, true);
+                ui->ui_V();
+            }
+            if (e->sensor)
+            {
+                ui->ui_P();
+                e->sensor->update_data(strtof(payload.c_str(), NULL));
+                ui->ui_V();
+                fcce_alive = true;
+            }
+        }
+    }
 out:
     if (fcce_alive)
         ui->update_config(String("/sensor-alive"));
@@ -21,17 +21,46 @@
 
 #include <WiFiClient.h>
 #include <WiFiClientSecure.h>
+#include <atomic>
 
 #include "ui.h"
 
+/* connection manager: a task of its own connects and reconnects, backing off exponentially from
+   MQTT_BACKOFF_MIN to MQTT_BACKOFF_MAX, so a broker outage never blocks loop(); conn_stat says who
+   owns the client: CONN the loop() thread (loop) and the connection task (publish) under the client
+   mutex, taken per publish, otherwise the connection task alone. Given up on the broker for
+   MQTT_GIVE_UP, the connection task flushes the spool and reboots.
+   Progress goes back to the ui thread as events through a queue */
+#define MQTT_BACKOFF_MIN 2500  /* ms */
+#define MQTT_BACKOFF_MAX 60000 /* ms */
+#define MQTT_GIVE_UP 300       /* s without a connection, reboot */
+
+/* publish queue: mqtt_publish() only copies the message into a lock free ring, the connection task
+   sends in batches every MQTT_BATCH_MS; telemetry coalesces per topic (last value wins), events keep
+   every message in order, alarms have a lane of their own which goes first. A full lane refuses
+   the message and counts it, producers never wait for the network */
+typedef enum { MQTT_TELEMETRY, MQTT_EVENT, MQTT_ALARM } mqtt_class_t;
+#define MQTT_QUEUE_LEN 32       /* telemetry and events, power of 2 */
+#define MQTT_ALARM_QUEUE_LEN 8  /* alarms, power of 2 */
+#define MQTT_BATCH_MS 100
+#define MQTT_REPLAY_PER_BATCH 2 /* spooled messages (spool.h), 20/s after a reconnect */
+#define MQTT_TOPIC_LEN 64       /* longer ones are truncated, like payloads */
+#define MQTT_PAYLOAD_LEN 232
+
 class myMqtt
 {
+public:
     typedef enum { NO_CONN, CONN, RECONN } conn_stat_t;
-    conn_stat_t conn_stat = NO_CONN;
-    TaskHandle_t th = nullptr;
-    int reconnects = 0;
-    unsigned long last = 0;
-    unsigned long connection_wd = 0;
+    typedef enum { EV_CONNECTING, EV_CONNECTED, EV_FAILED, EV_LOST } event_t;
+
+private:
+    std::atomic<int> conn_stat{NO_CONN};
+    int reconnects = 0;               /* attempts since the last connection */
+    unsigned long next_try = 0;       /* millis() */
+    unsigned long backoff = 0;        /* ms, 0: try right away */
+    unsigned long connection_wd = 0;  /* millis() of the first failed attempt */
+    uint32_t connects = 0, lost = 0, dropped = 0, skipped = 0; /* statistics */
+    unsigned long connect_max_ms = 0;
 
 protected:
     SemaphoreHandle_t mutex;
@@ -43,20 +72,22 @@ protected:
     typedef void (*upstream_fn)(String &topic, String &payload);
     upstream_fn up_fn;
 
+    virtual bool connect(void) = 0; /* blocking, connection task only */
+
 public:
     myMqtt(const char *id, upstream_fn up_fn = nullptr, const char *name = nullptr, const char *user = "", const char *pw = "");
     virtual ~myMqtt() { delete client; vSemaphoreDelete(mutex); log_msg(String(name) + " destroyed.");};
 
-    void set_conn_stat(conn_stat_t s) { P(mutex); conn_stat = s; V(mutex); }
     inline const char *get_name(void) { return name; }
     void loop(void);
-    bool connected(void);
-    void reconnect(void);
-    void cleanup(void);
-    void reconnect_body(void);
-    virtual bool connect(void) = 0;
+    inline bool connected(void) { return conn_stat == CONN; }
+    /* connection task: one attempt if due, returns ms until the next one is due */
+    unsigned long manage(void);
     void register_callback(upstream_fn fn);
-    void publish(String &topic, String &payload, int qos = 0);
+    /* connection task, takes the client mutex for the one publish */
+    bool send(const char *topic, const char *payload, int qos = 0);
+    bool send(const char *topic, const uint8_t *payload, size_t len, int qos = 0);
+    String stats(void);
 };
 
 class myMqttSec : public myMqtt
@@ -67,6 +98,7 @@ public:
     myMqttSec(const char *id, const char *server, upstream_fn up_fn = nullptr, const char *name = nullptr, int port = 8883, const char *user = "", const char *pw = "");
     virtual ~myMqttSec() = default;
 
+protected:
     virtual bool connect(void) override;
 };
 
@@ -79,18 +111,39 @@ public:
     myMqttLocal(const char *id, const char *server, upstream_fn up_fn = nullptr, const char *name = nullptr, int port = 1883, const char *user = "", const char *pw = "");
     virtual ~myMqttLocal() = default;
 
-    virtual bool connect(void) override;
     char *get_id(void);
+
+protected:
+    virtual bool connect(void) override;
 };
 
 void setup_mqtt(uiElements *ui);
 void loop_mqtt(void);
 void mqtt_register_sensor(genSensor *s);
 void mqtt_register_circuit(genCircuit *s);
+/* the sensors and circuits fcce/<topic> goes to, as fcce_upstream() finds them */
+void mqtt_topic_lookup(const char *topic, void (*fn)(genSensor *s, genCircuit *c, void *arg), void *arg);
 myMqtt *mqtt_register_logger(void);
 bool mqtt_connect(MQTTClient *c);
-void mqtt_publish(String topic, String msg, myMqtt *c = nullptr, int qos = 0);
-void mqtt_P(void);
+/* queue a message for c (nullptr: the fcce broker), false if its lane is full */
+bool mqtt_publish(const char *topic, const char *msg, myMqtt *c = nullptr, int qos = 0, mqtt_class_t cls = MQTT_TELEMETRY);
+static inline bool mqtt_publish(const String &topic, const String &msg, myMqtt *c = nullptr, int qos = 0,
+                                mqtt_class_t cls = MQTT_TELEMETRY)
+{
+    return mqtt_publish(topic.c_str(), msg.c_str(), c, qos, cls);
+}
+/* a binary payload, e.g. a telemetry frame; false if it's longer than MQTT_PAYLOAD_LEN or the lane is full */
+bool mqtt_publish_raw(const char *topic, const uint8_t *data, size_t len, myMqtt *c = nullptr, int qos = 0,
+                      mqtt_class_t cls = MQTT_TELEMETRY);
+/* the mqtt client lib to the portal, false while a publish is in flight: skip the round */
+bool mqtt_P(void);
 void mqtt_V(void);
+/* per connection: state, connects, losses, longest connect, messages dropped while down;
+   per lane: queued, refused (full), coalesced, sent, spooled; the spool - one line each to sink */
+void mqtt_stats(log_sink_fn sink, void *arg);
+/* spooled messages not replayed yet */
+unsigned long mqtt_spool_pending(void);
+/* messages refused by a full lane, both lanes */
+unsigned long mqtt_refused(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,65 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __pid_h__
+#define __pid_h__
+
+#include <math.h>
+#include <algorithm>
+
+/* PID with the output in [0, 1], a duty cycle: u = kp * (e + I / ti + td * dPV/dt), e = sp - pv.
+   The derivative acts on the measurement (no kick on setpoint steps) and is low pass filtered,
+   sensors come in 0.1 steps. Anti-windup: the integral doesn't grow while the output is saturated
+   in the direction of the error, and never exceeds what the output range needs */
+class myPID
+{
+    const float kp, ti, td; /* 1/K, s, s */
+    const float d_tau;      /* derivative filter time constant, s */
+    float integral = 0;     /* as output share */
+    float d_filt = 0;
+    float last_pv = NAN;
+
+public:
+    myPID(float p, float i, float d) : kp(p), ti(i), td(d), d_tau(std::max(d / 4, 30.0f)) {}
+    ~myPID() = default;
+
+    void reset(void)
+    {
+        integral = 0;
+        d_filt = 0;
+        last_pv = NAN;
+    }
+    /* dt: s since the last call, 0 for the first one */
+    float update(float sp, float pv, float dt)
+    {
+        float e = sp - pv;
+        if (!isnan(last_pv) && (dt > 0))
+            d_filt += (-(pv - last_pv) / dt - d_filt) * std::min(1.0f, dt / d_tau);
+        last_pv = pv;
+        float pd = kp * (e + td * d_filt);
+        float i = (ti > 0) ? integral + kp * e * dt / ti : 0;
+        float u = pd + i;
+        if (((u > 1) && (e > 0)) || ((u < 0) && (e < 0)))
+            i = integral; /* saturated, hold */
+        integral = std::max(0.0f, std::min(1.0f, i));
+        return std::max(0.0f, std::min(1.0f, pd + integral));
+    }
+    float get_integral(void) const { return integral; }
+};
+
+#endif
@@ -0,0 +1,158 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <list>
+#include <algorithm>
+#include "rollup.h"
+#include "ui.h"
+#include "wifi.h"
+
+const uint32_t myRollup::res[LEVELS] = {60, 3600, 86400};
+const uint32_t myRollup::len[LEVELS] = {60, 24, 31};
+
+static std::list<myRollup *> rollups;
+static SemaphoreHandle_t rollup_mutex;
+
+myRollup::myRollup(const String &n, bool d) : name(n), duty(d)
+{
+    if (!rollup_mutex)
+    {
+        rollup_mutex = xSemaphoreCreateMutex();
+        V(rollup_mutex);
+    }
+    for (int l = 0; l < LEVELS; l++)
+        for (uint32_t i = 0; i < len[l]; i++)
+            clear(ring[l][i]);
+    P(rollup_mutex);
+    rollups.push_back(this);
+    V(rollup_mutex);
+}
+
+void myRollup::merge(stat_t &s, const stat_t &o)
+{
+    if (!o.weight)
+        return;
+    s.min = (s.weight && (s.min <= o.min)) ? s.min : o.min;
+    s.max = (s.weight && (s.max >= o.max)) ? s.max : o.max;
+    s.sum += o.sum;
+    s.weight += o.weight;
+}
+
+/* mutex held; moving the head on clears the buckets it passes, at most one ring's worth */
+void myRollup::put(int l, uint32_t t, float v, float w)
+{
+    uint32_t p = t / res[l];
+    if (p > head[l])
+    {
+        for (uint32_t q = head[l] + 1; (q <= p) && (q <= head[l] + len[l]); q++)
+            clear(ring[l][q % len[l]]);
+        head[l] = p;
+    }
+    else if (head[l] - p >= len[l])
+        return;
+    merge(ring[l][p % len[l]], stat_t{v, v, v * w, w});
+}
+
+void myRollup::add(time_t t, float v)
+{
+    if (isnan(v) || (t < TIME_VALID_EPOCH))
+        return;
+    P(rollup_mutex);
+    for (int l = 0; l < LEVELS; l++)
+        put(l, t, v, 1);
+    V(rollup_mutex);
+}
+
+void myRollup::add_span(time_t from, time_t to, float v)
+{
+    if (isnan(v) || (from < TIME_VALID_EPOCH) || (to <= from))
+        return;
+    P(rollup_mutex);
+    for (int l = 0; l < LEVELS; l++)
+    {
+        uint32_t t = from, end = to, span = res[l] * len[l];
+        if (end - t > span) /* older parts would fall off right away */
+            t = end - span;
+        while (t < end)
+        {
+            uint32_t e = std::min(end, (t / res[l] + 1) * res[l]);
+            put(l, t, v, e - t);
+            t = e;
+        }
+    }
+    V(rollup_mutex);
+}
+
+myRollup::stat_t myRollup::get(level_t l, time_t t) const
+{
+    stat_t s{NAN, NAN, 0, 0};
+    uint32_t p = t / res[l];
+    P(rollup_mutex);
+    if ((p <= head[l]) && (head[l] - p < len[l]))
+        s = ring[l][p % len[l]];
+    V(rollup_mutex);
+    return s;
+}
+
+myRollup::stat_t myRollup::window(level_t l, int n, time_t now) const
+{
+    stat_t s{NAN, NAN, 0, 0};
+    for (int i = 0; i < std::min(n, static_cast<int>(len[l])); i++)
+        merge(s, get(l, now - i * res[l]));
+    return s;
+}
+
+String myRollup::to_string(time_t now) const
+{
+    static const struct
+    {
+        const char *what;
+        level_t l;
+        int n;
+    } windows[] = {{"1h", MINUTES, 60}, {"24h", HOURS, 24}, {"30d", DAYS, 30}};
+    String s = name + ":";
+    for (auto &w : windows)
+    {
+        stat_t st = window(w.l, w.n, now);
+        char buf[64];
+        if (!st.weight)
+            snprintf(buf, sizeof(buf), " %s -", w.what);
+        else if (duty)
+            snprintf(buf, sizeof(buf), " %s on %.0f%% (%.1fh)", w.what, 100 * st.sum / st.weight, st.sum / 3600);
+        else
+            snprintf(buf, sizeof(buf), " %s %.1f/%.1f/%.1f", w.what, st.min, st.sum / st.weight, st.max);
+        s += buf;
+    }
+    return s;
+}
+
+void rollup_stats(log_sink_fn sink, void *arg)
+{
+    static const char no_time[] = "no time yet\n";
+    time_t now = time(nullptr);
+    if (now < TIME_VALID_EPOCH)
+    {
+        sink(no_time, sizeof(no_time) - 1, arg);
+        return;
+    }
+    for (auto r : rollups)
+    {
+        String s = r->to_string(now) + "\n";
+        sink(s.c_str(), s.length(), arg);
+    }
+}
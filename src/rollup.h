@@ -0,0 +1,80 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __rollup_h__
+#define __rollup_h__
+
+#include <Arduino.h>
+#include <WString.h>
+#include <time.h>
+#include "logger.h"
+
+/* streaming min/max/mean at three resolutions, kept up to date per sample, never rescanned:
+   the last 60 minutes, 24 hours and 31 days as rings of buckets aligned to epoch seconds (UTC).
+   Sensors add readings (weight 1), circuits add on/off spans weighted by their seconds, so
+   sum is the on-time and mean the duty cycle. Samples older than a ring reaches are dropped */
+
+class myRollup
+{
+public:
+    typedef enum
+    {
+        MINUTES,
+        HOURS,
+        DAYS,
+        LEVELS
+    } level_t;
+    typedef struct
+    {
+        float min, max;
+        float sum, weight; /* weight: samples or seconds */
+    } stat_t;
+    static const uint32_t res[LEVELS]; /* bucket width in s */
+    static const uint32_t len[LEVELS]; /* buckets per ring */
+
+private:
+    const String name;
+    const bool duty; /* on-time of a circuit */
+    stat_t minutes[60], hours[24], days[31];
+    stat_t *const ring[LEVELS] = {minutes, hours, days};
+    uint32_t head[LEVELS] = {}; /* newest bucket, in units of res */
+
+    static void clear(stat_t &s) { s = stat_t{NAN, NAN, 0, 0}; }
+    static void merge(stat_t &s, const stat_t &o);
+    void put(int l, uint32_t t, float v, float w);
+
+public:
+    myRollup(const String &n, bool d = false);
+    ~myRollup() = default;
+
+    const String &get_name(void) const { return name; }
+    /* one reading at wall clock t, NAN is ignored */
+    void add(time_t t, float v);
+    /* v held over [from, to), split at bucket boundaries, bounded by the ring lengths */
+    void add_span(time_t from, time_t to, float v);
+    /* bucket holding t, empty (weight 0) if it fell off the ring or saw nothing */
+    stat_t get(level_t l, time_t t) const;
+    /* the last n buckets of a level up to and including now, merged */
+    stat_t window(level_t l, int n, time_t now) const;
+    String to_string(time_t now) const;
+};
+
+/* all sensor and circuit rollups, one line each to sink: last hour, day and 30 days */
+void rollup_stats(log_sink_fn sink, void *arg);
+
+#endif
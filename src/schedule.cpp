@@ -0,0 +1,163 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include "schedule.h"
+
+const uint8_t mySchedule::EVERY_DAY;
+const int32_t mySchedule::DAY;
+const int32_t mySchedule::WEEK;
+
+static int32_t sod(const struct tm &t)
+{
+    return t.tm_hour * 3600 + t.tm_min * 60 + t.tm_sec;
+}
+
+void mySchedule::add(uint8_t days, int32_t from, int32_t to)
+{
+    rules.push_back(rule_t{static_cast<uint8_t>(days & EVERY_DAY), from, to});
+    dirty = true;
+}
+
+void mySchedule::clear(void)
+{
+    rules.clear();
+    dirty = true;
+}
+
+/* the tracked range as a rule: inclusive upper bound, so it ends a second later; lbound > ubound
+   runs over midnight */
+void mySchedule::sync(void)
+{
+    if (range)
+    {
+        int32_t f = sod(range->get_lbound()), t = sod(range->get_ubound()) + 1;
+        if ((f != range_from) || (t != range_to))
+        {
+            range_from = f;
+            range_to = t;
+            dirty = true;
+        }
+    }
+    if (dirty)
+        compile();
+}
+
+void mySchedule::compile(void)
+{
+    std::vector<std::pair<int32_t, int32_t>> win; /* [start, end) in the week */
+    auto put = [&win](uint8_t days, int32_t from, int32_t to) {
+        from = std::max<int32_t>(0, std::min(from, DAY));
+        to = std::max<int32_t>(0, std::min(to, DAY));
+        if (to <= from)
+            to += DAY;
+        for (int d = 0; d < 7; d++)
+        {
+            if (!(days & (1 << d)))
+                continue;
+            int32_t s = d * DAY + from, e = d * DAY + to;
+            if (e > WEEK) /* saturday night into sunday */
+            {
+                win.push_back({0, e - WEEK});
+                e = WEEK;
+            }
+            win.push_back({s, e});
+        }
+    };
+    for (auto &r : rules)
+        put(r.days, r.from, r.to);
+    if (range && (range_from < DAY)) /* lbound 24:00 is never in, as with myRange::is_in() */
+        put(EVERY_DAY, range_from, range_to);
+    std::sort(win.begin(), win.end());
+    edges.clear();
+    int32_t s = -1, e = -1;
+    for (auto &w : win)
+    {
+        if (w.first > e) /* gap: close the window so far */
+        {
+            if (s >= 0)
+            {
+                edges.push_back(s);
+                edges.push_back(e);
+            }
+            s = w.first;
+        }
+        e = std::max(e, w.second);
+    }
+    if (s >= 0)
+    {
+        edges.push_back(s);
+        edges.push_back(e);
+    }
+    /* a window from sunday 0:00 is the one that started the week before, if that runs up to its end */
+    week_start = !edges.empty() && (edges.front() == 0);
+    if (week_start)
+        edges.erase(edges.begin());
+    if (week_start && !edges.empty() && (edges.back() == WEEK))
+        edges.pop_back();
+    edges.shrink_to_fit();
+    dirty = false;
+}
+
+bool mySchedule::is_on(int wday, int32_t sod)
+{
+    sync();
+    int32_t w = wday * DAY + sod;
+    size_t n = std::upper_bound(edges.begin(), edges.end(), w) - edges.begin();
+    return week_start ^ (n & 1);
+}
+
+int32_t mySchedule::next(int wday, int32_t sod)
+{
+    sync();
+    if (edges.empty())
+        return -1;
+    int32_t w = wday * DAY + sod;
+    auto it = std::upper_bound(edges.begin(), edges.end(), w);
+    if (it != edges.end())
+        return *it - w;
+    if (edges.size() & 1) /* saturday ends other than the week started, flips at midnight */
+        return WEEK - w;
+    return edges.front() + WEEK - w;
+}
+
+String mySchedule::to_string(void)
+{
+    static const char wd[] = "SMTWTFS";
+    char buf[32];
+    String s("[");
+    sync();
+    auto win = [&](uint8_t days, int32_t from, int32_t to) {
+        if (s.length() > 1)
+            s += ", ";
+        if (days != EVERY_DAY)
+        {
+            for (int d = 0; d < 7; d++)
+                s += (days & (1 << d)) ? wd[d] : '-';
+            s += " ";
+        }
+        snprintf(buf, sizeof(buf), "%02d:%02d:%02d-%02d:%02d:%02d", from / 3600, (from / 60) % 60, from % 60,
+                 to / 3600, (to / 60) % 60, to % 60);
+        s += buf;
+    };
+    if (range)
+        win(EVERY_DAY, range_from, range_to - 1); /* as the ui shows it, inclusive */
+    for (auto &r : rules)
+        win(r.days, r.from, r.to);
+    return s + "] " + String(static_cast<int>(edges.size())) + " flips/week";
+}
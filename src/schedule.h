@@ -0,0 +1,76 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __schedule_h__
+#define __schedule_h__
+
+#include <vector>
+#include "ui.h"
+#include "wifi.h"
+
+/* weekly on/off schedule in local time: rules are windows of seconds of day on a set of weekdays,
+   compiled into one sorted table of the seconds into the week (sunday 0:00) at which the state flips.
+   State now and the next flip are a binary search each, nothing is evaluated per rule.
+   A schedule may follow a ui edited myRange<struct tm>, that rule is recompiled once the range moves */
+
+class mySchedule
+{
+public:
+    static const uint8_t EVERY_DAY = 0x7f; /* bit n: tm_wday n, 0 = sunday */
+    static const int32_t DAY = 86400;
+    static const int32_t WEEK = 7 * DAY;
+
+private:
+    typedef struct
+    {
+        uint8_t days;
+        int32_t from, to; /* [from, to), to <= from: over midnight, into the next day */
+    } rule_t;
+    std::vector<rule_t> rules;
+    myRange<struct tm> *range = nullptr; /* inclusive bounds, as myRange::is_in() */
+    int32_t range_from = -1, range_to = -1;
+    std::vector<int32_t> edges; /* flips, seconds into the week, ascending */
+    bool week_start = false;    /* state at sunday 0:00 */
+    bool dirty = true;
+
+    void sync(void);
+    void compile(void);
+
+public:
+    mySchedule() = default;
+    mySchedule(myRange<struct tm> &r) : range(&r) {}
+    ~mySchedule() = default;
+
+    /* adds a window on the days of the mask, e.g. add(EVERY_DAY, 22 * 3600, 6 * 3600) */
+    void add(uint8_t days, int32_t from, int32_t to);
+    void clear(void);
+
+    bool is_on(int wday, int32_t sod);
+    /* seconds from (wday, sod) to the next flip, -1: the state never changes */
+    int32_t next(int wday, int32_t sod);
+    inline bool is_on(const time_snapshot_t &t) { return is_on(t.tm.tm_wday, t.sod); }
+    inline int32_t next(const time_snapshot_t &t) { return next(t.tm.tm_wday, t.sod); }
+    size_t size(void)
+    {
+        sync();
+        return edges.size();
+    }
+    String to_string(void);
+};
+
+#endif
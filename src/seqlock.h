@@ -0,0 +1,82 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __seqlock_h__
+#define __seqlock_h__
+
+#include <Arduino.h>
+#include <atomic>
+#include <string.h>
+
+/* seqlock: one writer at a time (e.g. under the sensor mutex), readers never block or take a lock;
+   the writer makes seq odd while it stores, a reader retries if it saw seq odd or changed.
+   The payload lives in atomic words, so a torn copy is well defined - and discarded.
+   After spin_tries failed tries a reader yields before each further one: a writer it preempted
+   mid-store on the same core gets to finish instead of being spun against for a whole tick */
+template <typename T>
+class seqLock
+{
+public:
+    static const unsigned spin_tries = 8;
+
+private:
+    static const size_t words = (sizeof(T) + 3) / 4;
+    std::atomic<uint32_t> seq{0};
+    std::atomic<uint32_t> data[words];
+
+public:
+    seqLock(const T &v) { write(v); }
+    ~seqLock() = default;
+
+    void write(const T &v)
+    {
+        uint32_t w[words] = {};
+        memcpy(w, &v, sizeof(T));
+        uint32_t s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < words; i++)
+            data[i].store(w[i], std::memory_order_relaxed);
+        seq.store(s + 2, std::memory_order_release);
+    }
+    /* tries: if given, the copies it took */
+    T read(unsigned *tries = nullptr) const
+    {
+        uint32_t w[words], s;
+        unsigned n = 0;
+        for (;;)
+        {
+            s = seq.load(std::memory_order_acquire);
+            for (size_t i = 0; i < words; i++)
+                w[i] = data[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            n++;
+            if (!(s & 1) && (s == seq.load(std::memory_order_relaxed)))
+                break;
+            if (n >= spin_tries)
+                yield();
+        }
+        if (tries)
+            *tries = n;
+        T v;
+        memcpy(&v, w, sizeof(T));
+        return v;
+    }
+};
+
+#endif
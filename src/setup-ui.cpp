@@ -21,12 +21,19 @@
 
 #include "ui.h"
 #include "circuits.h"
+#include "img_rle.h"
 
 static TFT_eSPI tft = TFT_eSPI(); /* TFT instance */
+static const int hor_res = 240, ver_res = 320;
 static lv_disp_buf_t disp_buf;
-static lv_color_t buf[LV_HOR_RES_MAX * 10];
+static lv_color_t buf1[hor_res * DISP_BUF_LINES];
+static lv_color_t buf2[hor_res * DISP_BUF_LINES];
+static lv_disp_drv_t *dma_drv; /* flush in flight, completed by dma_done() */
 
-/* Display flushing */
+/* frame statistics */
+static unsigned long frames, frame_ms, frame_ms_max, frame_px, stall_us;
+
+/* Display flushing: start the DMA transfer and return, lvgl renders into the other buffer meanwhile */
 static void my_disp_flush(lv_disp_drv_t *disp, const lv_area_t *area,
 						  lv_color_t *color_p)
 {
@@ -34,10 +41,48 @@ static void my_disp_flush(lv_disp_drv_t *disp, const lv_area_t *area,
 	uint32_t h = (area->y2 - area->y1 + 1);
 	tft.startWrite();
 	tft.setAddrWindow(area->x1, area->y1, w, h);
-	tft.pushColors(&color_p->full, w * h, true);
+	tft.pushPixelsDMA(&color_p->full, w * h); /* swaps bytes in place, then queues the transfer */
+	dma_drv = disp;
+}
+
+/* hand the buffer back to lvgl once its transfer has finished */
+static bool dma_done(void)
+{
+	if (!dma_drv)
+		return true;
+	if (tft.dmaBusy())
+		return false;
 	tft.endWrite();
+	lv_disp_flush_ready(dma_drv);
+	dma_drv = NULL;
+	return true;
+}
 
-	lv_disp_flush_ready(disp);
+/* lvgl wants to flush again, but the previous stripe is still on the wire */
+static void my_disp_wait(lv_disp_drv_t *disp)
+{
+	unsigned long t = micros();
+	while (!dma_done())
+		;
+	stall_us += micros() - t;
+}
+
+static void my_disp_monitor(lv_disp_drv_t *disp, uint32_t ms, uint32_t px)
+{
+	frames++;
+	frame_ms += ms;
+	frame_px += px;
+	if (ms > frame_ms_max)
+		frame_ms_max = ms;
+}
+
+void disp_stats(log_sink_fn sink, void *arg)
+{
+	char buf[128];
+	int n = snprintf(buf, sizeof(buf), "%lu frames, avg %lums, max %lums, %lukpx/frame, %lums stalled on SPI, %d lines x2",
+					 frames, frames ? frame_ms / frames : 0, frame_ms_max, frames ? frame_px / frames / 1000 : 0,
+					 stall_us / 1000, DISP_BUF_LINES);
+	sink(buf, n, arg);
 }
 
 /*Read the touchpad*/
@@ -45,6 +90,8 @@ static bool my_touchpad_read(lv_indev_drv_t *indev_driver, lv_indev_data_t *data
 {
 	uint16_t touchX, touchY;
 
+	while (!dma_done()) /* touch shares the SPI bus */
+		;
 	bool touched = tft.getTouch(&touchX, &touchY, 600);
 	if (!touched)
 	{
@@ -87,6 +134,7 @@ static void init_lvgl(void)
 	digitalWrite(TFT_LED, LOW); // Display-Beleuchtung einschalten
 
 	lv_init();
+	img_rle_init();
 
 	tft.begin();									 /* TFT init */
 	tft.setRotation(0);								 /* Portrait orientation */
@@ -95,15 +143,19 @@ static void init_lvgl(void)
 	//tft.calibrateTouch(calData,TFT_MAGENTA, TFT_BLACK, 15);
 	Serial.printf("caldata: %d, %d, %d, %d, %d\n", calData[0], calData[1], calData[2], calData[3], calData[4]);
 	tft.setTouch(calData);
+	tft.initDMA();
+	tft.setSwapBytes(true); /* lvgl renders little endian RGB565 */
 
-	lv_disp_buf_init(&disp_buf, buf, NULL, LV_HOR_RES_MAX * 10);
+	lv_disp_buf_init(&disp_buf, buf1, buf2, hor_res * DISP_BUF_LINES);
 
 	/*Initialize the display*/
 	lv_disp_drv_t disp_drv;
 	lv_disp_drv_init(&disp_drv);
-	disp_drv.hor_res = 240;
-	disp_drv.ver_res = 320;
+	disp_drv.hor_res = hor_res;
+	disp_drv.ver_res = ver_res;
 	disp_drv.flush_cb = my_disp_flush;
+	disp_drv.wait_cb = my_disp_wait;
+	disp_drv.monitor_cb = my_disp_monitor;
 	disp_drv.buffer = &disp_buf;
 	lv_disp_drv_register(&disp_drv);
 
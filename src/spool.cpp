@@ -0,0 +1,285 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <LittleFS.h>
+#include <algorithm>
+#include <vector>
+#include "spool.h"
+#include "ui.h"
+
+static void put_hdr(uint8_t *p, uint32_t t, uint8_t tl, uint8_t pl)
+{
+    p[0] = t;
+    p[1] = t >> 8;
+    p[2] = t >> 16;
+    p[3] = t >> 24;
+    p[4] = tl;
+    p[5] = pl;
+}
+
+static uint32_t get_t(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+String mySpool::seg_path(uint16_t nr)
+{
+    char buf[16];
+    snprintf(buf, sizeof(buf), "/s%05u.sp", nr);
+    return String(buf);
+}
+
+mySpool::mySpool(size_t b, unsigned long f)
+    : budget(b), flush_ms(f)
+{
+    seg = static_cast<uint8_t *>(malloc(seg_size));
+    mutex = xSemaphoreCreateMutex();
+    V(mutex);
+    last_flush = millis();
+}
+
+bool mySpool::begin(void)
+{
+    if (!seg || !LittleFS.begin(true))
+    {
+        log_msg("spool: no file system, messages are dropped while the broker is away.");
+        return false;
+    }
+    mounted = true;
+    P(mutex);
+    load();
+    V(mutex);
+    log_msg("spool: " + stats());
+    return true;
+}
+
+/* the segments left by an earlier run, all to be replayed; the newest one continues in RAM */
+void mySpool::load(void)
+{
+    std::vector<uint16_t> nrs;
+    File root = LittleFS.open("/");
+    for (File f = root.openNextFile(); f; f = root.openNextFile())
+    {
+        const char *n = f.name();
+        unsigned nr;
+        if (*n == '/')
+            n++;
+        if (sscanf(n, "s%05u.sp", &nr) == 1)
+            nrs.push_back(nr);
+    }
+    if (nrs.empty())
+        return;
+    std::sort(nrs.begin(), nrs.end());
+    rd_seg = first_seg = nrs.front();
+    seg_nr = nrs.back();
+    File f = LittleFS.open(seg_path(seg_nr), "r");
+    size_t size = f ? f.read(seg, seg_size) : 0;
+    f.close();
+    for (seg_fill = 0; seg_fill + hdr_size <= size;)
+    {
+        size_t len = rec_len(seg + seg_fill);
+        if (seg_fill + len > size)
+            break; /* torn write */
+        seg_fill += len;
+    }
+}
+
+/* current segment to flash */
+void mySpool::write_seg(void)
+{
+    last_flush = millis();
+    if (!mounted)
+        return;
+    File f = LittleFS.open(seg_path(seg_nr), "w");
+    if (!f)
+    {
+        log_msg("spool: can't write " + seg_path(seg_nr));
+        return;
+    }
+    f.write(seg, seg_fill);
+    f.close();
+    seg_writes++;
+    seg_dirty = false;
+}
+
+/* records of segment nr from offset on */
+size_t mySpool::count(uint16_t nr, size_t from)
+{
+    if (nr == seg_nr)
+    {
+        size_t n = 0;
+        for (size_t pos = from; pos + hdr_size <= seg_fill; pos += rec_len(seg + pos))
+            n++;
+        return n;
+    }
+    File f = LittleFS.open(seg_path(nr), "r");
+    size_t n = 0, size = f ? f.size() : 0;
+    uint8_t h[hdr_size];
+    for (size_t pos = from; (pos + hdr_size <= size) && f.seek(pos) && (f.read(h, hdr_size) == hdr_size);
+         pos += rec_len(h))
+        n++;
+    f.close();
+    return n;
+}
+
+void mySpool::drop_oldest(void)
+{
+    dropped += count(first_seg, (rd_seg == first_seg) ? rd_pos : 0);
+    if (mounted)
+        LittleFS.remove(seg_path(first_seg));
+    first_seg++;
+    if (rd_seg < first_seg)
+    {
+        rd_seg = first_seg;
+        rd_pos = rd_len = 0; /* a peeked record went with it */
+    }
+}
+
+/* the current segment is full: final write, start the next one, drop the oldest if over budget */
+void mySpool::new_seg(void)
+{
+    write_seg();
+    seg_nr++;
+    seg_fill = 0;
+    while ((seg_nr - first_seg + 1) * seg_size > budget)
+        drop_oldest();
+}
+
+bool mySpool::put(uint32_t t, const char *topic, const uint8_t *payload, size_t pl, bool raw)
+{
+    size_t tl = strlen(topic);
+    if ((tl >= raw_flag) || (pl > 255))
+        return false;
+    P(mutex);
+    if (seg_fill + hdr_size + tl + pl > seg_size)
+        new_seg();
+    put_hdr(seg + seg_fill, t, tl | (raw ? raw_flag : 0), pl);
+    memcpy(seg + seg_fill + hdr_size, topic, tl);
+    memcpy(seg + seg_fill + hdr_size + tl, payload, pl);
+    seg_fill += hdr_size + tl + pl;
+    seg_dirty = true;
+    spooled++;
+    V(mutex);
+    return true;
+}
+
+bool mySpool::peek(uint32_t &t, char *topic, size_t topic_len, uint8_t *payload, size_t &len, bool &raw)
+{
+    uint8_t h[hdr_size];
+    size_t tl, pl;
+    P(mutex);
+    for (;;)
+    {
+        if (rd_seg == seg_nr)
+        {
+            if (rd_pos + hdr_size > seg_fill)
+            {
+                V(mutex);
+                return false;
+            }
+            memcpy(h, seg + rd_pos, hdr_size);
+            tl = std::min(static_cast<size_t>(h[4] & ~raw_flag), topic_len - 1);
+            pl = std::min(static_cast<size_t>(h[5]), len);
+            memcpy(topic, seg + rd_pos + hdr_size, tl);
+            memcpy(payload, seg + rd_pos + hdr_size + (h[4] & ~raw_flag), pl);
+            break;
+        }
+        File f = LittleFS.open(seg_path(rd_seg), "r");
+        size_t size = f ? f.size() : 0;
+        if ((rd_pos + hdr_size <= size) && f.seek(rd_pos) && (f.read(h, hdr_size) == hdr_size) &&
+            (rd_pos + rec_len(h) <= size))
+        {
+            tl = std::min(static_cast<size_t>(h[4] & ~raw_flag), topic_len - 1);
+            pl = std::min(static_cast<size_t>(h[5]), len);
+            f.read(reinterpret_cast<uint8_t *>(topic), tl);
+            f.seek(rd_pos + hdr_size + (h[4] & ~raw_flag));
+            f.read(payload, pl);
+            f.close();
+            break;
+        }
+        f.close();
+        LittleFS.remove(seg_path(rd_seg)); /* through, or torn */
+        first_seg = ++rd_seg;
+        rd_pos = 0;
+    }
+    topic[tl] = '\0';
+    len = pl;
+    raw = h[4] & raw_flag;
+    t = get_t(h);
+    rd_len = rec_len(h);
+    V(mutex);
+    return true;
+}
+
+void mySpool::done(void)
+{
+    P(mutex);
+    if (!rd_len)
+    {
+        V(mutex);
+        return;
+    }
+    rd_pos += rd_len;
+    rd_len = 0;
+    replayed++;
+    if ((rd_seg == seg_nr) && (rd_pos >= seg_fill)) /* all through, start over */
+    {
+        if (mounted && LittleFS.exists(seg_path(seg_nr)))
+            LittleFS.remove(seg_path(seg_nr));
+        seg_fill = rd_pos = 0;
+        seg_dirty = false;
+    }
+    V(mutex);
+}
+
+bool mySpool::empty(void)
+{
+    P(mutex);
+    bool e = (rd_seg == seg_nr) && (rd_pos >= seg_fill);
+    V(mutex);
+    return e;
+}
+
+void mySpool::flush(bool force)
+{
+    P(mutex);
+    if (seg_dirty && (force || (millis() - last_flush >= flush_ms)))
+        write_seg();
+    V(mutex);
+}
+
+unsigned long mySpool::pending(void)
+{
+    unsigned long n = 0;
+    P(mutex);
+    for (uint16_t nr = rd_seg; nr != static_cast<uint16_t>(seg_nr + 1); nr++)
+        n += count(nr, (nr == rd_seg) ? rd_pos : 0);
+    V(mutex);
+    return n;
+}
+
+String mySpool::stats(void)
+{
+    unsigned long p = pending();
+    char buf[128];
+    P(mutex);
+    snprintf(buf, sizeof(buf), "%lu pending in %u segments, %lu spooled, %lu replayed, %lu dropped (full), %lu segment writes",
+             p, static_cast<unsigned>(seg_nr - rd_seg + 1), spooled, replayed, dropped, seg_writes);
+    V(mutex);
+    return String(buf);
+}
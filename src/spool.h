@@ -0,0 +1,91 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __spool_h__
+#define __spool_h__
+
+#include <Arduino.h>
+#include <WString.h>
+
+/* store and forward: outbound telemetry the broker can't take goes into a circular spool on LittleFS,
+   records of <epoch (4), topic length (1, bit 7: binary payload), payload length (1), topic, payload> in 4k segment files
+   like the history's; the current segment is kept in RAM and written when full, every flush_ms and
+   before a reboot, the oldest segment is dropped once over budget. After a reconnect the records
+   are replayed in order, a few per batch, and a segment is removed once it's through */
+
+#ifndef SPOOL_BUDGET
+#define SPOOL_BUDGET (3 * 4096) /* next to the history's HIST_BUDGET in the 64k partition */
+#endif
+
+class mySpool
+{
+public:
+    static const size_t seg_size = 4096;
+    static const size_t hdr_size = 6;
+    static const uint8_t raw_flag = 0x80; /* in the topic length */
+
+private:
+    uint8_t *seg;           /* current segment */
+    size_t seg_fill = 0;
+    uint16_t seg_nr = 0, first_seg = 0;
+    bool seg_dirty = false;
+    uint16_t rd_seg = 0;    /* replay cursor */
+    size_t rd_pos = 0, rd_len = 0;
+    size_t budget;
+    unsigned long flush_ms;
+    unsigned long last_flush;
+    bool mounted = false;
+    SemaphoreHandle_t mutex;
+
+    /* statistics */
+    unsigned long spooled = 0, replayed = 0, dropped = 0, seg_writes = 0;
+
+    static String seg_path(uint16_t nr);
+    static size_t rec_len(const uint8_t *h) { return hdr_size + (h[4] & ~raw_flag) + h[5]; }
+    void write_seg(void);
+    void new_seg(void);
+    void drop_oldest(void);
+    void load(void);
+    size_t count(uint16_t nr, size_t from);
+
+public:
+    mySpool(size_t budget = SPOOL_BUDGET, unsigned long flush_ms = 30 * 60 * 1000UL);
+    ~mySpool()
+    {
+        free(seg);
+        vSemaphoreDelete(mutex);
+    }
+
+    /* mount LittleFS and pick up what an earlier run left, false if there's no file system */
+    bool begin(void);
+    /* keep a message for later, false if it doesn't fit a record */
+    bool put(uint32_t t, const char *topic, const uint8_t *payload, size_t len, bool raw = false);
+    /* the next record in line, true if there is one; done() moves on past it, unless the budget
+       dropped it meanwhile. len: the size of payload in, the bytes in it out (not terminated),
+       raw: a binary payload */
+    bool peek(uint32_t &t, char *topic, size_t topic_len, uint8_t *payload, size_t &len, bool &raw);
+    void done(void);
+    bool empty(void);
+    /* write the current segment if it changed, forced or every flush_ms */
+    void flush(bool force = false);
+    /* records not replayed yet, counted through the segments */
+    unsigned long pending(void);
+    String stats(void);
+};
+
+#endif
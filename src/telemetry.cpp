@@ -0,0 +1,205 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include "telemetry.h"
+#include "cbor.h"
+#include "circuits.h"
+
+static genSensor *sensors[TLM_MAX_SENSORS];
+static genCircuit *circuits[TLM_MAX_CIRCUITS];
+static int no_sensors, no_circuits;
+static lv_task_t *tlm_task;
+static unsigned long period; /* s, 0: off */
+static bool fits = true;      /* the last frame fit the buffer, else the values go one by one */
+static bool complete = true;  /* all sensors and circuits made it into the tables */
+static uint32_t seq;
+static unsigned long frames, frame_bytes, frame_max, too_big, refused; /* statistics */
+static const char *health_topics[TLM_HEALTH_VALUES] = {"/heap", "/lv", "/stale", "/refused"};
+
+/* false for an error, a stale value or none read yet */
+static bool sensor_value(genSensor *s, float &v)
+{
+    sens_snapshot_t snap = s->snapshot();
+    v = snap.val;
+    return snap.ts && !snap.error && !s->stale() && !isnan(v);
+}
+
+static void health(uint32_t *h)
+{
+    h[0] = ESP.getFreeHeap();
+    h[1] = lv_stall_max_us / 1000;
+    h[2] = genSensor::stale_events();
+    h[3] = mqtt_refused();
+}
+
+size_t telemetry_frame(uint8_t *buf, size_t len)
+{
+    cborWriter w(buf, len);
+    uint32_t h[TLM_HEALTH_VALUES];
+    uint32_t now = 0;
+    if (time_obj)
+    {
+        time_snapshot_t ts = time_obj->now();
+        now = ts.valid ? ts.now : 0;
+    }
+    w.put_map(TLM_KEYS);
+    w.put_uint(TLM_EPOCH);
+    w.put_uint(now);
+    w.put_uint(TLM_UPTIME);
+    w.put_uint(millis() / 1000);
+    w.put_uint(TLM_SEQ);
+    w.put_uint(seq);
+    w.put_uint(TLM_SENSORS);
+    w.put_map(no_sensors);
+    for (int i = 0; i < no_sensors; i++)
+    {
+        const String &n = sensors[i]->get_name();
+        float v;
+        w.put_text(n.c_str(), n.length());
+        if (sensor_value(sensors[i], v))
+            w.put_int(lroundf(v * 100));
+        else
+            w.put_null();
+    }
+    w.put_uint(TLM_CIRCUITS);
+    w.put_map(no_circuits);
+    for (int i = 0; i < no_circuits; i++)
+    {
+        const String &n = circuits[i]->get_name();
+        w.put_text(n.c_str(), n.length());
+        w.put_uint(lroundf(circuits[i]->get_output() * 100));
+    }
+    w.put_uint(TLM_HEALTH);
+    w.put_array(TLM_HEALTH_VALUES);
+    health(h);
+    for (int i = 0; i < TLM_HEALTH_VALUES; i++)
+        w.put_uint(h[i]);
+    if (w.ok())
+        seq++;
+    return w.size();
+}
+
+void telemetry_each(void (*fn)(const char *topic, float v, void *arg), void *arg)
+{
+    char topic[MQTT_TOPIC_LEN];
+    uint32_t h[TLM_HEALTH_VALUES];
+    for (int i = 0; i < no_sensors; i++)
+    {
+        float v;
+        fn(sensors[i]->get_name().c_str(), sensor_value(sensors[i], v) ? v : NAN, arg);
+    }
+    for (int i = 0; i < no_circuits; i++)
+    {
+        snprintf(topic, sizeof(topic), "/%s", circuits[i]->get_name().c_str());
+        fn(topic, circuits[i]->get_output() * 100, arg);
+    }
+    health(h);
+    for (int i = 0; i < TLM_HEALTH_VALUES; i++)
+        fn(health_topics[i], h[i], arg);
+}
+
+/* ui thread, lv_task_handler(): one frame, copied into the publish queue */
+static void telemetry_tick(lv_task_t *t)
+{
+    static uint8_t frame[MQTT_PAYLOAD_LEN];
+    if (!complete)
+        return; /* the values go one by one */
+    size_t n = telemetry_frame(frame, sizeof(frame));
+    if (!n)
+    {
+        too_big++;
+        if (fits)
+            log_msg("telemetry: frame exceeds " + String(sizeof(frame)) + " bytes, one message per value meanwhile.");
+        fits = false;
+        return;
+    }
+    if (!fits)
+        log_msg("telemetry: frames fit again.");
+    fits = true;
+    if (!mqtt_publish_raw("/telemetry", frame, n))
+    {
+        refused++;
+        return;
+    }
+    frames++;
+    frame_bytes += n;
+    frame_max = std::max(frame_max, static_cast<unsigned long>(n));
+}
+
+void setup_telemetry(unsigned long period_s)
+{
+    tlm_task = lv_task_create(telemetry_tick, 1000, LV_TASK_PRIO_OFF, nullptr);
+    telemetry_set_period(period_s);
+}
+
+void telemetry_set_period(unsigned long period_s)
+{
+    period = period_s;
+    if (!tlm_task)
+        return;
+    if (period)
+    {
+        lv_task_set_period(tlm_task, period * 1000);
+        lv_task_set_prio(tlm_task, LV_TASK_PRIO_LOW);
+    }
+    else
+        lv_task_set_prio(tlm_task, LV_TASK_PRIO_OFF);
+}
+
+bool telemetry_bundled(void)
+{
+    return tlm_task && period && fits && complete;
+}
+
+void telemetry_add(genSensor *s)
+{
+    if (no_sensors < TLM_MAX_SENSORS)
+        sensors[no_sensors++] = s;
+    else
+    {
+        complete = false;
+        log_msg("telemetry: too many sensors, " + s->get_name() + " left out, one message per value.");
+    }
+}
+
+void telemetry_add(genCircuit *c)
+{
+    if (no_circuits < TLM_MAX_CIRCUITS)
+        circuits[no_circuits++] = c;
+    else
+    {
+        complete = false;
+        log_msg("telemetry: too many circuits, " + c->get_name() + " left out, one message per value.");
+    }
+}
+
+void telemetry_stats(log_sink_fn sink, void *arg)
+{
+    char buf[160];
+    int n;
+    if (!tlm_task || !period)
+        n = snprintf(buf, sizeof(buf), "off, one message per value");
+    else if (!complete)
+        n = snprintf(buf, sizeof(buf), "too many sensors or circuits, one message per value");
+    else
+        n = snprintf(buf, sizeof(buf), "%lu frames every %lus, avg %lu bytes, max %lu, %lu too big%s, %lu refused",
+                     frames, period, frames ? frame_bytes / frames : 0, frame_max, too_big,
+                     fits ? "" : " (one message per value meanwhile)", refused);
+    sink(buf, n, arg);
+}
@@ -0,0 +1,74 @@
+/* -*-c++-*-
+ * This file is part of formicula2.
+ * 
+ * vice-mapper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * vice-mapper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __telemetry_h__
+#define __telemetry_h__
+
+#include <Arduino.h>
+#include <WString.h>
+#include "logger.h"
+
+/* bundled telemetry: instead of one message per value, every period the sensors, the circuit outputs
+   and a few health counters go out together as one CBOR frame (cbor.h) to /telemetry, built in a
+   fixed buffer without touching the heap. The frame is a map with small integer keys:
+     TLM_EPOCH    epoch of the frame, 0: clock not set
+     TLM_UPTIME   s since boot
+     TLM_SEQ      frame counter since boot, gaps are lost frames
+     TLM_SENSORS  {sensor name: value * 100, null: error, stale or no reading yet}
+     TLM_CIRCUITS {circuit name: output in %, 0/100 for a relay, the duty of a PID}
+     TLM_HEALTH   [free heap, longest lv_task_handler() run in ms, stale sensor events, mqtt refused]
+   Frames are telemetry to mqtt: coalesced, spooled while the broker is away and replayed as they
+   are (they carry their epoch). A frame that doesn't fit MQTT_PAYLOAD_LEN isn't sent, the values go
+   one by one instead until one fits again, as they do if a sensor or circuit didn't fit the tables.
+   The DS18B20 probes aren't in the frame one by one (<name>-<idx>), only their averages.
+   Decoder: tools/cbor_dump.py */
+
+class genSensor;
+class genCircuit;
+
+typedef enum
+{
+    TLM_EPOCH,
+    TLM_UPTIME,
+    TLM_SEQ,
+    TLM_SENSORS,
+    TLM_CIRCUITS,
+    TLM_HEALTH,
+    TLM_KEYS
+} tlm_key_t;
+
+#define TLM_MAX_SENSORS 16
+#define TLM_MAX_CIRCUITS 8
+#define TLM_HEALTH_VALUES 4
+
+/* period in s, 0: off, the sensors publish each reading by itself */
+void setup_telemetry(unsigned long period_s);
+void telemetry_set_period(unsigned long period_s);
+/* true while frames replace the per value messages: on, everything in the tables and the last frame fit */
+bool telemetry_bundled(void);
+/* called by the constructors: sensors with a value, circuits */
+void telemetry_add(genSensor *s);
+void telemetry_add(genCircuit *c);
+/* encode a frame of what's current into buf, its size, 0 if it doesn't fit */
+size_t telemetry_frame(uint8_t *buf, size_t len);
+/* the values of a frame one by one, as the per value messages would carry them (topic, value) */
+void telemetry_each(void (*fn)(const char *topic, float v, void *arg), void *arg);
+/* frames sent, their size, the ones too big or refused by the queue, one line to sink */
+void telemetry_stats(log_sink_fn sink, void *arg);
+
+#endif
@@ -115,7 +115,7 @@ uiElements::uiElements(int idle_time) : saver(this, idle_time), mwidget(nullptr)
     /* some action buttons */
     add2ui(UI_SETTINGS, (new actionButton(this, UI_SETTINGS, "Reset FCCE", [](uiCommons *p) {
                             p->get_ui()->log_event("reset fcce requested by user...");
-                            mqtt_publish("/reset-request", "user request");
+                            mqtt_publish("/reset-request", "user request", nullptr, 0, MQTT_ALARM);
                         }))->get_area(),
            0, 5);
 
@@ -210,14 +210,16 @@ void uiElements::update()
     {
         fcc_wd = millis();
         unsigned long upt = fcc_wd / 1000;
-        snprintf(buf, 64, "fcc/ut %02ldh:%02ldm:%02lds, fm=%d",
+        snprintf(buf, 64, "fcc/ut %02ldh:%02ldm:%02lds, fm=%d, lv=%lums",
                  upt / 3600,
                  (upt % 3600) / 60,
                  (upt % 60),
-                 ESP.getFreeHeap());
+                 ESP.getFreeHeap(),
+                 lv_stall_us / 1000);
+        lv_stall_us = 0;
         lv_label_set_text(load_widget, buf);
         fcc_ut = String(buf);
-        mqtt_publish("/cc-alive", buf);
+        mqtt_publish("/cc-alive", buf, nullptr, 0, MQTT_EVENT); /* a heartbeat, only worth it live */
     }
 };
 
@@ -418,7 +420,7 @@ static void button_cb_wrapper(lv_obj_t *obj, lv_event_t e)
     button_callbacks.retrieve(obj)->cb(e);
 }
 
-tiny_hash_c<lv_obj_t *, rangeSpinbox<myRange<struct tm>> *> spinbox_callbacks{6};
+tiny_hash_c<lv_obj_t *, rangeSpinbox<myRange<struct tm>> *> spinbox_callbacks{12}; /* 4 buttons per spinbox */
 void spinbox_cb_wrapper(lv_obj_t *obj, lv_event_t e)
 {
     spinbox_callbacks.retrieve(obj)->cb(obj, e);
@@ -38,6 +38,11 @@
 
 #define TFT_LED 15
 
+/* display draw buffer height in lines, two of them: lvgl renders into one while DMA sends the other */
+#ifndef DISP_BUF_LINES
+#define DISP_BUF_LINES 20
+#endif
+
 //#define ALARM_SOUND
 #define BUZZER_PIN 21
 
@@ -51,6 +56,7 @@ class genSensor;
 
 /* prototypes */
 uiElements *setup_ui(const int to);
+void disp_stats(log_sink_fn sink, void *arg); /* one line to sink */
 extern lv_obj_t *log_handle;
 extern myRange<float> ctrl_temprange1;
 extern myRange<float> ctrl_humrange1;
@@ -59,6 +65,7 @@ extern myRange<float> ctrl_humrange2;
 extern myRange<struct tm> def_day;
 
 extern int glob_delay;
+extern unsigned long lv_stall_us, lv_stall_max_us;
 
 void setup_wifi(uiElements *ui);
 void loop_wifi(void);
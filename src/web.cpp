@@ -17,159 +17,124 @@
  */
 #include <Arduino.h>
 #include <AutoConnect.h>
-#include <PageBuilder.h>
 
 #include "ui.h"
+#include "acq.h"
+#include "io.h"
+#include "history.h"
+#include "rollup.h"
+#include "telemetry.h"
 
-//    static PageElement ROOT_PAGE_ELEMENT(rp->c_str());
-//    static PageBuilder ROOT_PAGE("/", {ROOT_PAGE_ELEMENT});
-
-static PageElement elm;
-static PageBuilder page;
-static bool handle_web(HTTPMethod method, String uri);
-static String currentUri;
+static WebServer *server;
 static uiElements *ui;
+static void handle_root(void);
+static void handle_history(void);
 
 void setup_web(WebServer &ip_server, uiElements *u)
 {
     ui = u;
-    page.exitCanHandle(handle_web); // Handles for all requests.
-    page.insert(ip_server);
-}
-
-// The root page content builder
-String rootPage(PageArgument &args)
-{
-    return String(F("Formicula Control Centre..."));
+    server = &ip_server;
+    server->on("/", HTTP_GET, handle_root);
+    server->on("/history", HTTP_GET, handle_history);
 }
 
-String body(PageArgument &args)
+static void send_chunk(const char *s, size_t len, void *arg)
 {
-    return String{String("<a href=\"http://" + WiFi.localIP().toString() + "/_ac\">FCC Administration</a>")};
+    static_cast<WebServer *>(arg)->sendContent_P(s, len);
 }
 
-String body_fcc_ut(PageArgument &args)
+/* the stats are written a line at a time, on the page a line ends in <br> */
+static void send_lines(const char *s, size_t len, void *arg)
 {
-    return ui->get_fcc_ut();
-}
-
-String body_fcce_ut(PageArgument &args)
-{
-    return ui->get_fcce_ut();
-}
-
-String bodyLog_msg(PageArgument &args)
-{
-    return get_log(myLogger::LOG_MSG);
+    WebServer *srv = static_cast<WebServer *>(arg);
+    while (len)
+    {
+        const char *nl = static_cast<const char *>(memchr(s, '\n', len));
+        size_t n = nl ? nl - s : len;
+        if (n)
+            srv->sendContent_P(s, n);
+        if (!nl)
+            break;
+        srv->sendContent_P(PSTR("<br>"));
+        s += n + 1;
+        len -= n + 1;
+    }
 }
 
-String bodyLog_sensor(PageArgument &args)
+static void send_log(const char *title, myLogger::myLog_t w)
 {
-    return get_log(myLogger::LOG_SENSOR);
+    server->sendContent_P(PSTR("<h3>"));
+    server->sendContent_P(title);
+    server->sendContent_P(PSTR(
+        "</h3>"
+        "<div>"
+        "<table class=\"info\">"
+        "<tbody>"));
+    stream_log(w, send_chunk, server); /* row by row, straight from the logger */
+    server->sendContent_P(PSTR(
+        "</tbody>"
+        "</table>"
+        "</div>"));
 }
 
-String bodyLog_circuit(PageArgument &args)
+/* the / page is sent with chunked transfer encoding piece by piece, stats and logs
+   line by line, so it never exists as a whole in memory */
+static void handle_root(void)
 {
-    return get_log(myLogger::LOG_CIRCUIT);
+    Serial.println("Request:" + server->uri());
+    server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server->send(200, "text/html", "");
+    server->sendContent_P(PSTR(
+        "<!DOCTYPE html>"
+        "<html>"
+        "<head>"
+        "<meta charset=\"UTF-8\" name=\"viewport\" content=\"width=device-width,initial-scale=1\">"
+        "<style type=\"text/css\">"));
+    server->sendContent_P(AutoConnect::_CSS_BASE);
+    server->sendContent_P(AutoConnect::_CSS_TABLE);
+    server->sendContent_P(PSTR(
+        "</style>"
+        "<body style=\"padding-top:58px;\">"
+        "<h2>Formicula Control Centre...</h2>"
+        "<div class=\"container\">"
+        "<p>"));
+    server->sendContent("<a href=\"http://" + WiFi.localIP().toString() + "/_ac\">FCC Administration</a>");
+    server->sendContent_P(PSTR("</p><p>FCC Uptime: "));
+    server->sendContent(ui->get_fcc_ut());
+    server->sendContent_P(PSTR("</p><p>FCCE Uptime: "));
+    server->sendContent(ui->get_fcce_ut());
+    server->sendContent_P(PSTR("</p><p>Display: "));
+    disp_stats(send_lines, server);
+    server->sendContent_P(PSTR("</p><p>MQTT:<br>"));
+    mqtt_stats(send_lines, server);
+    server->sendContent_P(PSTR("</p><p>Telemetry: "));
+    telemetry_stats(send_lines, server);
+    server->sendContent_P(PSTR("</p><p>Sensor acquisition:<br>"));
+    acq_stats(send_lines, server);
+    server->sendContent_P(PSTR("</p><p>History: "));
+    history_stats(send_lines, server);
+    server->sendContent_P(PSTR("</p><p>Outputs:<br>"));
+    io_stats(send_lines, server);
+    server->sendContent_P(PSTR("</p><p>Rollups (min/mean/max):<br>"));
+    rollup_stats(send_lines, server);
+    server->sendContent_P(PSTR("</p>"));
+    send_log(PSTR("FCC Message Log:"), myLogger::LOG_MSG);
+    send_log(PSTR("FCC Sensor Log:"), myLogger::LOG_SENSOR);
+    send_log(PSTR("FCC Circuit Log:"), myLogger::LOG_CIRCUIT);
+    server->sendContent_P(PSTR(
+        "</div>"
+        "</body>"
+        "</html>"));
+    server->sendContent(""); /* terminating chunk */
 }
 
-String _token_CSS_BASE(PageArgument &args)
-{
-    return String(FPSTR(AutoConnect::_CSS_BASE));
-}
-String _token_CSS_TABLE(PageArgument &args)
+/* /history?s=/FCCETemp&h=24: the last h hours of a sensor as csv, decoded block by block */
+static void handle_history(void)
 {
-    return String(FPSTR(AutoConnect::_CSS_TABLE));
+    time_t to = time(nullptr) + 1;
+    long h = server->hasArg("h") ? server->arg("h").toInt() : 24;
+    server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server->send(200, "text/plain", "");
+    stream_history(server->arg("s"), to - h * 3600, to, send_chunk, server);
+    server->sendContent(""); /* terminating chunk */
 }
-
-static bool handle_web(HTTPMethod method, String uri)
-{
-    if (uri == currentUri)
-    {
-        // Page is already prepared.
-        return true;
-    }
-    else
-    {
-        currentUri = uri;
-        page.clearElements();  // Discards the remains of PageElement.
-        page.addElement(elm); // Register PageElement for current access.
-
-        Serial.println("Request:" + uri);
-
-        if (uri == "/")
-        { // for the / page
-            page.setUri(uri.c_str());
-            elm.setMold(PSTR(
-                "<!DOCTYPE html>"
-                "<html>"
-                "<head>"
-                "<meta charset=\"UTF-8\" name=\"viewport\" content=\"width=device-width,initial-scale=1\">"
-                "<style type=\"text/css\">"
-                "{{CSS_BASE}}"
-                "{{CSS_TABLE}}"
-                "</style>"
-                "<body style=\"padding-top:58px;\">"
-                 "<h2>{{ROOT}}</h2>"
-                  "<div class=\"container\">"
-                  "<p>{{BODY_HEAD}}</p>"
-                  "<p>FCC Uptime: {{BODY_FCCUT}}</p>"
-                  "<p>FCCE Uptime: {{BODY_FCCEUT}}</p>"
-                  "<h3>FCC Message Log:</h3>"
-                    "<div>"
-                    "<table class=\"info\">"
-                        "<tbody>"
-                        "{{LOG_MSG}}"
-                        "</tbody>"
-                    "</table>"
-                    "</div>"   
-                  "<h3>FCC Sensor Log:</h3>"
-                    "<div>"
-                    "<table class=\"info\">"
-                        "<tbody>"
-                        "{{LOG_SENSOR}}"
-                        "</tbody>"
-                    "</table>"
-                    "</div>"   
-                  "<h3>FCC Circuit Log:</h3>"
-                    "<div>"
-                    "<table class=\"info\">"
-                        "<tbody>"
-                        "{{LOG_CIRCUIT}}"
-                        "</tbody>"
-                    "</table>"
-                    "</div>"   
-                  "</div>"   
-                "</body>"
-                "</html>"));
-            elm.addToken("CSS_BASE", _token_CSS_BASE);
-            elm.addToken("CSS_TABLE", _token_CSS_TABLE);
-            elm.addToken("ROOT", rootPage);
-            elm.addToken("BODY_HEAD", body);
-            elm.addToken("BODY_FCCUT", body_fcc_ut);
-            elm.addToken("BODY_FCCEUT", body_fcce_ut);
-            elm.addToken("LOG_MSG", bodyLog_msg);
-            elm.addToken("LOG_SENSOR", bodyLog_sensor);
-            elm.addToken("LOG_CIRCUIT", bodyLog_circuit);
-            return true;
-        }
-        /*
-        else if (uri == "/hello")
-        { // for the /hello page
-            page.setUri(uri.c_str());
-            elm.setMold(PSTR(
-                "<html>"
-                "<body>"
-                "<p style=\"color:Tomato;\">{{HELLO}}</p>"
-                "</body>"
-                "</html>"));
-            elm.addToken("HELLO", helloPage);
-            return true;
-        }
-        */
-        else
-        {
-            return false; // Not found to accessing exception URI.
-        }
-    }
-}
\ No newline at end of file
@@ -47,9 +47,28 @@ myTime::myTime()
     configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
     V(mutex);
     printLocalTime();
+    tick();
     lv_task_create(myTime::sync_clock, 1000 * 60 * 60 * 24 /* 1x daily ntp sync */, LV_TASK_PRIO_LOWEST, this);
 }
 
+void myTime::tick(void)
+{
+    time_t t = time(nullptr);
+    if (t == last)
+        return;
+    last = t;
+    /* configTime() sets a fixed offset TZ, so this is what localtime_r() would give, without the TZ parsing */
+    time_snapshot_t s;
+    time_t local = t + gmtOffset_sec + daylightOffset_sec;
+    gmtime_r(&local, &s.tm);
+    s.now = t;
+    s.sod = s.tm.tm_hour * 3600 + s.tm.tm_min * 60 + s.tm.tm_sec;
+    s.valid = (t >= TIME_VALID_EPOCH);
+    if (s.valid && !snap.read().valid)
+        log_msg("clock valid.");
+    snap.write(s);
+}
+
 void printLocalTime()
 {
     struct tm timeinfo;
@@ -126,12 +145,13 @@ void setup_wifi(uiElements *u)
 
 void loop_wifi(void)
 {
+    if (time_obj)
+        time_obj->tick(); /* first thing in loop(), mqtt and circuits of this round see the current second */
     if (!WiFi.isConnected())
         log_msg("Wifi not connected ... strange");
 #ifdef USE_AC
-    if (ui->portal())
+    if (ui->portal() && mqtt_P()) /* else a publish is in flight, next round */
     {
-        mqtt_P();
         portal.handleClient();
         mqtt_V();
     }
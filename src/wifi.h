@@ -19,14 +19,30 @@
 #ifndef __WIFI_H__
 #define __WIFI_H__
 
+#include <time.h>
+#include "seqlock.h"
+
 void printLocalTime();
 
+/* the clock as the consumers see it, refreshed by myTime::tick() once per second */
+typedef struct
+{
+    struct tm tm; /* local time, broken down */
+    time_t now;   /* epoch seconds tm was made from */
+    int32_t sod;  /* seconds since local midnight */
+    bool valid;   /* NTP has set the clock */
+} time_snapshot_t;
+
+#define TIME_VALID_EPOCH 1600000000 /* before that, NTP hasn't answered yet */
+
 class myTime
 {
     const char *ntpServer = "pool.ntp.org";
     const long gmtOffset_sec = 1 * 3600;
     const int daylightOffset_sec = 0;
     SemaphoreHandle_t mutex;
+    time_t last = 0; /* epoch of the snapshot */
+    seqLock<time_snapshot_t> snap{time_snapshot_t{}};
 
 public:
     myTime();
@@ -46,14 +62,18 @@ public:
         log_msg("NTP sync done.");
         printLocalTime();
     }
-    inline bool get_time(struct tm *t)
+    /* loop(): converts the epoch once it has moved on a second, otherwise just a time() call */
+    void tick(void);
+    /* lock free and never blocks: a copy of the snapshot, false until the clock is valid */
+    inline bool get_time(struct tm *t) const
     {
-        bool res;
-        //P(mutex);
-        res = getLocalTime(t);
-        //V(mutex);
-        return res;
+        time_snapshot_t s = snap.read();
+        *t = s.tm;
+        return s.valid;
     }
+    inline time_snapshot_t now(void) const { return snap.read(); }
+    inline bool valid(void) const { return snap.read().valid; }
+    inline int32_t sec_of_day(void) const { return snap.read().sod; }
 };
 
 extern myTime *time_obj;
@@ -0,0 +1,132 @@
+# This file is part of formicula2.
+#
+# vice-mapper is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# vice-mapper is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+
+"""Decode the bundled telemetry frames (src/telemetry.h): CBOR maps with small integer keys, one
+per period on fcc/telemetry, spooled ones on fcc/replay/telemetry.
+
+Input lines as mosquitto_sub prints them with -F '%t %x' (topic, payload in hex), a bare hex
+payload works too; -r: files holding one raw frame each. One line per frame out, -j: JSON lines.
+  mosquitto_sub -h fcc-rpi -t 'fcc/telemetry' -t 'fcc/replay/telemetry' -F '%t %x' | python3 tools/cbor_dump.py
+  .pio/build/native/program -q -C 60:frames.txt && python3 tools/cbor_dump.py frames.txt
+"""
+
+import json
+import struct
+import sys
+import time
+
+# tlm_key_t, telemetry.h
+KEYS = ["epoch", "uptime", "seq", "sensors", "circuits", "health"]
+HEALTH = ["heap", "lv_ms", "stale", "refused"]
+
+
+def decode(b, i=0):
+    """one item at b[i], (value, index past it); RFC 8949 minus indefinite lengths"""
+    major, ai = b[i] >> 5, b[i] & 0x1F
+    i += 1
+    if ai < 24:
+        v = ai
+    elif ai <= 27:
+        n = 1 << (ai - 24)
+        raw = bytes(b[i:i + n])
+        if len(raw) < n:
+            raise ValueError("truncated")
+        i += n
+        if major == 7:
+            return struct.unpack({2: ">e", 4: ">f", 8: ">d"}[n], raw)[0] if n > 1 else None, i
+        v = int.from_bytes(raw, "big")
+    else:
+        raise ValueError("indefinite length or reserved at %d" % (i - 1))
+    if major == 0:
+        return v, i
+    if major == 1:
+        return -1 - v, i
+    if major in (2, 3):
+        if i + v > len(b):
+            raise ValueError("truncated")
+        s = bytes(b[i:i + v])
+        return (s.decode("utf-8") if major == 3 else s), i + v
+    if major == 4:
+        a = []
+        for _ in range(v):
+            x, i = decode(b, i)
+            a.append(x)
+        return a, i
+    if major == 5:
+        m = {}
+        for _ in range(v):
+            k, i = decode(b, i)
+            m[k], i = decode(b, i)
+        return m, i
+    if major == 6:
+        return decode(b, i)  # tags aren't used, the tagged item
+    return {20: False, 21: True, 22: None, 23: None}.get(v), i
+
+
+def frame(b):
+    """a telemetry frame with named keys and values scaled back"""
+    m, n = decode(b)
+    if n != len(b) or not isinstance(m, dict):
+        raise ValueError("not a frame")
+    f = {KEYS[k] if isinstance(k, int) and k < len(KEYS) else str(k): v for k, v in m.items()}
+    f["sensors"] = {k: (None if v is None else v / 100.0) for k, v in f.get("sensors", {}).items()}
+    f["health"] = dict(zip(HEALTH, f.get("health", [])))
+    return f
+
+
+def show(topic, f):
+    t = time.strftime("%Y-%m-%d %H:%M:%S", time.gmtime(f["epoch"])) if f.get("epoch") else "no clock"
+    sens = " ".join("%s=%s" % (k, "-" if v is None else "%.2f" % v) for k, v in f["sensors"].items())
+    circ = " ".join("%s=%d%%" % (k, v) for k, v in f.get("circuits", {}).items())
+    health = " ".join("%s=%s" % kv for kv in f["health"].items())
+    return "%s %s #%s up %ss | %s | %s | %s" % (t, topic, f.get("seq"), f.get("uptime"), sens, circ, health)
+
+
+def main(args):
+    as_json = "-j" in args
+    raw = "-r" in args
+    files = [a for a in args if a not in ("-j", "-r")]
+    frames = []
+    if raw:
+        for fn in files:
+            with open(fn, "rb") as fd:
+                frames.append((fn, fd.read()))
+    else:
+        for fn in files or ["-"]:
+            fd = sys.stdin if fn == "-" else open(fn)
+            for line in fd:
+                parts = line.split()
+                if parts:
+                    frames.append((parts[0] if len(parts) > 1 else "-", bytes.fromhex(parts[-1])))
+            if fd is not sys.stdin:
+                fd.close()
+    bad = 0
+    for topic, b in frames:
+        try:
+            f = frame(b)
+        except (ValueError, IndexError, KeyError) as e:
+            bad += 1
+            print("%s: %d bytes, %s" % (topic, len(b), e), file=sys.stderr)
+            continue
+        if as_json:
+            f["topic"] = topic
+            print(json.dumps(f))
+        else:
+            print(show(topic, f))
+    return 1 if bad else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,160 @@
+# This file is part of formicula2.
+#
+# vice-mapper is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# vice-mapper is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with vice-mapper.  If not, see <https://www.gnu.org/licenses/>.
+
+"""RLE-compress lvgl image sources (output of the lvgl online converter, C array,
+true color) from assets/ into src/img_<name>.c, decoded line by line by src/img_rle.cpp.
+
+Runs as a PlatformIO pre-build script (extra_scripts = pre:tools/img_rle.py), only
+stale images are converted; or by hand: python3 tools/img_rle.py [-v] [assets/x.c ...]
+
+Stream layout, little endian, see img_rle.h:
+  'R' 'L' 'E' px_size, uint16 w, uint16 h, uint32 line_offset[h], packets...
+  packet: n < 0x80: n+1 literal pixels follow, n >= 0x80: next pixel repeated n-0x7f times
+"""
+
+import os
+import re
+import struct
+import sys
+
+MAGIC = b"RLE"
+MAX_RUN = 128
+
+# the color depth variants lvgl's converter emits, with their pixel size in bytes
+VARIANTS = [
+    ("LV_COLOR_DEPTH == 1 || LV_COLOR_DEPTH == 8", 1),
+    ("LV_COLOR_DEPTH == 16 && LV_COLOR_16_SWAP == 0", 2),
+    ("LV_COLOR_DEPTH == 16 && LV_COLOR_16_SWAP != 0", 2),
+    ("LV_COLOR_DEPTH == 32", 4),
+]
+
+
+def parse(fn):
+    src = open(fn).read()
+    name = re.search(r"const\s+lv_img_dsc_t\s+(\w+)\s*=", src).group(1)
+    w = int(re.search(r"\.header\.w\s*=\s*(\d+)", src).group(1))
+    h = int(re.search(r"\.header\.h\s*=\s*(\d+)", src).group(1))
+    if "LV_IMG_CF_TRUE_COLOR," not in src:
+        raise ValueError("%s: only LV_IMG_CF_TRUE_COLOR images are supported" % fn)
+    blocks = []
+    for cond, px in VARIANTS:
+        m = re.search(r"#if " + re.escape(cond) + r"\s*\n(.*?)#endif", src, re.S)
+        if not m:
+            continue
+        body = re.sub(r"/\*.*?\*/", "", m.group(1), flags=re.S)
+        data = bytes(int(x, 16) for x in re.findall(r"0x([0-9a-fA-F]{2})", body))
+        if len(data) != w * h * px:
+            raise ValueError("%s: %s has %d bytes, expected %d" % (fn, cond, len(data), w * h * px))
+        blocks.append((cond, px, data))
+    return name, w, h, blocks
+
+
+def encode_line(line, px):
+    pix = [line[i:i + px] for i in range(0, len(line), px)]
+    out = bytearray()
+    lit = []
+    i = 0
+    while i < len(pix):
+        run = 1
+        while i + run < len(pix) and run < MAX_RUN and pix[i + run] == pix[i]:
+            run += 1
+        if run > 1:
+            if lit:
+                out.append(len(lit) - 1)
+                out += b"".join(lit)
+                lit = []
+            out.append(0x80 + run - 1)
+            out += pix[i]
+            i += run
+        else:
+            lit.append(pix[i])
+            if len(lit) == MAX_RUN:
+                out.append(len(lit) - 1)
+                out += b"".join(lit)
+                lit = []
+            i += 1
+    if lit:
+        out.append(len(lit) - 1)
+        out += b"".join(lit)
+    return bytes(out)
+
+
+def encode(w, h, px, data):
+    lines = [encode_line(data[y * w * px:(y + 1) * w * px], px) for y in range(h)]
+    hdr = MAGIC + bytes([px]) + struct.pack("<HH", w, h)
+    pos = len(hdr) + 4 * h
+    offsets = []
+    for l in lines:
+        offsets.append(pos)
+        pos += len(l)
+    return hdr + struct.pack("<%dI" % h, *offsets) + b"".join(lines)
+
+
+def c_array(data):
+    rows = []
+    for i in range(0, len(data), 24):
+        rows.append("  " + ", ".join("0x%02x" % b for b in data[i:i + 24]) + ",")
+    return "\n".join(rows)
+
+
+def convert(fn, out_dir, verbose=False):
+    name, w, h, blocks = parse(fn)
+    out = os.path.join(out_dir, "img_" + os.path.basename(fn))
+    parts = ["/* generated by tools/img_rle.py from %s, don't edit */\n" % os.path.basename(fn),
+             "#include <lvgl.h>\n",
+             "static const uint8_t %s_rle[] = {" % name]
+    for cond, px, data in blocks:
+        rle = encode(w, h, px, data)
+        if verbose:
+            print("%s: %s %d -> %d bytes (%.1f%%)" % (name, cond, len(data), len(rle), 100.0 * len(rle) / len(data)))
+        parts += ["#if " + cond, c_array(rle), "#endif"]
+    parts += ["};\n",
+              "const lv_img_dsc_t %s = {" % name,
+              "  .header.always_zero = 0,",
+              "  .header.w = %d," % w,
+              "  .header.h = %d," % h,
+              "  .data_size = sizeof(%s_rle)," % name,
+              "  .header.cf = LV_IMG_CF_RAW,",
+              "  .data = %s_rle," % name,
+              "};\n"]
+    with open(out, "w") as f:
+        f.write("\n".join(parts))
+    return out
+
+
+def convert_stale(assets, out_dir, verbose=False):
+    for fn in sorted(os.listdir(assets)):
+        if not fn.endswith(".c"):
+            continue
+        src = os.path.join(assets, fn)
+        out = os.path.join(out_dir, "img_" + fn)
+        if os.path.exists(out) and os.path.getmtime(out) >= os.path.getmtime(src):
+            continue
+        print("img_rle: %s -> %s" % (src, convert(src, out_dir, verbose)))
+
+
+if __name__ == "__main__":
+    root = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+    args = [a for a in sys.argv[1:] if a != "-v"]
+    verbose = "-v" in sys.argv[1:]
+    if args:
+        for a in args:
+            print(convert(a, os.path.join(root, "src"), verbose))
+    else:
+        convert_stale(os.path.join(root, "assets"), os.path.join(root, "src"), verbose)
+else:
+    Import("env")  # noqa: F821 - PlatformIO pre-build script
+    root = env.subst("$PROJECT_DIR")  # noqa: F821
+    convert_stale(os.path.join(root, "assets"), os.path.join(root, "src"))